@@ -0,0 +1,282 @@
+// Copyright 2017 Bablawn3d5
+
+#define CATCH_CONFIG_MAIN
+
+// NOTE: MUST be first include. See http://docs.python.org/2/extending/extending.html
+#include <pybind11/pybind11.h>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include "entityx/python/3rdparty/catch.hpp"
+#include "entityx/entityx.h"
+#include "entityx/python/PythonScript.hpp"
+#include "entityx/python/PythonSystem.h"
+#include "entityx/python/SharedComponents.hpp"
+#include "entityx/python/ShardedWorld.h"
+
+namespace py = pybind11;
+using namespace entityx;
+using namespace entityx::python;
+
+struct Position {
+  Position(float x = 0.0, float y = 0.0) : x(x), y(y) {}
+
+  float x, y;
+};
+
+PYBIND11_PLUGIN(entityx_python_benchmark) {
+  py::module m("entityx_python_benchmark");
+  py::class_<Position> position(m, "Position");
+  position
+    .def(py::init<float, float>(), py::arg("x") = 0.f, py::arg("y") = 0.f)
+    .def("assign_to", &assign_to<Position>)
+    .def_static("get_component", &get_component<Position>,
+                py::return_value_policy::reference);
+  def_tracked(position, "x", &Position::x);
+  def_tracked(position, "y", &Position::y);
+  return m.ptr();
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+class BenchmarkWorld {
+protected:
+  BenchmarkWorld() : entity_manager(event_manager), python(entity_manager) {
+    python.host()->add_module("entityx_python_benchmark", &pybind11_init);
+    python.add_path(ENTITYX_PYTHON_TEST_DATA);
+    python.configure(event_manager);
+  }
+
+  ~BenchmarkWorld() {
+    entity_manager.reset();
+  }
+
+  void spawn(const char *module, const char *cls, int count) {
+    for ( int i = 0; i < count; ++i ) {
+      entity_manager.create().assign<PythonScript>(module, cls);
+    }
+  }
+
+  EventManager event_manager;
+  EntityManager entity_manager;
+  PythonSystem python;
+};
+
+TEST_CASE_METHOD(BenchmarkWorld, "BenchmarkParallelUpdate") {
+  const int entities = 10000;
+  const int frames = 10;
+  spawn("entityx.tests.benchmark", "Mover", entities);
+  std::cout << "PythonSystem::update(), " << entities << " scripts, "
+#ifdef Py_GIL_DISABLED
+            << "free-threaded"
+#else
+            << "with GIL"
+#endif
+            << std::endl;
+  double base = 0.0;
+  for ( size_t threads : {1, 2, 4, 8} ) {
+    python.set_update_threads(threads);
+    python.update(entity_manager, event_manager, 0.016);  // warm up
+    const Clock::time_point start = Clock::now();
+    for ( int frame = 0; frame < frames; ++frame ) {
+      python.update(entity_manager, event_manager, 0.016);
+    }
+    const double frame = seconds_since(start) / frames;
+    if ( threads == 1 )
+      base = frame;
+    std::cout << std::setw(3) << threads << " threads: " << std::fixed << std::setprecision(2)
+              << frame * 1000.0 << " ms/frame, speedup " << base / frame << "x" << std::endl;
+  }
+  python.set_update_threads(1);
+}
+
+// Every count-th Mover of the scenario, in a worker process.
+class MoverShard : public Shard {
+public:
+  MoverShard(size_t index, size_t count, int entities, SharedComponents<Position> &positions)
+    : entity_manager(event_manager), python(entity_manager), index(index),
+      positions(positions) {
+    python.host()->add_module("entityx_python_benchmark", &pybind11_init);
+    python.add_path(ENTITYX_PYTHON_TEST_DATA);
+    python.configure(event_manager);
+    for ( int i = static_cast<int>(index); i < entities; i += static_cast<int>(count) ) {
+      entity_manager.create().assign<PythonScript>("entityx.tests.benchmark", "Mover");
+    }
+  }
+
+  ~MoverShard() {
+    entity_manager.reset();
+  }
+
+  void update(TimeDelta dt) override {
+    python.update(entity_manager, event_manager, dt);
+    positions.publish(index, entity_manager);
+  }
+
+private:
+  EventManager event_manager;
+  EntityManager entity_manager;
+  PythonSystem python;
+  size_t index;
+  SharedComponents<Position> &positions;
+};
+
+TEST_CASE("BenchmarkShardedWorld") {
+  const int entities = 10000;
+  const int frames = 10;
+  std::cout << "ShardedWorld::update(), " << entities << " scripts" << std::endl;
+  double base = 0.0;
+  for ( size_t processes : {1, 2, 4, 8} ) {
+    SharedComponents<Position> positions(
+      "/dev/shm/entityx_python_benchmark_" + std::to_string(::getpid()), processes,
+      entities / processes + 1);
+    ShardedWorld world(processes, [&](size_t index, size_t count) {
+      return std::unique_ptr<Shard>(new MoverShard(index, count, entities, positions));
+    });
+    world.update(0.016);  // warm up
+    const Clock::time_point start = Clock::now();
+    for ( int frame = 0; frame < frames; ++frame ) {
+      world.update(0.016);
+    }
+    const double frame = seconds_since(start) / frames;
+
+    // The coordinator reads every shard's components in place.
+    size_t published = 0;
+    for ( size_t shard = 0; shard < processes; ++shard ) {
+      published += positions.size(shard);
+    }
+    REQUIRE(published == static_cast<size_t>(entities));
+    REQUIRE(positions.begin(0)->component.x > 0.f);
+
+    if ( processes == 1 )
+      base = frame;
+    std::cout << std::setw(3) << processes << " processes: " << std::fixed << std::setprecision(2)
+              << frame * 1000.0 << " ms/frame, speedup " << base / frame << "x" << std::endl;
+  }
+}
+
+TEST_CASE("BenchmarkSharedPublish") {
+  const int frames = 100;
+  std::cout << "SharedComponents::publish(), per call" << std::endl;
+  for ( int count : {10000, 100000} ) {
+    EventManager events;
+    EntityManager entities(events);
+    for ( int i = 0; i < count; ++i ) {
+      entities.create().assign<Position>(1.f, 2.f);
+    }
+    SharedComponents<Position> positions(
+      "/dev/shm/entityx_python_benchmark_" + std::to_string(::getpid()), 1, count);
+    positions.publish(0, entities);  // fault the pages in
+    const Clock::time_point start = Clock::now();
+    for ( int frame = 0; frame < frames; ++frame ) {
+      positions.publish(0, entities);
+    }
+    const double publish = seconds_since(start) / frames;
+    REQUIRE(positions.size(0) == static_cast<size_t>(count));
+    std::cout << std::setw(7) << count << " components: " << std::fixed << std::setprecision(3)
+              << publish * 1000.0 << " ms, " << publish * 1e9 / count << " ns/component"
+              << std::endl;
+  }
+}
+
+TEST_CASE_METHOD(BenchmarkWorld, "BenchmarkSnapshot") {
+  const int entities = 100000;
+  const std::string path = "/tmp/entityx_python_benchmark_" + std::to_string(::getpid());
+  python.register_component<Position>("Position")
+    .field("x", &Position::x)
+    .field("y", &Position::y);
+  spawn("entityx.tests.benchmark", "Mover", entities);
+  python.update(entity_manager, event_manager, 0.016);
+
+  Clock::time_point start = Clock::now();
+  python.save_snapshot(path);
+  const double save = seconds_since(start);
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  const double megabytes = static_cast<double>(file.tellg()) / (1024.0 * 1024.0);
+
+  entity_manager.reset();
+  start = Clock::now();
+  REQUIRE(python.load_snapshot(path).size() == static_cast<size_t>(entities));
+  const double load = seconds_since(start);
+  ::unlink(path.c_str());
+
+  std::cout << "Snapshot of " << entities << " scripts, " << std::fixed << std::setprecision(2)
+            << megabytes << " MB" << std::endl
+            << "  save: " << save * 1000.0 << " ms, " << entities / save / 1000.0
+            << "k entities/s" << std::endl
+            << "  load: " << load * 1000.0 << " ms, " << entities / load / 1000.0
+            << "k entities/s" << std::endl;
+}
+
+TEST_CASE_METHOD(BenchmarkWorld, "BenchmarkLoadLevel") {
+  const int entities = 10000;
+  const std::string path = "/tmp/entityx_python_benchmark_" + std::to_string(::getpid());
+  python.register_component<Position>("Position")
+    .field("x", &Position::x)
+    .field("y", &Position::y);
+  {
+    std::ofstream out(path);
+    out << "{\"entities\": [{\"count\": " << entities
+        << ", \"components\": {\"Position\": {\"x\": 1, \"y\": 2}}"
+        << ", \"script\": {\"module\": \"entityx.tests.benchmark\", \"class\": \"Mover\"}}]}";
+  }
+
+  Clock::time_point start = Clock::now();
+  LoadTiming timing = python.load_level(path);
+  const double total = seconds_since(start);
+  ::unlink(path.c_str());
+  REQUIRE(timing.entities == static_cast<size_t>(entities));
+
+  std::cout << "Level of " << entities << " scripts: " << std::fixed << std::setprecision(2)
+            << total * 1000.0 << " ms" << std::endl
+            << "  parse: " << timing.parse * 1000.0 << " ms" << std::endl
+            << "  spawn: " << timing.spawn * 1000.0 << " ms" << std::endl
+            << "  instantiate: " << timing.instantiate * 1000.0 << " ms" << std::endl;
+}
+
+TEST_CASE_METHOD(BenchmarkWorld, "BenchmarkRollback") {
+  const int frames = 100;
+  python.register_component<Position>("Position")
+    .field("x", &Position::x)
+    .field("y", &Position::y);
+  std::cout << "Rollback snapshots, per frame" << std::endl;
+  int spawned = 0;
+  for ( int entities : {100, 1000} ) {
+    spawn("entityx.tests.benchmark", "Mover", entities - spawned);
+    spawned = entities;
+
+    python.enable_rollback(0);
+    Clock::time_point start = Clock::now();
+    for ( int frame = 0; frame < frames; ++frame ) {
+      python.update(entity_manager, event_manager, 0.016);
+    }
+    const double plain = seconds_since(start) / frames;
+
+    python.enable_rollback(8);
+    start = Clock::now();
+    for ( int frame = 0; frame < frames; ++frame ) {
+      python.update(entity_manager, event_manager, 0.016);
+    }
+    const double saving = seconds_since(start) / frames;
+
+    start = Clock::now();
+    for ( int frame = 0; frame < frames; ++frame ) {
+      python.rollback(python.frame());
+    }
+    const double rewind = seconds_since(start) / frames;
+
+    std::string saved;
+    python.snapshot(saved);
+    std::cout << std::setw(6) << entities << " scripts: save " << std::fixed << std::setprecision(3)
+              << (saving - plain) * 1000.0 << " ms, rollback " << rewind * 1000.0 << " ms, "
+              << saved.size() << " bytes" << std::endl;
+  }
+}
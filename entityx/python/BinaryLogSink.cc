@@ -0,0 +1,104 @@
+// Copyright 2017 Bablawn3d5
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include "entityx/python/BinaryLogSink.h"
+
+namespace entityx {
+namespace python {
+
+const size_t BinaryLogSink::DEFAULT_SEGMENT_SIZE;
+const size_t BinaryLogSink::DEFAULT_MAX_SEGMENTS;
+
+static const char BINARY_LOG_MAGIC[8] = { 'E', 'X', 'P', 'Y', 'L', 'O', 'G', '\0' };
+static const uint32_t BINARY_LOG_VERSION = 1;
+
+static size_t padded(size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+BinaryLogSink::BinaryLogSink(const std::string &path, size_t segment_size, size_t max_segments)
+  : path_(path), segment_size_(segment_size), max_segments_(max_segments),
+    sequence_(0), offset_(0) {
+  if ( segment_size_ < sizeof(BinaryLogSegmentHeader) + sizeof(BinaryLogRecordHeader) + 8 )
+    throw std::invalid_argument("BinaryLogSink segment_size is too small");
+  if ( max_segments_ == 0 )
+    throw std::invalid_argument("BinaryLogSink needs at least one segment");
+  // Carry on from the segments of an earlier run, so the sequence keeps
+  // ordering them and the oldest is overwritten first.
+  for ( size_t i = 0; i < max_segments_; ++i ) {
+    std::ifstream in(path_ + "." + std::to_string(i), std::ios::binary);
+    BinaryLogSegmentHeader header;
+    if ( !in.read(reinterpret_cast<char *>(&header), sizeof(header)) )
+      continue;
+    if ( std::memcmp(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic)) != 0 )
+      continue;
+    sequence_ = std::max(sequence_, header.sequence + 1);
+  }
+  open_segment();
+}
+
+BinaryLogSink::~BinaryLogSink() {
+  segment_.sync();
+}
+
+void BinaryLogSink::open_segment() {
+  segment_.close();
+  segment_.open(path_ + "." + std::to_string(sequence_ % max_segments_), segment_size_);
+  BinaryLogSegmentHeader header;
+  std::memcpy(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic));
+  header.version = BINARY_LOG_VERSION;
+  header.header_size = sizeof(BinaryLogSegmentHeader);
+  header.sequence = sequence_;
+  header.size = 0;
+  std::memcpy(segment_.data(), &header, sizeof(header));
+  offset_ = sizeof(BinaryLogSegmentHeader);
+}
+
+void BinaryLogSink::write(LogLevel level, Entity::Id entity, const char *message, size_t size) {
+  const size_t capacity = segment_size_ - sizeof(BinaryLogSegmentHeader) - sizeof(BinaryLogRecordHeader);
+  size = std::min(size, capacity & ~static_cast<size_t>(7));
+
+  BinaryLogRecordHeader record;
+  record.timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count());
+  record.entity = entity.id();
+  record.level = static_cast<uint32_t>(level);
+  record.length = static_cast<uint32_t>(size);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  const size_t total = sizeof(BinaryLogRecordHeader) + padded(size);
+  if ( offset_ + total > segment_size_ ) {
+    segment_.sync();
+    ++sequence_;
+    open_segment();
+  }
+  char *out = segment_.data() + offset_;
+  std::memcpy(out, &record, sizeof(record));
+  std::memcpy(out + sizeof(record), message, size);
+  offset_ += total;
+  // Publish the record by bumping the segment size last. The size is 8 byte
+  // aligned, as segments are mapped at page boundaries.
+  const uint64_t used = offset_ - sizeof(BinaryLogSegmentHeader);
+  uint64_t *size_field =
+    reinterpret_cast<uint64_t *>(segment_.data() + offsetof(BinaryLogSegmentHeader, size));
+  __atomic_store_n(size_field, used, __ATOMIC_RELEASE);
+}
+
+void BinaryLogSink::write(const LogRecord &record) {
+  const std::string message = record.cls + ": " + record.message;
+  write(record.level, record.entity, message.data(), message.size());
+}
+
+void BinaryLogSink::flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  segment_.sync();
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,86 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "entityx/Entity.h"
+#include "entityx/python/MappedFile.h"
+#include "entityx/python/PythonLogger.h"
+
+namespace entityx {
+namespace python {
+
+/**
+ * Writes script output as fixed-format binary records into memory-mapped
+ * segment files, for keeping full script logs in production.
+ *
+ * Segments are named `<path>.0` ... `<path>.<max_segments - 1>` and reused
+ * round robin, so the oldest segment is overwritten once all are full. Each
+ * segment starts with a BinaryLogSegmentHeader followed by records, each a
+ * BinaryLogRecordHeader followed by the message padded to 8 bytes. Only the
+ * first `size` bytes after the segment header are valid. Segment sequences
+ * continue from those already at `path`, so they order segments across runs.
+ *
+ * Read the segments with tools/logreader.py. Use PythonSystem::log_to() to
+ * send script output here.
+ */
+class BinaryLogSink {
+public:
+  static const size_t DEFAULT_SEGMENT_SIZE = 16 * 1024 * 1024;
+  static const size_t DEFAULT_MAX_SEGMENTS = 4;
+
+  BinaryLogSink(const std::string &path,
+                size_t segment_size = DEFAULT_SEGMENT_SIZE,
+                size_t max_segments = DEFAULT_MAX_SEGMENTS);
+  ~BinaryLogSink();
+
+  BinaryLogSink(const BinaryLogSink &) = delete;
+  BinaryLogSink &operator = (const BinaryLogSink &) = delete;
+
+  /**
+   * Append a record. Messages that do not fit into a segment are truncated.
+   */
+  void write(LogLevel level, Entity::Id entity, const char *message, size_t size);
+
+  /// Append a script log record, prefixing the message with its class.
+  void write(const LogRecord &record);
+
+  /// Schedule the current segment to be written back to disk.
+  void flush();
+
+  size_t segment_size() const { return segment_size_; }
+  size_t max_segments() const { return max_segments_; }
+
+private:
+  void open_segment();
+
+  std::mutex mutex_;
+  const std::string path_;
+  const size_t segment_size_;
+  const size_t max_segments_;
+  uint64_t sequence_;
+  size_t offset_;
+  MappedFile segment_;
+};
+
+#pragma pack(push, 1)
+struct BinaryLogSegmentHeader {
+  char magic[8];          // "EXPYLOG\0"
+  uint32_t version;
+  uint32_t header_size;   // sizeof(BinaryLogSegmentHeader)
+  uint64_t sequence;      // Increases by one for each segment written.
+  uint64_t size;          // Bytes of records following the header.
+};
+
+struct BinaryLogRecordHeader {
+  uint64_t timestamp;     // Nanoseconds since the Unix epoch.
+  uint64_t entity;        // Entity::Id::id()
+  uint32_t level;         // LogLevel
+  uint32_t length;        // Message bytes, not including padding.
+};
+#pragma pack(pop)
+
+}  // namespace python
+}  // namespace entityx
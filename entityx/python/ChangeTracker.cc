@@ -0,0 +1,338 @@
+// Copyright 2017 Bablawn3d5
+
+#include "entityx/python/ChangeTracker.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include "entityx/python/PythonScript.hpp"
+
+namespace entityx {
+namespace python {
+
+// Enabled trackers, for mark_written(). The mutex also guards their marks
+// and component owners.
+static std::vector<ChangeTracker *> &tracker_registry() {
+  static std::vector<ChangeTracker *> trackers;
+  return trackers;
+}
+
+static std::mutex &tracker_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// The size of the registry, so that writes skip the mutex while no world
+// tracks changes.
+static std::atomic<size_t> &tracker_count() {
+  static std::atomic<size_t> count(0);
+  return count;
+}
+
+void mark_written(const void *component) {
+  if ( tracker_count() == 0 )
+    return;
+  std::lock_guard<std::mutex> lock(tracker_mutex());
+  for ( auto tracker : tracker_registry() ) {
+    auto found = tracker->owners_.find(component);
+    if ( found != tracker->owners_.end() )
+      tracker->mark_locked(found->second);
+  }
+}
+
+ChangeTracker::~ChangeTracker() {
+  std::lock_guard<std::mutex> lock(tracker_mutex());
+  auto &trackers = tracker_registry();
+  trackers.erase(std::remove(trackers.begin(), trackers.end(), this), trackers.end());
+  tracker_count() = trackers.size();
+}
+
+void ChangeTracker::enable(size_t history, bool scan) {
+  history_ = history;
+  scan_ = scan;
+  if ( enabled_ )
+    return;
+  std::lock_guard<std::mutex> lock(tracker_mutex());
+  enabled_ = true;
+  seeded_ = false;
+  tracker_registry().push_back(this);
+  tracker_count() = tracker_registry().size();
+}
+
+void ChangeTracker::mark(Entity::Id id) {
+  if ( !enabled_ )
+    return;
+  std::lock_guard<std::mutex> lock(tracker_mutex());
+  mark_locked(id);
+}
+
+void ChangeTracker::mark_locked(Entity::Id id) {
+  const size_t index = id.index();
+  if ( index >= marked_ids_.size() )
+    marked_ids_.resize(index + 1, 0);
+  // Ids are never 0, so a 0 slot is unmarked.
+  if ( marked_ids_[index] == id.id() )
+    return;
+  marked_ids_[index] = id.id();
+  marked_.push_back(id);
+}
+
+void ChangeTracker::added(size_t component, Entity::Id id, const void *data) {
+  if ( !enabled_ )
+    return;
+  std::lock_guard<std::mutex> lock(tracker_mutex());
+  owners_[data] = id;
+  mark_locked(id);
+}
+
+void ChangeTracker::removed(size_t component, Entity::Id id, const void *data) {
+  if ( !enabled_ )
+    return;
+  std::lock_guard<std::mutex> lock(tracker_mutex());
+  owners_.erase(data);
+  mark_locked(id);
+}
+
+void ChangeTracker::seed() {
+  std::lock_guard<std::mutex> lock(tracker_mutex());
+  owners_.clear();
+  for ( auto &component : components_.components() ) {
+    component->each(entities_, [this](Entity::Id id, void *data) {
+      owners_[data] = id;
+      mark_locked(id);
+    });
+  }
+  entities_.each<PythonScript>([this](Entity entity, PythonScript &) {
+    mark_locked(entity.id());
+  });
+  seeded_ = true;
+}
+
+void ChangeTracker::scan_locked() {
+  const auto &components = components_.components();
+  for ( size_t c = 0; c < components.size(); ++c ) {
+    const ComponentTrack &track = tracks_[c];
+    const size_t size = components[c]->size();
+    components[c]->each(entities_, [&](Entity::Id id, void *data) {
+      const size_t index = id.index();
+      if ( index >= track.states.size() || !track.states[index].present ||
+           std::memcmp(&track.copies[index * size], data, size) != 0 )
+        mark_locked(id);
+    });
+  }
+}
+
+ChangeTracker::EntityState &ChangeTracker::touch(Entity::Id id) {
+  const size_t index = id.index();
+  if ( index >= states_.size() )
+    states_.resize(index + 1);
+  EntityState &entity = states_[index];
+  if ( entity.tracked && entity.id != id ) {
+    removals_.emplace_back(frame_, entity.id);
+    forget(index);
+  }
+  if ( !entity.tracked ) {
+    entity.tracked = true;
+    entity.id = id;
+    entity.changed = frame_;
+  }
+  return entity;
+}
+
+void ChangeTracker::forget(size_t index) {
+  states_[index] = EntityState();
+  for ( auto &track : tracks_ ) {
+    if ( index < track.states.size() )
+      track.states[index] = ComponentState();
+  }
+  if ( index < scripts_.size() )
+    scripts_[index] = ScriptState();
+}
+
+const ChangeTracker::EntityState *ChangeTracker::find(Entity::Id id) const {
+  const size_t index = id.index();
+  if ( index >= states_.size() || !states_[index].tracked || states_[index].id != id )
+    return nullptr;
+  return &states_[index];
+}
+
+void ChangeTracker::remove(Entity::Id id) {
+  if ( !find(id) )
+    return;
+  removals_.emplace_back(frame_, id);
+  forget(id.index());
+}
+
+void ChangeTracker::commit(uint64_t frame) {
+  frame_ = frame;
+  const auto &components = components_.components();
+  if ( tracks_.size() < components.size() ) {
+    tracks_.resize(components.size());
+    // Components of a type registered late have no known owners yet.
+    seeded_ = false;
+  }
+  if ( !seeded_ )
+    seed();
+  std::vector<Entity::Id> marked;
+  {
+    std::lock_guard<std::mutex> lock(tracker_mutex());
+    if ( scan_ )
+      scan_locked();
+    marked.swap(marked_);
+    for ( auto id : marked ) {
+      marked_ids_[id.index()] = 0;
+    }
+  }
+
+  py::object dumps;
+  for ( auto id : marked ) {
+    if ( !entities_.valid(id) ) {
+      remove(id);
+      continue;
+    }
+    const size_t index = id.index();
+    EntityState *entity = nullptr;
+    for ( size_t c = 0; c < components.size(); ++c ) {
+      ComponentTrack &track = tracks_[c];
+      ComponentState *state = index < track.states.size() ? &track.states[index] : nullptr;
+      const void *data = components[c]->get(entities_, id);
+      if ( !data ) {
+        if ( state && state->present && find(id) ) {
+          state->present = false;
+          state->removed = frame_;
+          states_[index].changed = frame_;
+        }
+        continue;
+      }
+      if ( !entity )
+        entity = &touch(id);
+      const size_t size = components[c]->size();
+      if ( index >= track.states.size() ) {
+        track.states.resize(index + 1);
+        track.copies.resize((index + 1) * size);
+      }
+      state = &track.states[index];
+      char *copy = &track.copies[index * size];
+      if ( !state->present || std::memcmp(copy, data, size) != 0 ) {
+        std::memcpy(copy, data, size);
+        state->present = true;
+        state->changed = frame_;
+        entity->changed = frame_;
+      }
+    }
+
+    auto script = entities_.component<PythonScript>(id);
+    if ( !script || !script->object ) {
+      if ( index < scripts_.size() && scripts_[index].present && find(id) ) {
+        scripts_[index] = ScriptState();
+        scripts_[index].removed = frame_;
+        states_[index].changed = frame_;
+      }
+    } else {
+      if ( !entity )
+        entity = &touch(id);
+      if ( index >= scripts_.size() )
+        scripts_.resize(index + 1);
+      ScriptState &state = scripts_[index];
+      if ( !dumps )
+        dumps = pickle_module().attr("dumps");
+      py::object pickled = py::reinterpret_steal<py::object>(PyObject_CallFunction(
+        dumps.ptr(), const_cast<char *>("Oi"), serializer_.script_state(script->object).ptr(), 2));
+      // State that does not pickle is left out from now on.
+      if ( !pickled ) {
+        PyObject *type;
+        PyObject *value;
+        PyObject *trace;
+        PyErr_Fetch(&type, &value, &trace);
+        if ( !serializer_.skip_unpicklable(script->object) ) {
+          PyErr_Restore(type, value, trace);
+          throw py::error_already_set();
+        }
+        Py_XDECREF(type);
+        Py_XDECREF(value);
+        Py_XDECREF(trace);
+        pickled = dumps(serializer_.script_state(script->object), 2);
+      }
+      char *data = nullptr;
+      Py_ssize_t size = 0;
+      if ( PyBytes_AsStringAndSize(pickled.ptr(), &data, &size) != 0 )
+        throw py::error_already_set();
+      if ( !state.present ) {
+        state.present = true;
+        state.created = frame_;
+      } else if ( state.pickle.size() == static_cast<size_t>(size) &&
+                  std::memcmp(state.pickle.data(), data, state.pickle.size()) == 0 ) {
+        continue;
+      }
+      state.pickle.assign(data, static_cast<size_t>(size));
+      state.changed = frame_;
+      entity->changed = frame_;
+    }
+
+    // Nothing left to save: the entity counts as removed.
+    if ( !entity )
+      remove(id);
+  }
+  while ( !removals_.empty() && removals_.front().first < horizon() ) {
+    removals_.pop_front();
+  }
+}
+
+std::vector<Entity::Id> ChangeTracker::changed(uint64_t since) const {
+  std::vector<Entity::Id> ids;
+  for ( auto &entity : states_ ) {
+    if ( entity.tracked && entity.changed > since )
+      ids.push_back(entity.id);
+  }
+  return ids;
+}
+
+std::vector<Entity::Id> ChangeTracker::removed(uint64_t since) const {
+  std::vector<Entity::Id> ids;
+  for ( auto &removal : removals_ ) {
+    if ( removal.first > since )
+      ids.push_back(removal.second);
+  }
+  return ids;
+}
+
+const void *ChangeTracker::component_changed(size_t component, Entity::Id id,
+                                             uint64_t since) const {
+  const size_t index = id.index();
+  if ( !find(id) || component >= tracks_.size() || index >= tracks_[component].states.size() )
+    return nullptr;
+  const ComponentTrack &track = tracks_[component];
+  const ComponentState &state = track.states[index];
+  if ( !state.present || state.changed <= since )
+    return nullptr;
+  return &track.copies[index * components_.components()[component]->size()];
+}
+
+bool ChangeTracker::component_removed(size_t component, Entity::Id id, uint64_t since) const {
+  const size_t index = id.index();
+  if ( !find(id) || component >= tracks_.size() || index >= tracks_[component].states.size() )
+    return false;
+  const ComponentState &state = tracks_[component].states[index];
+  return !state.present && state.removed > since;
+}
+
+bool ChangeTracker::script_created(Entity::Id id, uint64_t since) const {
+  const size_t index = id.index();
+  return find(id) && index < scripts_.size() && scripts_[index].present &&
+         scripts_[index].created > since;
+}
+
+bool ChangeTracker::script_changed(Entity::Id id, uint64_t since) const {
+  const size_t index = id.index();
+  return find(id) && index < scripts_.size() && scripts_[index].present &&
+         scripts_[index].changed > since;
+}
+
+bool ChangeTracker::script_removed(Entity::Id id, uint64_t since) const {
+  const size_t index = id.index();
+  return find(id) && index < scripts_.size() && !scripts_[index].present &&
+         scripts_[index].removed > since;
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,189 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "entityx/Entity.h"
+#include "entityx/python/ComponentRegistry.hpp"
+#include "entityx/python/WorldSerializer.h"
+
+namespace py = pybind11;
+
+namespace entityx {
+namespace python {
+
+/**
+ * Records the frame in which each registered component and each script's
+ * state last changed, for delta snapshots.
+ *
+ * commit() only looks at entities marked since the previous commit, so a
+ * frame costs what changed rather than the size of the world. Entities
+ * are marked when:
+ *
+ *  - they gain or lose a registered component or a script (the
+ *    PythonSystem calls added() and removed()),
+ *  - a script writes a component field bound with def_tracked(), which
+ *    calls mark_written(),
+ *  - a script sets a public attribute of its own, or
+ *  - mark() is called, which scripts changing a list or dict in place
+ *    must do, or
+ *  - C++ code writes a registered component in place and either calls
+ *    mark() or tracking scans components.
+ *
+ * Scanning compares every registered component with its copy at each
+ * commit, so it costs a memcmp per component in the world.
+ *
+ * A marked entity's components are compared with copies taken at the
+ * previous commit and its script state by its pickle, so only real changes
+ * count. The first commit marks every entity.
+ *
+ * Entities are the ones WorldSerializer::entities() would save; an entity
+ * that loses its last registered component and its script counts as
+ * removed.
+ */
+class ChangeTracker {
+public:
+  ChangeTracker(EntityManager &entities, const ComponentRegistry &components,
+                WorldSerializer &serializer)
+    : entities_(entities), components_(components), serializer_(serializer),
+      enabled_(false), seeded_(false), scan_(false), history_(0), frame_(0) {}
+  ~ChangeTracker();
+
+  /**
+   * Start tracking. Removals are remembered for `history` frames, so deltas
+   * may go back that far. With `scan` components written in place without
+   * mark() are noticed too.
+   */
+  void enable(size_t history, bool scan = false);
+
+  /// Note that `id` may have changed, for the next commit. Thread safe.
+  void mark(Entity::Id id);
+
+  /// The `component`th registered component was assigned to `id` at `data`.
+  void added(size_t component, Entity::Id id, const void *data);
+
+  /// The `component`th registered component at `data` is being removed from `id`.
+  void removed(size_t component, Entity::Id id, const void *data);
+
+  bool enabled() const {
+    return enabled_;
+  }
+
+  /// The last committed frame; 0 before the first commit.
+  uint64_t frame() const {
+    return frame_;
+  }
+
+  /// The oldest frame a delta may start from.
+  uint64_t horizon() const {
+    return frame_ > history_ ? frame_ - history_ : 0;
+  }
+
+  /// End `frame` by recording what changed in the marked entities.
+  /// Requires the GIL.
+  void commit(uint64_t frame);
+
+  /// Tracked entities changed after frame `since`, in index order.
+  std::vector<Entity::Id> changed(uint64_t since) const;
+
+  /// Entities removed after frame `since`.
+  std::vector<Entity::Id> removed(uint64_t since) const;
+
+  /**
+   * The `component`th registered component of `id` as of the last commit if
+   * it changed after `since`, else null.
+   */
+  const void *component_changed(size_t component, Entity::Id id, uint64_t since) const;
+
+  /// Whether the entity lost the `component`th registered component after `since`.
+  bool component_removed(size_t component, Entity::Id id, uint64_t since) const;
+
+  /// Whether the entity's script was assigned after `since`.
+  bool script_created(Entity::Id id, uint64_t since) const;
+
+  /// Whether the entity's script was assigned or its state changed after `since`.
+  bool script_changed(Entity::Id id, uint64_t since) const;
+
+  /// Whether the entity lost its script after `since`.
+  bool script_removed(Entity::Id id, uint64_t since) const;
+
+private:
+  friend void mark_written(const void *component);
+
+  struct EntityState {
+    EntityState() : tracked(false), changed(0) {}
+
+    Entity::Id id;
+    bool tracked;
+    uint64_t changed;
+  };
+
+  struct ComponentState {
+    ComponentState() : present(false), changed(0), removed(0) {}
+
+    bool present;
+    uint64_t changed;
+    uint64_t removed;
+  };
+
+  // One registered component type, indexed by entity index.
+  struct ComponentTrack {
+    std::vector<ComponentState> states;
+    // Each entity's component as of the last commit.
+    std::vector<char> copies;
+  };
+
+  struct ScriptState {
+    ScriptState() : present(false), created(0), changed(0), removed(0) {}
+
+    bool present;
+    uint64_t created;
+    uint64_t changed;
+    uint64_t removed;
+    std::string pickle;
+  };
+
+  // The state of `id`, forgetting an earlier entity with the same index.
+  EntityState &touch(Entity::Id id);
+  void forget(size_t index);
+  const EntityState *find(Entity::Id id) const;
+  // Record that `id` is gone, if it was tracked.
+  void remove(Entity::Id id);
+  // Mark every entity and learn where their components live.
+  void seed();
+  // mark() with the registry mutex held.
+  void mark_locked(Entity::Id id);
+  // Mark entities whose components differ from their copies, with the
+  // registry mutex held.
+  void scan_locked();
+
+  EntityManager &entities_;
+  const ComponentRegistry &components_;
+  WorldSerializer &serializer_;
+  bool enabled_;
+  bool seeded_;
+  bool scan_;
+  uint64_t history_;
+  uint64_t frame_;
+  std::vector<EntityState> states_;
+  std::vector<ComponentTrack> tracks_;
+  std::vector<ScriptState> scripts_;
+  // (frame, entity) for every removal within the history.
+  std::deque<std::pair<uint64_t, Entity::Id>> removals_;
+  // Guarded by the registry mutex: the entities marked since the last
+  // commit, the id each index was last marked for, and which entity owns
+  // each registered component, so mark_written() can find it.
+  std::vector<Entity::Id> marked_;
+  std::vector<uint64_t> marked_ids_;
+  std::unordered_map<const void *, Entity::Id> owners_;
+};
+
+}  // namespace python
+}  // namespace entityx
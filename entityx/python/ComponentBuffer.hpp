@@ -0,0 +1,217 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+#include "entityx/Entity.h"
+#include "entityx/python/ComponentRegistry.hpp"
+
+namespace entityx {
+namespace python {
+
+/**
+ * Type-erased interface PythonSystem keeps its ComponentBuffers behind.
+ */
+class BaseComponentBuffer {
+public:
+  virtual ~BaseComponentBuffer() {}
+
+  /**
+   * Merge copies changed since the last sync() as sync() does, e.g. by
+   * event handlers between frames, then copy every component from the
+   * EntityManager, on the thread that owns it, before scripts run
+   * elsewhere. Until the next sync() scripts only see these copies and
+   * never touch the EntityManager.
+   */
+  virtual void snapshot() = 0;
+
+  /**
+   * Copy components scripts changed since the last sync() into the
+   * EntityManager, then refresh every buffered copy from it.
+   */
+  virtual void sync() = 0;
+};
+
+/**
+ * Script-side copies of one component type of one EntityManager.
+ *
+ * While a buffer exists, get_component<Component>() hands scripts a copy of
+ * the component instead of the component itself. C++ systems can then work
+ * on the real components while scripts run on another thread; sync() merges
+ * the two at a point where neither runs.
+ *
+ * Merging is per component, not per field: a component the script changed
+ * replaces the real one as a whole, so C++ writes to it since snapshot()
+ * are lost. Components the script did not change keep C++ writes.
+ *
+ * Copies have stable addresses, as Python objects keep pointers to them.
+ */
+template <typename Component>
+class ComponentBuffer : public BaseComponentBuffer {
+public:
+  static_assert(std::is_trivially_copyable<Component>::value,
+                "double buffered components must be trivially copyable");
+
+  explicit ComponentBuffer(EntityManager &entities) : entities_(entities), frozen_(false) {
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    registry().push_back(this);
+    ++registered();
+    ++changes();
+  }
+
+  ~ComponentBuffer() {
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    auto &buffers = registry();
+    buffers.erase(std::remove(buffers.begin(), buffers.end(), this), buffers.end());
+    --registered();
+    ++changes();
+  }
+
+  ComponentBuffer(const ComponentBuffer &) = delete;
+  ComponentBuffer &operator = (const ComponentBuffer &) = delete;
+
+  /**
+   * The buffer for `entities`, or null if Component is not buffered. Each
+   * thread remembers its last answer until a buffer is created or destroyed,
+   * so get_component() takes no lock.
+   */
+  static ComponentBuffer *find(EntityManager &entities) {
+    if ( registered() == 0 )
+      return nullptr;
+    struct Cached {
+      EntityManager *entities;
+      ComponentBuffer *buffer;
+      int changes;
+    };
+    static thread_local Cached cached = { nullptr, nullptr, -1 };
+    const int current = changes();
+    if ( cached.entities == &entities && cached.changes == current )
+      return cached.buffer;
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    ComponentBuffer *found = nullptr;
+    for ( auto buffer : registry() ) {
+      if ( &buffer->entities_ == &entities ) {
+        found = buffer;
+        break;
+      }
+    }
+    cached.entities = &entities;
+    cached.buffer = found;
+    cached.changes = changes();
+    return found;
+  }
+
+  /**
+   * The script-side copy of the entity's component, or null if it has none.
+   * Between snapshot() and sync() only snapshotted components are found;
+   * otherwise the copy is made on first use.
+   */
+  Component *get(Entity::Id id) {
+    const size_t index = id.index();
+    if ( index < slots_.size() && slots_[index].present && slots_[index].id == id )
+      return &slots_[index].value;
+    if ( frozen_ )
+      return nullptr;
+    auto component = entities_.component<Component>(id);
+    if ( !component )
+      return nullptr;
+    return &copy(id, *component.get());
+  }
+
+  void snapshot() override {
+    // Copies are about to be replaced, so keep what scripts wrote to them.
+    sync();
+    for ( auto &slot : slots_ ) {
+      slot.present = false;
+    }
+    entities_.each<Component>([this](Entity entity, Component &component) {
+      copy(entity.id(), component);
+    });
+    frozen_ = true;
+  }
+
+  void sync() override {
+    frozen_ = false;
+    for ( auto &slot : slots_ ) {
+      if ( !slot.present )
+        continue;
+      // C++ may have destroyed the entity while scripts ran.
+      if ( !entities_.valid(slot.id) ) {
+        slot.present = false;
+        continue;
+      }
+      auto component = entities_.component<Component>(slot.id);
+      if ( !component ) {
+        slot.present = false;
+        continue;
+      }
+      if ( std::memcmp(&slot.value, &slot.base, sizeof(Component)) != 0 ) {
+        std::memcpy(component.get(), &slot.value, sizeof(Component));
+        mark_written(component.get());
+      }
+      std::memcpy(&slot.value, component.get(), sizeof(Component));
+      std::memcpy(&slot.base, component.get(), sizeof(Component));
+    }
+  }
+
+private:
+  // Reuses the entity's slot, so scripts holding its copy see the new one.
+  Component &copy(Entity::Id id, const Component &component) {
+    const size_t index = id.index();
+    if ( index >= slots_.size() )
+      slots_.resize(index + 1);
+    Slot &slot = slots_[index];
+    slot.id = id;
+    slot.present = true;
+    std::memcpy(&slot.value, &component, sizeof(Component));
+    std::memcpy(&slot.base, &component, sizeof(Component));
+    return slot.value;
+  }
+
+  struct Slot {
+    Slot() : present(false) {}
+
+    Entity::Id id;
+    bool present;
+    // What scripts see and write.
+    Component value;
+    // The component as of the last sync, to tell which copies changed.
+    Component base;
+  };
+
+  static std::vector<ComponentBuffer *> &registry() {
+    static std::vector<ComponentBuffer *> buffers;
+    return buffers;
+  }
+
+  static std::mutex &registry_mutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static std::atomic<int> &registered() {
+    static std::atomic<int> count(0);
+    return count;
+  }
+
+  // Bumped whenever a buffer is created or destroyed.
+  static std::atomic<int> &changes() {
+    static std::atomic<int> count(0);
+    return count;
+  }
+
+  EntityManager &entities_;
+  // Set from snapshot() until sync(); scripts must not read entities_.
+  bool frozen_;
+  // A deque, so that growing it never moves copies scripts point to.
+  std::deque<Slot> slots_;
+};
+
+}  // namespace python
+}  // namespace entityx
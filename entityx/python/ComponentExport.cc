@@ -0,0 +1,147 @@
+// Copyright 2017 Bablawn3d5
+
+#include "entityx/python/ComponentExport.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace entityx {
+namespace python {
+
+namespace {
+
+const char export_magic[8] = {'E', 'X', 'P', 'Y', 'E', 'X', 'P', 'T'};
+const uint32_t export_version = 1;
+
+size_t padded(size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+ExportHeader *export_header(MappedFile &file) {
+  return reinterpret_cast<ExportHeader *>(file.data());
+}
+
+ExportedComponent *export_table(MappedFile &file) {
+  return reinterpret_cast<ExportedComponent *>(file.data() + sizeof(ExportHeader));
+}
+
+}  // namespace
+
+ComponentExport::ComponentExport(EntityManager &entities,
+                                 const std::vector<const ComponentInfo *> &components,
+                                 const std::string &path, size_t capacity)
+  : entities_(entities), components_(components) {
+  size_t offset = sizeof(ExportHeader) + components.size() * sizeof(ExportedComponent);
+  std::vector<ExportedComponent> table(components.size());
+  for ( size_t c = 0; c < components.size(); ++c ) {
+    const std::string &name = components[c]->name();
+    if ( name.size() >= sizeof(table[c].name) )
+      throw std::runtime_error("component name too long to export: " + name);
+    std::memset(&table[c], 0, sizeof(table[c]));
+    std::memcpy(table[c].name, name.data(), name.size());
+    table[c].size = components[c]->size();
+    table[c].stride = sizeof(uint64_t) + padded(components[c]->size());
+    table[c].offset = offset;
+    offset += capacity * table[c].stride;
+  }
+
+  file_.open(path, offset);
+  ExportHeader *header = export_header(file_);
+  std::memset(header, 0, sizeof(ExportHeader));
+  std::memcpy(header->magic, export_magic, sizeof(header->magic));
+  header->version = export_version;
+  header->components = static_cast<uint32_t>(components.size());
+  header->capacity = capacity;
+  std::memcpy(export_table(file_), table.data(), table.size() * sizeof(ExportedComponent));
+}
+
+ComponentExport::~ComponentExport() {
+#ifndef _WIN32
+  if ( file_.is_open() )
+    ::unlink(file_.path().c_str());
+#endif
+}
+
+void ComponentExport::publish(uint64_t frame) {
+  ExportHeader *header = export_header(file_);
+  ExportedComponent *table = export_table(file_);
+  const uint64_t sequence = header->sequence;
+  __atomic_store_n(&header->sequence, sequence + 1, __ATOMIC_RELAXED);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  header->frame = frame;
+  for ( size_t c = 0; c < components_.size(); ++c ) {
+    const ComponentInfo &info = *components_[c];
+    ExportedComponent &exported = table[c];
+    char *rows = file_.data() + exported.offset;
+    const size_t stride = static_cast<size_t>(exported.stride);
+    const uint64_t capacity = header->capacity;
+    uint64_t count = 0;
+    uint64_t total = 0;
+    info.each(entities_, [&](Entity::Id id, void *data) {
+      ++total;
+      if ( count == capacity )
+        return;
+      char *row = rows + count * stride;
+      const uint64_t entity = id.id();
+      std::memcpy(row, &entity, sizeof(entity));
+      std::memcpy(row + sizeof(entity), data, info.size());
+      ++count;
+    });
+    exported.count = count;
+    exported.total = total;
+  }
+
+  __atomic_store_n(&header->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+ComponentExportReader::ComponentExportReader(const std::string &path) {
+  file_.open_readonly(path);
+  if ( file_.size() < sizeof(ExportHeader) ||
+       std::memcmp(header()->magic, export_magic, sizeof(export_magic)) != 0 )
+    throw std::runtime_error(path + " is not a component export");
+  if ( header()->version != export_version )
+    throw std::runtime_error(path + " is a component export of unsupported version " +
+                             std::to_string(header()->version));
+  const size_t components = header()->components;
+  const ExportedComponent *table =
+    reinterpret_cast<const ExportedComponent *>(file_.data() + sizeof(ExportHeader));
+  if ( file_.size() < sizeof(ExportHeader) + components * sizeof(ExportedComponent) )
+    throw std::runtime_error(path + " is a truncated component export");
+  for ( size_t c = 0; c < components; ++c ) {
+    const uint64_t end = table[c].offset + header()->capacity * table[c].stride;
+    if ( end > file_.size() )
+      throw std::runtime_error(path + " is a truncated component export");
+    View view;
+    view.name.assign(table[c].name, strnlen(table[c].name, sizeof(table[c].name)));
+    view.size = static_cast<size_t>(table[c].size);
+    view.count = 0;
+    view.total = 0;
+    view.rows = file_.data() + table[c].offset;
+    view.stride = static_cast<size_t>(table[c].stride);
+    views_.push_back(view);
+  }
+}
+
+uint64_t ComponentExportReader::begin() const {
+  return __atomic_load_n(&header()->sequence, __ATOMIC_ACQUIRE);
+}
+
+const std::vector<ComponentExportReader::View> &ComponentExportReader::load() {
+  const ExportedComponent *table =
+    reinterpret_cast<const ExportedComponent *>(file_.data() + sizeof(ExportHeader));
+  const uint64_t capacity = header()->capacity;
+  for ( size_t c = 0; c < views_.size(); ++c ) {
+    // Clamped, as a torn frame may be read before it is thrown away.
+    views_[c].count = static_cast<size_t>(std::min(table[c].count, capacity));
+    views_[c].total = static_cast<size_t>(table[c].total);
+  }
+  return views_;
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,151 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "entityx/Entity.h"
+#include "entityx/python/ComponentRegistry.hpp"
+#include "entityx/python/MappedFile.h"
+
+namespace entityx {
+namespace python {
+
+/**
+ * The layout of a component export, all native-endian: an ExportHeader,
+ * an ExportedComponent per component, then each component's rows of a
+ * uint64 entity id followed by the component's bytes, `stride` apart.
+ */
+struct ExportHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t components;
+  /// Odd while the frame is being written; bumped by two per frame.
+  uint64_t sequence;
+  uint64_t frame;
+  uint64_t capacity;
+};
+
+struct ExportedComponent {
+  char name[64];
+  uint64_t size;
+  uint64_t stride;
+  uint64_t offset;
+  uint64_t count;
+  /// How many entities had the component; more than count if cut off.
+  uint64_t total;
+};
+
+/**
+ * Mirrors registered components into a file that other processes map
+ * read-only, e.g. to monitor a world without Python. `path` should be on
+ * a memory-backed file system such as /dev/shm; the file is removed when
+ * the export is destroyed.
+ *
+ * Every publish() replaces the rows under a seqlock: the header's sequence
+ * is odd while rows are written, so a reader that saw the same even
+ * sequence before and after reading saw one whole frame. Read it with
+ * ComponentExportReader.
+ */
+class ComponentExport {
+public:
+  /**
+   * @param capacity Rows per component; entities beyond it are left out.
+   */
+  ComponentExport(EntityManager &entities, const std::vector<const ComponentInfo *> &components,
+                  const std::string &path, size_t capacity);
+  ~ComponentExport();
+
+  ComponentExport(const ComponentExport &) = delete;
+  ComponentExport &operator = (const ComponentExport &) = delete;
+
+  const std::string &path() const {
+    return file_.path();
+  }
+
+  /// Replace the exported rows with the components as of `frame`.
+  void publish(uint64_t frame);
+
+private:
+  EntityManager &entities_;
+  std::vector<const ComponentInfo *> components_;
+  MappedFile file_;
+};
+
+/**
+ * Reads a ComponentExport in place from another process.
+ */
+class ComponentExportReader {
+public:
+  /// One component's rows, pointing into the export.
+  struct View {
+    std::string name;
+    size_t size;
+    size_t count;
+    size_t total;
+    const char *rows;
+    size_t stride;
+
+    /// Entity::Id::id() of the entity in `row`.
+    uint64_t entity(size_t row) const {
+      return *reinterpret_cast<const uint64_t *>(rows + row * stride);
+    }
+
+    /// The size bytes of the component in `row`.
+    const void *component(size_t row) const {
+      return rows + row * stride + sizeof(uint64_t);
+    }
+  };
+
+  /// Throws std::runtime_error if `path` is not a component export.
+  explicit ComponentExportReader(const std::string &path);
+
+  /**
+   * Call `visit(frame, views)` with a View per component until it has seen
+   * one whole frame, and return that frame. A torn frame may be visited
+   * first, so only trust what `visit` computed from the last call.
+   *
+   * Throws std::runtime_error if no whole frame was seen within `timeout`,
+   * e.g. because the writer died while writing one. Not thread safe; give
+   * each reading thread its own reader.
+   */
+  template <typename Visit>
+  uint64_t read(Visit visit,
+                std::chrono::milliseconds timeout = std::chrono::milliseconds(1000)) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    for ( ;; ) {
+      const uint64_t sequence = begin();
+      if ( !(sequence & 1) ) {
+        const uint64_t frame = header()->frame;
+        const std::vector<View> &views = load();
+        visit(frame, views);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ( sequence == __atomic_load_n(&header()->sequence, __ATOMIC_RELAXED) )
+          return frame;
+      }
+      if ( std::chrono::steady_clock::now() >= deadline )
+        throw std::runtime_error("no whole frame in " + file_.path() + " before the timeout");
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  const ExportHeader *header() const {
+    return reinterpret_cast<const ExportHeader *>(file_.data());
+  }
+
+  uint64_t begin() const;
+  const std::vector<View> &load();
+
+  MappedFile file_;
+  std::vector<View> views_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,193 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "entityx/Entity.h"
+
+namespace entityx {
+namespace python {
+
+/// The types a registered component field may have.
+enum class FieldType : uint8_t {
+  Bool,
+  Int32,
+  UInt32,
+  Int64,
+  UInt64,
+  Float,
+  Double
+};
+
+template <typename T> struct FieldTypeOf;
+template <> struct FieldTypeOf<bool> { static const FieldType value = FieldType::Bool; };
+template <> struct FieldTypeOf<int32_t> { static const FieldType value = FieldType::Int32; };
+template <> struct FieldTypeOf<uint32_t> { static const FieldType value = FieldType::UInt32; };
+template <> struct FieldTypeOf<int64_t> { static const FieldType value = FieldType::Int64; };
+template <> struct FieldTypeOf<uint64_t> { static const FieldType value = FieldType::UInt64; };
+template <> struct FieldTypeOf<float> { static const FieldType value = FieldType::Float; };
+template <> struct FieldTypeOf<double> { static const FieldType value = FieldType::Double; };
+
+/// A named field of a registered component, at `offset` bytes into it.
+struct FieldInfo {
+  std::string name;
+  FieldType type;
+  size_t offset;
+};
+
+/**
+ * Tell every tracking ChangeTracker that the registered component at
+ * `component` was written in place, so its entity is compared at the next
+ * commit. Fields bound with def_tracked() call this. Thread safe.
+ */
+void mark_written(const void *component);
+
+/**
+ * A registered component type, usable without knowing the C++ type.
+ */
+class ComponentInfo {
+public:
+  ComponentInfo(const std::string &name, size_t size) : name_(name), size_(size) {}
+  virtual ~ComponentInfo() {}
+
+  const std::string &name() const {
+    return name_;
+  }
+
+  /// sizeof() the component. Components are trivially copyable, so this
+  /// many bytes capture one.
+  size_t size() const {
+    return size_;
+  }
+
+  const std::vector<FieldInfo> &fields() const {
+    return fields_;
+  }
+
+  /// The entity's component, or null if it has none.
+  virtual void *get(EntityManager &entities, Entity::Id id) const = 0;
+
+  /// The entity's component, assigning a default constructed one if needed.
+  virtual void *assign(EntityManager &entities, Entity::Id id) const = 0;
+
+  virtual void remove(EntityManager &entities, Entity::Id id) const = 0;
+
+  /// Default construct a component in the size() bytes at `data`.
+  virtual void construct(void *data) const = 0;
+
+  /// Call `visit` for every entity that has the component.
+  virtual void each(EntityManager &entities,
+                    const std::function<void(Entity::Id, void *)> &visit) const = 0;
+
+protected:
+  template <typename Component> friend class ComponentFields;
+
+  std::string name_;
+  size_t size_;
+  std::vector<FieldInfo> fields_;
+};
+
+template <typename Component>
+class TypedComponentInfo : public ComponentInfo {
+public:
+  explicit TypedComponentInfo(const std::string &name)
+    : ComponentInfo(name, sizeof(Component)) {}
+
+  void *get(EntityManager &entities, Entity::Id id) const override {
+    auto component = entities.component<Component>(id);
+    return component ? component.get() : nullptr;
+  }
+
+  void *assign(EntityManager &entities, Entity::Id id) const override {
+    auto component = entities.component<Component>(id);
+    if ( !component )
+      component = entities.assign<Component>(id);
+    return component.get();
+  }
+
+  void remove(EntityManager &entities, Entity::Id id) const override {
+    if ( entities.component<Component>(id) )
+      entities.remove<Component>(id);
+  }
+
+  void construct(void *data) const override {
+    new (data) Component();
+  }
+
+  void each(EntityManager &entities,
+            const std::function<void(Entity::Id, void *)> &visit) const override {
+    entities.each<Component>([&visit](Entity entity, Component &component) {
+      visit(entity.id(), &component);
+    });
+  }
+};
+
+/**
+ * Declares the fields of a registered component:
+ *
+ *   python.register_component<Position>("Position")
+ *     .field("x", &Position::x)
+ *     .field("y", &Position::y);
+ */
+template <typename Component>
+class ComponentFields {
+public:
+  explicit ComponentFields(ComponentInfo &info) : info_(info) {}
+
+  template <typename T>
+  ComponentFields &field(const std::string &name, T Component::*member) {
+    // Measure the offset on uninitialized storage; nothing is read.
+    typename std::aligned_storage<sizeof(Component), alignof(Component)>::type storage;
+    const Component *base = reinterpret_cast<const Component *>(&storage);
+    const size_t offset = static_cast<size_t>(
+      reinterpret_cast<const char *>(&(base->*member)) - reinterpret_cast<const char *>(base));
+    info_.fields_.push_back(FieldInfo{name, FieldTypeOf<T>::value, offset});
+    return *this;
+  }
+
+private:
+  ComponentInfo &info_;
+};
+
+/**
+ * The component types a PythonSystem knows how to serialize, in
+ * registration order.
+ */
+class ComponentRegistry {
+public:
+  template <typename Component>
+  ComponentFields<Component> add(const std::string &name) {
+    static_assert(std::is_trivially_copyable<Component>::value,
+                  "registered components must be trivially copyable");
+    static_assert(std::is_default_constructible<Component>::value,
+                  "registered components must be default constructible");
+    components_.emplace_back(new TypedComponentInfo<Component>(name));
+    return ComponentFields<Component>(*components_.back());
+  }
+
+  const std::vector<std::unique_ptr<ComponentInfo>> &components() const {
+    return components_;
+  }
+
+  /// The component registered as `name`, or null.
+  const ComponentInfo *find(const std::string &name) const {
+    for ( auto &component : components_ ) {
+      if ( component->name() == name )
+        return component.get();
+    }
+    return nullptr;
+  }
+
+private:
+  std::vector<std::unique_ptr<ComponentInfo>> components_;
+};
+
+}  // namespace python
+}  // namespace entityx
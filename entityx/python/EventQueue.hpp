@@ -0,0 +1,150 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace entityx {
+namespace python {
+
+/**
+ * A lock-free multi-producer, single-consumer queue of events.
+ *
+ * Any number of threads may push(); one thread at a time drains. An event
+ * pushed while drain() runs may be left for the next drain(). Every push
+ * allocates a node.
+ *
+ * Once the consumer is gone it close()s the queue, which drops what is
+ * queued and every later push, so producers that outlive it do not grow the
+ * queue forever. Dropped events are counted by dropped(). close() waits for
+ * pushes already past their check, so none lands after it.
+ */
+template <typename Event>
+class EventQueue {
+public:
+  EventQueue()
+    : head_(new Node()), tail_(head_.load(std::memory_order_relaxed)), closed_(false),
+      pushing_(0), dropped_(0) {}
+
+  ~EventQueue() {
+    drain([](Event &&) {});
+    delete tail_;
+  }
+
+  EventQueue(const EventQueue &) = delete;
+  EventQueue &operator = (const EventQueue &) = delete;
+
+  /// Queue an event. Returns false, dropping it, once the queue is closed.
+  bool push(const Event &event) {
+    return push_node(Node::make(event));
+  }
+
+  bool push(Event &&event) {
+    return push_node(Node::make(std::move(event)));
+  }
+
+  /// Drop the queued events and every later push. Call from the consumer.
+  void close() {
+    closed_.store(true, std::memory_order_seq_cst);
+    // A push that saw the queue open is enqueueing; take its event too.
+    while ( pushing_.load(std::memory_order_seq_cst) != 0 ) {
+      std::this_thread::yield();
+    }
+    drop(drain([](Event &&) {}));
+  }
+
+  /// Count `count` events the consumer took but could not deliver.
+  void drop(size_t count) {
+    dropped_.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  /// Events dropped so far: by close(), pushed after it, or by drop().
+  size_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  /// Pass every queued event to `consume(Event&&)` in push order per producer.
+  template <typename Consumer>
+  size_t drain(Consumer consume) {
+    size_t count = 0;
+    for ( ;; ) {
+      Node *next = tail_->next.load(std::memory_order_acquire);
+      if ( !next )
+        return count;
+      // `next` becomes the empty front node once its event is taken.
+      consume(std::move(*next->event()));
+      next->event()->~Event();
+      next->full = false;
+      delete tail_;
+      tail_ = next;
+      ++count;
+    }
+  }
+
+private:
+  struct Node {
+    Node() : next(nullptr), full(false) {}
+
+    template <typename Value>
+    explicit Node(Value &&value) : next(nullptr), full(true) {
+      new (&storage) Event(std::forward<Value>(value));
+    }
+
+    // Allocated before push() checks the queue, outside the window close()
+    // waits on.
+    template <typename Value>
+    static std::unique_ptr<Node> make(Value &&value) {
+      return std::unique_ptr<Node>(new Node(std::forward<Value>(value)));
+    }
+
+    ~Node() {
+      if ( full )
+        event()->~Event();
+    }
+
+    Event *event() {
+      return reinterpret_cast<Event *>(&storage);
+    }
+
+    std::atomic<Node *> next;
+    bool full;
+    typename std::aligned_storage<sizeof(Event), alignof(Event)>::type storage;
+  };
+
+  // Counted in pushing_ from before the check until the node is linked, and
+  // both sides use seq_cst: either the push sees closed_, or close() sees it
+  // pushing and waits for it.
+  bool push_node(std::unique_ptr<Node> node) {
+    pushing_.fetch_add(1, std::memory_order_seq_cst);
+    if ( closed_.load(std::memory_order_seq_cst) ) {
+      pushing_.fetch_sub(1, std::memory_order_release);
+      drop(1);
+      return false;
+    }
+    enqueue(node.release());
+    pushing_.fetch_sub(1, std::memory_order_release);
+    return true;
+  }
+
+  void enqueue(Node *node) {
+    Node *previous = head_.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+  }
+
+  // Producers append after head_; the consumer takes from after tail_.
+  std::atomic<Node *> head_;
+  Node *tail_;
+  std::atomic<bool> closed_;
+  // Pushes between their check of closed_ and linking their node.
+  std::atomic<size_t> pushing_;
+  std::atomic<size_t> dropped_;
+};
+
+}  // namespace python
+}  // namespace entityx
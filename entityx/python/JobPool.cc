@@ -0,0 +1,93 @@
+// Copyright 2017 Bablawn3d5
+
+#include <algorithm>
+#include "entityx/python/JobPool.h"
+
+namespace entityx {
+namespace python {
+
+// The pool and worker index of the calling thread, if it is a worker.
+static thread_local const JobPool *current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+JobPool::JobPool(size_t threads) : next_(0), queued_(0), stop_(false) {
+  threads = std::max<size_t>(threads, 1);
+  for ( size_t i = 0; i < threads; ++i ) {
+    queues_.emplace_back(new Queue());
+  }
+  for ( size_t i = 0; i < threads; ++i ) {
+    workers_.push_back(std::thread([this, i]() { work(i); }));
+  }
+}
+
+JobPool::~JobPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  ready_.notify_all();
+  for ( auto &worker : workers_ ) {
+    worker.join();
+  }
+}
+
+void JobPool::submit(Job job) {
+  const size_t index = current_pool == this
+    ? current_worker
+    : next_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+  // Count the job before a worker can take it, so that queued_ never drops
+  // below zero.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++queued_;
+  }
+  {
+    Queue &queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(std::move(job));
+  }
+  ready_.notify_one();
+}
+
+bool JobPool::take(size_t worker, Job &job) {
+  {
+    Queue &own = *queues_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if ( !own.jobs.empty() ) {
+      job = std::move(own.jobs.back());
+      own.jobs.pop_back();
+      --queued_;
+      return true;
+    }
+  }
+  for ( size_t i = 1; i < queues_.size(); ++i ) {
+    Queue &victim = *queues_[(worker + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if ( !victim.jobs.empty() ) {
+      job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+      --queued_;
+      return true;
+    }
+  }
+  return false;
+}
+
+void JobPool::work(size_t worker) {
+  current_pool = this;
+  current_worker = worker;
+  for ( ;; ) {
+    Job job;
+    if ( take(worker, job) ) {
+      job();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+    if ( stop_ && queued_ == 0 )
+      return;
+  }
+}
+
+}  // namespace python
+}  // namespace entityx
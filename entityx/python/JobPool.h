@@ -0,0 +1,68 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace entityx {
+namespace python {
+
+/**
+ * A work-stealing pool for independent background jobs.
+ *
+ * Every worker has its own queue. Jobs submitted from a worker go to the
+ * back of its queue and other jobs are spread round-robin. Workers take
+ * their newest job first and steal the oldest job of another worker when
+ * their own queue is empty.
+ *
+ * Jobs run without any Python lock and must not throw.
+ */
+class JobPool {
+public:
+  typedef std::function<void()> Job;
+
+  /// @param threads Number of workers, at least one.
+  explicit JobPool(size_t threads = std::thread::hardware_concurrency());
+  /// Runs the jobs still queued, then stops the workers.
+  ~JobPool();
+
+  JobPool(const JobPool &) = delete;
+  JobPool &operator = (const JobPool &) = delete;
+
+  size_t size() const {
+    return workers_.size();
+  }
+
+  /// Queue a job. May be called from any thread, including from a job.
+  void submit(Job job);
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  bool take(size_t worker, Job &job);
+  void work(size_t worker);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::atomic<size_t> next_;
+  // Jobs queued but not taken yet, counted before they are queued. Only
+  // increased with mutex_ held, so that sleeping workers never miss a job.
+  std::atomic<size_t> queued_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  bool stop_;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace python
+}  // namespace entityx
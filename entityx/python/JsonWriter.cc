@@ -0,0 +1,275 @@
+// Copyright 2017 Bablawn3d5
+
+#include "entityx/python/JsonWriter.h"
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace entityx {
+namespace python {
+
+void JsonWriter::separate() {
+  if ( after_key_ ) {
+    after_key_ = false;
+    return;
+  }
+  if ( !nonempty_.empty() ) {
+    if ( nonempty_.back() )
+      raw(",", 1);
+    nonempty_.back() = true;
+  }
+}
+
+void JsonWriter::begin_object() {
+  separate();
+  raw("{", 1);
+  nonempty_.push_back(false);
+}
+
+void JsonWriter::end_object() {
+  nonempty_.pop_back();
+  raw("}", 1);
+}
+
+void JsonWriter::begin_array() {
+  separate();
+  raw("[", 1);
+  nonempty_.push_back(false);
+}
+
+void JsonWriter::end_array() {
+  nonempty_.pop_back();
+  raw("]", 1);
+}
+
+void JsonWriter::key(const char *name, size_t length) {
+  value(name, length);
+  raw(":", 1);
+  after_key_ = true;
+}
+
+void JsonWriter::key(PyObject *name) {
+  python_string(name);
+  raw(":", 1);
+  after_key_ = true;
+}
+
+void JsonWriter::null() {
+  separate();
+  raw("null", 4);
+}
+
+void JsonWriter::value(bool value) {
+  separate();
+  if ( value ) {
+    raw("true", 4);
+  } else {
+    raw("false", 5);
+  }
+}
+
+void JsonWriter::value(int64_t value) {
+  separate();
+  char buffer[32];
+  const int length = std::snprintf(buffer, sizeof(buffer), "%" PRId64, value);
+  raw(buffer, static_cast<size_t>(length));
+}
+
+void JsonWriter::value(uint64_t value) {
+  separate();
+  char buffer[32];
+  const int length = std::snprintf(buffer, sizeof(buffer), "%" PRIu64, value);
+  raw(buffer, static_cast<size_t>(length));
+}
+
+void JsonWriter::value(double value, int precision) {
+  if ( !std::isfinite(value) ) {
+    null();
+    return;
+  }
+  separate();
+  char buffer[32];
+  const int length = std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+  raw(buffer, static_cast<size_t>(length));
+}
+
+void JsonWriter::value(const char *text, size_t length) {
+  separate();
+  raw("\"", 1);
+  size_t start = 0;
+  for ( size_t i = 0; i < length; ++i ) {
+    const unsigned char c = static_cast<unsigned char>(text[i]);
+    if ( c >= 0x20 && c != '"' && c != '\\' )
+      continue;
+    raw(text + start, i - start);
+    start = i + 1;
+    switch ( c ) {
+      case '"': raw("\\\"", 2); break;
+      case '\\': raw("\\\\", 2); break;
+      case '\n': raw("\\n", 2); break;
+      case '\r': raw("\\r", 2); break;
+      case '\t': raw("\\t", 2); break;
+      default: {
+        char escape[8];
+        std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+        raw(escape, 6);
+      }
+    }
+  }
+  raw(text + start, length - start);
+  raw("\"", 1);
+}
+
+void JsonWriter::field(const FieldInfo &field, const void *component) {
+  const char *data = static_cast<const char *>(component) + field.offset;
+  switch ( field.type ) {
+    case FieldType::Bool: {
+      bool v;
+      std::memcpy(&v, data, sizeof(v));
+      value(v);
+      break;
+    }
+    case FieldType::Int32: {
+      int32_t v;
+      std::memcpy(&v, data, sizeof(v));
+      value(static_cast<int64_t>(v));
+      break;
+    }
+    case FieldType::UInt32: {
+      uint32_t v;
+      std::memcpy(&v, data, sizeof(v));
+      value(static_cast<uint64_t>(v));
+      break;
+    }
+    case FieldType::Int64: {
+      int64_t v;
+      std::memcpy(&v, data, sizeof(v));
+      value(v);
+      break;
+    }
+    case FieldType::UInt64: {
+      uint64_t v;
+      std::memcpy(&v, data, sizeof(v));
+      value(v);
+      break;
+    }
+    case FieldType::Float: {
+      float v;
+      std::memcpy(&v, data, sizeof(v));
+      // Enough digits to read back the same float.
+      value(static_cast<double>(v), 9);
+      break;
+    }
+    case FieldType::Double: {
+      double v;
+      std::memcpy(&v, data, sizeof(v));
+      value(v);
+      break;
+    }
+  }
+}
+
+void JsonWriter::component(const ComponentInfo &info, const void *component) {
+  begin_object();
+  for ( auto &f : info.fields() ) {
+    key(f.name);
+    field(f, component);
+  }
+  end_object();
+}
+
+void JsonWriter::python_string(PyObject *object) {
+#if PY_MAJOR_VERSION >= 3
+  Py_ssize_t length = 0;
+  const char *text = PyUnicode_AsUTF8AndSize(object, &length);
+  if ( text ) {
+    value(text, static_cast<size_t>(length));
+    return;
+  }
+  PyErr_Clear();
+#else
+  if ( PyString_Check(object) ) {
+    value(PyString_AS_STRING(object), static_cast<size_t>(PyString_GET_SIZE(object)));
+    return;
+  }
+#endif
+  // Strings that are not valid UTF-8, e.g. with lone surrogates, keep the
+  // offending characters as \uXXXX text. Keys must stay strings.
+  py::object utf8 = py::reinterpret_steal<py::object>(
+    PyUnicode_AsEncodedString(object, "utf-8", "backslashreplace"));
+  if ( !utf8 )
+    throw py::error_already_set();
+  value(PyBytes_AS_STRING(utf8.ptr()), static_cast<size_t>(PyBytes_GET_SIZE(utf8.ptr())));
+}
+
+void JsonWriter::python(PyObject *object, int depth) {
+  if ( object == Py_None ) {
+    null();
+  } else if ( PyBool_Check(object) ) {
+    value(object == Py_True);
+  } else if ( PyFloat_Check(object) ) {
+    value(PyFloat_AS_DOUBLE(object));
+#if PY_MAJOR_VERSION < 3
+  } else if ( PyInt_Check(object) ) {
+    value(static_cast<int64_t>(PyInt_AS_LONG(object)));
+#endif
+  } else if ( PyLong_Check(object) ) {
+    int overflow = 0;
+    const long long v = PyLong_AsLongLongAndOverflow(object, &overflow);
+    if ( overflow == 0 && !(v == -1 && PyErr_Occurred()) ) {
+      value(static_cast<int64_t>(v));
+    } else {
+      // JSON numbers have no size limit, so write every digit.
+      PyErr_Clear();
+      py::object digits = py::reinterpret_steal<py::object>(PyObject_Str(object));
+      if ( !digits )
+        throw py::error_already_set();
+      const std::string text = digits.cast<std::string>();
+      separate();
+      raw(text.data(), text.size());
+    }
+#if PY_MAJOR_VERSION < 3
+  } else if ( PyString_Check(object) || PyUnicode_Check(object) ) {
+#else
+  } else if ( PyUnicode_Check(object) ) {
+#endif
+    python_string(object);
+  } else if ( depth >= 32 ) {
+    null();
+  } else if ( PyList_Check(object) || PyTuple_Check(object) ) {
+    py::object items = py::reinterpret_steal<py::object>(PySequence_Fast(object, ""));
+    begin_array();
+    const Py_ssize_t size = PySequence_Fast_GET_SIZE(items.ptr());
+    for ( Py_ssize_t i = 0; i < size; ++i ) {
+      python(PySequence_Fast_GET_ITEM(items.ptr(), i), depth + 1);
+    }
+    end_array();
+  } else if ( PyDict_Check(object) ) {
+    begin_object();
+    PyObject *k;
+    PyObject *v;
+    Py_ssize_t position = 0;
+    while ( PyDict_Next(object, &position, &k, &v) ) {
+      py::object name = py::reinterpret_steal<py::object>(PyObject_Str(k));
+      if ( !name ) {
+        PyErr_Clear();
+        continue;
+      }
+      key(name.ptr());
+      python(v, depth + 1);
+    }
+    end_object();
+  } else {
+    py::object text = py::reinterpret_steal<py::object>(PyObject_Str(object));
+    if ( !text ) {
+      PyErr_Clear();
+      null();
+      return;
+    }
+    python_string(text.ptr());
+  }
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,86 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "entityx/python/ComponentRegistry.hpp"
+
+namespace py = pybind11;
+
+namespace entityx {
+namespace python {
+
+/**
+ * Streams compact JSON to an std::ostream without building a document.
+ *
+ * Numbers are formatted into a stack buffer; the only allocation is the
+ * nesting stack. Callers must produce well-formed structure: key() before
+ * every value inside an object.
+ */
+class JsonWriter {
+public:
+  explicit JsonWriter(std::ostream &out) : out_(out), after_key_(false) {}
+
+  void begin_object();
+  void end_object();
+  void begin_array();
+  void end_array();
+  void key(const char *name, size_t length);
+  void key(const char *name) {
+    key(name, std::strlen(name));
+  }
+  void key(const std::string &name) {
+    key(name.data(), name.size());
+  }
+  /// A Python string key. Requires the GIL.
+  void key(PyObject *name);
+
+  void null();
+  void value(bool value);
+  void value(int64_t value);
+  void value(uint64_t value);
+  /// NaN and infinities are written as null.
+  void value(double value, int precision = 17);
+  void value(const char *text, size_t length);
+  void value(const char *text) {
+    value(text, std::strlen(text));
+  }
+  void value(const std::string &text) {
+    value(text.data(), text.size());
+  }
+
+  /// Write the field of `component` described by `field`.
+  void field(const FieldInfo &field, const void *component);
+
+  /// Write every registered field of `component` as an object.
+  void component(const ComponentInfo &info, const void *component);
+
+  /**
+   * Write a Python value: None, bools, numbers, strings, lists, tuples and
+   * dicts map to JSON; anything else is written as its str(). Integers keep
+   * every digit and characters UTF-8 cannot encode are escaped as \uXXXX
+   * text. Requires the GIL. Containers nested deeper than 32 levels are
+   * written as null.
+   */
+  void python(PyObject *object, int depth = 0);
+
+private:
+  void separate();
+  void raw(const char *text, size_t length) {
+    out_.write(text, static_cast<std::streamsize>(length));
+  }
+  void python_string(PyObject *object);
+
+  std::ostream &out_;
+  // Per open container: whether it has an element yet.
+  std::vector<bool> nonempty_;
+  bool after_key_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,262 @@
+// Copyright 2017 Bablawn3d5
+
+#include "entityx/python/LevelLoader.h"
+#include <pybind11/pybind11.h>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "entityx/python/WorldSnapshot.h"
+
+namespace py = pybind11;
+
+namespace entityx {
+namespace python {
+
+namespace {
+
+std::runtime_error level_error(const std::string &what) {
+  return std::runtime_error("malformed level: " + what);
+}
+
+template <typename T>
+void store(char *at, T value) {
+  std::memcpy(at, &value, sizeof(value));
+}
+
+template <typename T>
+T integer(PyObject *value, const std::string &where) {
+  if ( PyFloat_Check(value) )
+    throw level_error(where + " must be an integer");
+  try {
+    return py::cast<T>(py::handle(value));
+  }
+  catch ( const py::cast_error& ) {
+    PyErr_Clear();
+    throw level_error(where + " must be an integer in range");
+  }
+}
+
+double real(PyObject *value, const std::string &where) {
+  // write_json() saves NaN and infinities as null.
+  if ( value == Py_None )
+    return std::numeric_limits<double>::quiet_NaN();
+  const double result = PyFloat_AsDouble(value);
+  if ( result == -1.0 && PyErr_Occurred() ) {
+    PyErr_Clear();
+    throw level_error(where + " must be a number");
+  }
+  return result;
+}
+
+void set_field(const FieldInfo &field, char *component, PyObject *value,
+               const std::string &where) {
+  char *at = component + field.offset;
+  switch ( field.type ) {
+    case FieldType::Bool:
+      if ( !PyBool_Check(value) )
+        throw level_error(where + " must be true or false");
+      store(at, value == Py_True);
+      break;
+    case FieldType::Int32:
+      store(at, integer<int32_t>(value, where));
+      break;
+    case FieldType::UInt32:
+      store(at, integer<uint32_t>(value, where));
+      break;
+    case FieldType::Int64:
+      store(at, integer<int64_t>(value, where));
+      break;
+    case FieldType::UInt64:
+      store(at, integer<uint64_t>(value, where));
+      break;
+    case FieldType::Float:
+      store(at, static_cast<float>(real(value, where)));
+      break;
+    case FieldType::Double:
+      store(at, real(value, where));
+      break;
+  }
+}
+
+const FieldInfo *find_field(const ComponentInfo &info, const std::string &name) {
+  for ( auto &field : info.fields() ) {
+    if ( field.name == name )
+      return &field;
+  }
+  return nullptr;
+}
+
+// The entity's member `key`, which must be a `type` if present.
+PyObject *member(PyObject *entity, const char *key, bool (*check)(PyObject *),
+                 const char *type) {
+  PyObject *value = PyDict_GetItemString(entity, key);
+  if ( value && !check(value) )
+    throw level_error(std::string("\"") + key + "\" must be " + type);
+  return value;
+}
+
+bool is_dict(PyObject *value) {
+  return PyDict_Check(value);
+}
+
+bool is_list(PyObject *value) {
+  return PyList_Check(value);
+}
+
+bool is_number(PyObject *value) {
+  return PyNumber_Check(value) && !PyFloat_Check(value);
+}
+
+// A copy of decoded JSON sharing nothing mutable: objects and arrays are
+// copied, strings, numbers, booleans and null are shared.
+py::object copy_json(PyObject *value) {
+  if ( PyDict_Check(value) ) {
+    py::object copy = py::reinterpret_steal<py::object>(PyDict_New());
+    if ( !copy )
+      throw py::error_already_set();
+    PyObject *key;
+    PyObject *item;
+    Py_ssize_t position = 0;
+    while ( PyDict_Next(value, &position, &key, &item) ) {
+      if ( PyDict_SetItem(copy.ptr(), key, copy_json(item).ptr()) != 0 )
+        throw py::error_already_set();
+    }
+    return copy;
+  }
+  if ( PyList_Check(value) ) {
+    const Py_ssize_t size = PyList_GET_SIZE(value);
+    py::object copy = py::reinterpret_steal<py::object>(PyList_New(size));
+    if ( !copy )
+      throw py::error_already_set();
+    for ( Py_ssize_t i = 0; i < size; ++i ) {
+      PyList_SET_ITEM(copy.ptr(), i, copy_json(PyList_GET_ITEM(value, i)).release().ptr());
+    }
+    return copy;
+  }
+  return py::reinterpret_borrow<py::object>(value);
+}
+
+// The components of one registered type, in the order of their entities.
+struct Column {
+  std::vector<uint32_t> slots;
+  std::string data;
+};
+
+}  // namespace
+
+py::list level_to_snapshot(const ComponentRegistry &components, const char *json, size_t size,
+                           std::string &out) {
+  py::object text = py::reinterpret_steal<py::object>(
+    PyBytes_FromStringAndSize(json, static_cast<Py_ssize_t>(size)));
+  if ( !text )
+    throw py::error_already_set();
+  py::object level = py::module::import("json").attr("loads")(text);
+  if ( !PyDict_Check(level.ptr()) )
+    throw level_error("expected an object");
+  PyObject *entities = PyDict_GetItemString(level.ptr(), "entities");
+  if ( !entities || !PyList_Check(entities) )
+    throw level_error("\"entities\" must be a list");
+
+  const auto &registered = components.components();
+  std::unordered_map<std::string, size_t> index_of;
+  for ( size_t c = 0; c < registered.size(); ++c ) {
+    index_of[registered[c]->name()] = c;
+  }
+  std::vector<Column> columns(registered.size());
+  // Components are built here rather than in a column so that they are
+  // aligned; they are trivially copyable.
+  std::vector<uint64_t> scratch;
+
+  py::list scripts;
+  uint32_t slots = 0;
+  const Py_ssize_t entity_count = PyList_GET_SIZE(entities);
+  for ( Py_ssize_t i = 0; i < entity_count; ++i ) {
+    PyObject *entity = PyList_GET_ITEM(entities, i);
+    if ( !PyDict_Check(entity) )
+      throw level_error("entities must be objects");
+    PyObject *count_value = member(entity, "count", is_number, "an integer");
+    const uint32_t count = count_value ? integer<uint32_t>(count_value, "\"count\"") : 1;
+    if ( count > std::numeric_limits<uint32_t>::max() - slots )
+      throw level_error("too many entities");
+    const uint32_t first = slots;
+    slots += count;
+
+    PyObject *entity_components = member(entity, "components", is_dict, "an object");
+    PyObject *name;
+    PyObject *fields;
+    Py_ssize_t position = 0;
+    while ( entity_components && PyDict_Next(entity_components, &position, &name, &fields) ) {
+      const std::string component_name = py::cast<std::string>(py::handle(name));
+      auto found = index_of.find(component_name);
+      if ( found == index_of.end() )
+        throw std::runtime_error("level component " + component_name + " is not registered");
+      if ( !PyDict_Check(fields) )
+        throw level_error(component_name + " must be an object");
+      const ComponentInfo &info = *registered[found->second];
+      scratch.assign((info.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+      char *component = reinterpret_cast<char *>(scratch.data());
+      info.construct(component);
+
+      PyObject *field_name;
+      PyObject *value;
+      Py_ssize_t field_position = 0;
+      while ( PyDict_Next(fields, &field_position, &field_name, &value) ) {
+        const std::string field_string = py::cast<std::string>(py::handle(field_name));
+        const FieldInfo *field = find_field(info, field_string);
+        if ( !field )
+          throw std::runtime_error("level field " + component_name + "." + field_string +
+                                   " is not registered");
+        set_field(*field, component, value, component_name + "." + field_string);
+      }
+      Column &column = columns[found->second];
+      for ( uint32_t slot = first; slot < slots; ++slot ) {
+        column.slots.push_back(slot);
+        column.data.append(component, info.size());
+      }
+    }
+
+    PyObject *script = member(entity, "script", is_dict, "an object");
+    if ( !script )
+      continue;
+    PyObject *module = PyDict_GetItemString(script, "module");
+    PyObject *cls = PyDict_GetItemString(script, "class");
+    if ( !module || !cls )
+      throw level_error("scripts need a \"module\" and a \"class\"");
+    PyObject *args = member(script, "args", is_list, "a list");
+    PyObject *state = member(script, "state", is_dict, "an object");
+    py::object args_object = py::list();
+    if ( args )
+      args_object = py::reinterpret_borrow<py::object>(args);
+    py::object state_object = py::dict();
+    if ( state )
+      state_object = py::reinterpret_borrow<py::object>(state);
+    for ( uint32_t slot = first; slot < slots; ++slot ) {
+      // Copies must not share mutable args or state.
+      const bool copy = slot != first;
+      scripts.append(SnapshotWriter::script(
+        slot, py::reinterpret_borrow<py::object>(module), py::reinterpret_borrow<py::object>(cls),
+        copy ? copy_json(args_object.ptr()) : args_object,
+        copy ? copy_json(state_object.ptr()) : state_object));
+    }
+  }
+
+  // Any distinct ids do; restoring gives every entity a new one.
+  std::vector<Entity::Id> ids;
+  ids.reserve(slots);
+  for ( uint32_t slot = 0; slot < slots; ++slot ) {
+    ids.push_back(Entity::Id(slot, 1));
+  }
+  SnapshotWriter writer(out, ids, std::vector<Entity::Id>());
+  const std::vector<uint32_t> removed;
+  for ( size_t c = 0; c < registered.size(); ++c ) {
+    writer.section(*registered[c], columns[c].slots, columns[c].data, removed);
+  }
+  writer.finish(py::list(), 0, 0);
+  return scripts;
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,40 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <cstddef>
+#include <string>
+#include "entityx/python/ComponentRegistry.hpp"
+
+namespace py = pybind11;
+
+namespace entityx {
+namespace python {
+
+/**
+ * Convert a JSON level into a snapshot of its components in `out` and
+ * return its script entries, which WorldSnapshot::restore() spawns in one
+ * go. The entries are not pickled into the snapshot: they are built from
+ * the decoded JSON, each copy of a counted entity getting its own args and
+ * state. Requires the GIL.
+ *
+ * The level has the layout WorldSerializer::write_json() writes, so a
+ * saved world loads as a level:
+ *
+ *   {"entities": [
+ *     {"count": 100,
+ *      "components": {"Position": {"x": 1.0}},
+ *      "script": {"module": "game.enemy", "class": "Enemy",
+ *                 "args": [3], "state": {"health": 10}}}]}
+ *
+ * "count" spawns that many copies of an entity and defaults to 1. Fields
+ * left out of a component keep their default constructed value; "id",
+ * "index" and "version" are ignored. Unregistered components, unknown
+ * fields and values of the wrong type throw std::runtime_error.
+ */
+py::list level_to_snapshot(const ComponentRegistry &components, const char *json, size_t size,
+                           std::string &out);
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,180 @@
+// Copyright 2017 Bablawn3d5
+
+#include <cstdio>
+#include <stdexcept>
+#include <utility>
+#include "entityx/python/MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace entityx {
+namespace python {
+
+#ifndef _WIN32
+static std::runtime_error mapped_file_error(const std::string &what, const std::string &path) {
+  return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+#endif
+
+MappedFile::MappedFile() : data_(nullptr), size_(0) {}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+MappedFile::MappedFile(MappedFile &&other)
+  : data_(other.data_), size_(other.size_), path_(std::move(other.path_)) {
+  other.data_ = nullptr;
+  other.size_ = 0;
+}
+
+MappedFile &MappedFile::operator = (MappedFile &&other) {
+  if ( this != &other ) {
+    close();
+    data_ = other.data_;
+    size_ = other.size_;
+    path_ = std::move(other.path_);
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+#ifndef _WIN32
+
+void MappedFile::open(const std::string &path, size_t size) {
+  close();
+  path_ = path;
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if ( fd < 0 )
+    throw mapped_file_error("failed to open", path);
+  if ( ::ftruncate(fd, static_cast<off_t>(size)) != 0 ) {
+    std::runtime_error error = mapped_file_error("failed to resize", path);
+    ::close(fd);
+    throw error;
+  }
+  map(fd, size, true);
+}
+
+void MappedFile::open_readonly(const std::string &path) {
+  close();
+  path_ = path;
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if ( fd < 0 )
+    throw mapped_file_error("failed to open", path);
+  struct stat st;
+  if ( ::fstat(fd, &st) != 0 ) {
+    std::runtime_error error = mapped_file_error("failed to stat", path);
+    ::close(fd);
+    throw error;
+  }
+  map(fd, static_cast<size_t>(st.st_size), false);
+}
+
+void MappedFile::map(int fd, size_t size, bool writable) {
+  // The mapping stays valid after the descriptor is closed.
+  void *data = nullptr;
+  if ( size ) {
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    data = ::mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+    if ( data == MAP_FAILED ) {
+      std::runtime_error error = mapped_file_error("failed to map", path_);
+      ::close(fd);
+      throw error;
+    }
+  }
+  ::close(fd);
+  data_ = static_cast<char *>(data);
+  size_ = size;
+}
+
+void MappedFile::close() {
+  if ( data_ ) {
+    ::munmap(data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+void MappedFile::sync(bool wait) {
+  if ( data_ ) {
+    ::msync(data_, size_, wait ? MS_SYNC : MS_ASYNC);
+  }
+}
+
+void replace_file(const std::string &path, const char *data, size_t size) {
+  const std::string temporary = path + ".tmp";
+  int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if ( fd < 0 )
+    throw mapped_file_error("failed to open", temporary);
+  while ( size ) {
+    const ssize_t written = ::write(fd, data, size);
+    if ( written < 0 && errno == EINTR )
+      continue;
+    if ( written <= 0 ) {
+      std::runtime_error error = mapped_file_error("failed to write", temporary);
+      ::close(fd);
+      ::unlink(temporary.c_str());
+      throw error;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  if ( ::fsync(fd) != 0 ) {
+    std::runtime_error error = mapped_file_error("failed to flush", temporary);
+    ::close(fd);
+    ::unlink(temporary.c_str());
+    throw error;
+  }
+  ::close(fd);
+  if ( std::rename(temporary.c_str(), path.c_str()) != 0 ) {
+    std::runtime_error error = mapped_file_error("failed to rename to", path);
+    ::unlink(temporary.c_str());
+    throw error;
+  }
+
+  const size_t slash = path.rfind('/');
+  const std::string directory = slash == std::string::npos ? "." :
+                                slash == 0 ? "/" : path.substr(0, slash);
+  int dir = ::open(directory.c_str(), O_RDONLY);
+  if ( dir < 0 )
+    throw mapped_file_error("failed to open", directory);
+  if ( ::fsync(dir) != 0 ) {
+    std::runtime_error error = mapped_file_error("failed to flush", directory);
+    ::close(dir);
+    throw error;
+  }
+  ::close(dir);
+}
+
+#else
+
+void MappedFile::open(const std::string &path, size_t size) {
+  throw std::runtime_error("MappedFile is not supported on this platform: " + path);
+}
+
+void MappedFile::open_readonly(const std::string &path) {
+  throw std::runtime_error("MappedFile is not supported on this platform: " + path);
+}
+
+void MappedFile::map(int fd, size_t size, bool writable) {}
+
+void MappedFile::close() {}
+
+void MappedFile::sync(bool wait) {}
+
+void replace_file(const std::string &path, const char *data, size_t size) {
+  throw std::runtime_error("replace_file is not supported on this platform: " + path);
+}
+
+#endif
+
+}  // namespace python
+}  // namespace entityx
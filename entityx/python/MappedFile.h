@@ -0,0 +1,67 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace entityx {
+namespace python {
+
+/**
+ * A file mapped into memory with MAP_SHARED.
+ *
+ * Throws std::runtime_error if the file can not be opened or mapped. Only
+ * POSIX systems are supported.
+ */
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(MappedFile &&other);
+  MappedFile &operator = (MappedFile &&other);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator = (const MappedFile &) = delete;
+
+  /**
+   * Open `path` for reading and writing, creating it if needed, and resize
+   * it to `size` bytes before mapping it.
+   */
+  void open(const std::string &path, size_t size);
+
+  /**
+   * Map an existing file read-only.
+   */
+  void open_readonly(const std::string &path);
+
+  /// Unmap and close the file.
+  void close();
+
+  /// Schedule dirty pages to be written back; with wait, block until done.
+  void sync(bool wait = false);
+
+  bool is_open() const { return data_ != nullptr; }
+  char *data() { return data_; }
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+  const std::string &path() const { return path_; }
+
+private:
+  void map(int fd, size_t size, bool writable);
+
+  char *data_;
+  size_t size_;
+  std::string path_;
+};
+
+/**
+ * Replace the file at `path` with `size` bytes from `data`. They are
+ * written to `path` + ".tmp", flushed to disk and renamed over `path`,
+ * then the directory is flushed so the rename survives a crash. The
+ * temporary file is removed if anything fails. Throws std::runtime_error.
+ */
+void replace_file(const std::string &path, const char *data, size_t size);
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,290 @@
+// Copyright 2017 Bablawn3d5
+
+#include "entityx/python/PersistentStore.h"
+#include <sys/stat.h>
+#include <cstring>
+#include <stdexcept>
+#include "entityx/python/PythonScript.hpp"
+#include "entityx/python/WorldSerializer.h"
+
+namespace entityx {
+namespace python {
+
+const size_t PersistentStore::max_components;
+const size_t PersistentStore::class_capacity;
+
+namespace {
+
+const char store_magic[8] = {'E', 'X', 'P', 'Y', 'P', 'E', 'R', 'S'};
+const uint32_t store_version = 2;
+
+struct StoredComponent {
+  char name[64];
+  uint64_t size;
+};
+
+struct StoredClass {
+  char module[120];
+  char cls[120];
+};
+
+size_t padded(size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+// Copy `text` into a fixed size, zero terminated field.
+void copy_name(char *field, size_t size, const std::string &text, const char *what) {
+  if ( text.size() >= size )
+    throw std::runtime_error(std::string(what) + " name too long to persist: " + text);
+  std::memset(field, 0, size);
+  std::memcpy(field, text.data(), text.size());
+}
+
+std::string read_name(const char *field, size_t size) {
+  return std::string(field, strnlen(field, size));
+}
+
+StoredComponent *component_table(const MappedFile &file, size_t header_size) {
+  return reinterpret_cast<StoredComponent *>(const_cast<char *>(file.data()) + header_size);
+}
+
+}  // namespace
+
+struct PersistentStore::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t components;
+  uint64_t capacity;
+  // Bumped by every sync once its buffer is on disk; its parity names the
+  // buffer holding the last sync.
+  uint64_t generation;
+  uint64_t used[2];
+  uint32_t classes;
+  uint32_t class_capacity;
+};
+
+struct PersistentStore::Slot {
+  uint64_t id;
+  uint32_t components;
+  uint32_t script;
+};
+
+size_t PersistentStore::layout(const std::vector<const ComponentInfo *> &stored, size_t capacity,
+                               size_t &slots_offset, std::vector<size_t> &columns,
+                               size_t &buffer_size) {
+  slots_offset = sizeof(Header) + stored.size() * sizeof(StoredComponent) +
+                 class_capacity * sizeof(StoredClass);
+  size_t offset = slots_offset + capacity * sizeof(Slot);
+  columns.clear();
+  for ( auto info : stored ) {
+    columns.push_back(offset);
+    offset += padded(capacity * info->size());
+  }
+  buffer_size = offset - slots_offset;
+  return offset + buffer_size;
+}
+
+size_t PersistentStore::committed() const {
+  return static_cast<size_t>(header_->generation % 2);
+}
+
+PersistentStore::Slot *PersistentStore::slots(size_t buffer) const {
+  return reinterpret_cast<Slot *>(const_cast<char *>(file_.data()) + slots_offset_ +
+                                  buffer * buffer_size_);
+}
+
+char *PersistentStore::column(size_t buffer, size_t component) const {
+  return const_cast<char *>(file_.data()) + columns_[component] + buffer * buffer_size_;
+}
+
+bool PersistentStore::open(const std::string &path, const std::vector<std::string> &components,
+                           size_t capacity) {
+  if ( components.size() > max_components )
+    throw std::runtime_error("at most 32 components can be persisted");
+  std::vector<const ComponentInfo *> stored;
+  for ( auto &name : components ) {
+    const ComponentInfo *info = components_.find(name);
+    if ( !info )
+      throw std::runtime_error("persisted component " + name + " is not registered");
+    stored.push_back(info);
+  }
+  size_t slots_offset = 0;
+  std::vector<size_t> columns;
+  size_t buffer_size = 0;
+  const size_t size = layout(stored, capacity, slots_offset, columns, buffer_size);
+
+  // Everything is checked on a file of its own, so a store that is refused
+  // leaves the open one alone.
+  struct stat status;
+  const bool exists = ::stat(path.c_str(), &status) == 0 && status.st_size > 0;
+  if ( exists && static_cast<size_t>(status.st_size) != size )
+    throw std::runtime_error("persistent store " + path + " has a different layout");
+  MappedFile file;
+  file.open(path, size);
+  Header *header = reinterpret_cast<Header *>(file.data());
+  StoredComponent *descriptors = component_table(file, sizeof(Header));
+  StoredClass *classes = reinterpret_cast<StoredClass *>(descriptors + stored.size());
+
+  std::unordered_map<std::string, uint32_t> known;
+  if ( exists ) {
+    bool same = std::memcmp(header->magic, store_magic, sizeof(store_magic)) == 0 &&
+                header->version == store_version && header->components == stored.size() &&
+                header->capacity == capacity && header->class_capacity == class_capacity &&
+                header->used[0] <= capacity && header->used[1] <= capacity &&
+                header->classes <= class_capacity;
+    for ( size_t c = 0; same && c < stored.size(); ++c ) {
+      same = read_name(descriptors[c].name, sizeof(descriptors[c].name)) == stored[c]->name() &&
+             descriptors[c].size == stored[c]->size();
+    }
+    if ( !same )
+      throw std::runtime_error("persistent store " + path + " has a different layout");
+    for ( uint32_t i = 0; i < header->classes; ++i ) {
+      known[read_name(classes[i].module, sizeof(classes[i].module)) + ":" +
+            read_name(classes[i].cls, sizeof(classes[i].cls))] = i;
+    }
+  } else {
+    for ( size_t c = 0; c < stored.size(); ++c ) {
+      copy_name(descriptors[c].name, sizeof(descriptors[c].name), stored[c]->name(), "component");
+      descriptors[c].size = stored[c]->size();
+    }
+    header->version = store_version;
+    header->components = static_cast<uint32_t>(stored.size());
+    header->capacity = capacity;
+    header->generation = 0;
+    header->used[0] = 0;
+    header->used[1] = 0;
+    header->classes = 0;
+    header->class_capacity = class_capacity;
+    // The magic goes last, so a crash while creating leaves an invalid file.
+    file.sync(true);
+    std::memcpy(header->magic, store_magic, sizeof(store_magic));
+  }
+
+  close();
+  file_ = std::move(file);
+  header_ = header;
+  stored_.swap(stored);
+  slots_offset_ = slots_offset;
+  columns_.swap(columns);
+  buffer_size_ = buffer_size;
+  classes_.swap(known);
+  return exists && header_->used[committed()] != 0;
+}
+
+std::vector<Entity::Id> PersistentStore::reopen(const Bind &bind) {
+  std::vector<Entity::Id> ids;
+  std::vector<std::pair<Entity::Id, uint32_t>> scripts;
+  const StoredClass *classes = reinterpret_cast<const StoredClass *>(
+    component_table(file_, sizeof(Header)) + stored_.size());
+  const size_t buffer = committed();
+  Slot *slot = slots(buffer);
+  const size_t used = static_cast<size_t>(header_->used[buffer]);
+  for ( size_t i = 0; i < used; ++i ) {
+    if ( slot[i].id != 0 )
+      ids.push_back(entities_.create().id());
+  }
+  size_t next = 0;
+  for ( size_t i = 0; i < used; ++i ) {
+    if ( slot[i].id == 0 )
+      continue;
+    const Entity::Id id = ids[next++];
+    for ( size_t c = 0; c < stored_.size(); ++c ) {
+      if ( slot[i].components & (1u << c) ) {
+        const size_t size = stored_[c]->size();
+        std::memcpy(stored_[c]->assign(entities_, id), column(buffer, c) + i * size, size);
+      }
+    }
+    if ( slot[i].script != 0 && slot[i].script <= header_->classes )
+      scripts.emplace_back(id, slot[i].script - 1);
+  }
+  // Scripts last, so their Component attributes find the components.
+  for ( auto &script : scripts ) {
+    const StoredClass &cls = classes[script.second];
+    bind(script.first, read_name(cls.module, sizeof(cls.module)),
+         read_name(cls.cls, sizeof(cls.cls)));
+  }
+  return ids;
+}
+
+uint32_t PersistentStore::class_index(const py::object &object) {
+  // By name rather than class object, as hot reloading makes new ones.
+  class_key(Py_TYPE(object.ptr()), key_);
+  auto known = classes_.find(key_);
+  if ( known != classes_.end() )
+    return known->second;
+
+  if ( header_->classes == class_capacity )
+    throw std::runtime_error("too many script classes to persist");
+  py::object cls = py::reinterpret_borrow<py::object>(
+    reinterpret_cast<PyObject *>(Py_TYPE(object.ptr())));
+  const std::string module = py::cast<std::string>(cls.attr("__module__"));
+  const std::string name = py::cast<std::string>(cls.attr("__name__"));
+  const uint32_t index = header_->classes;
+  StoredClass &stored = reinterpret_cast<StoredClass *>(
+    component_table(file_, sizeof(Header)) + stored_.size())[index];
+  copy_name(stored.module, sizeof(stored.module), module, "module");
+  copy_name(stored.cls, sizeof(stored.cls), name, "class");
+  header_->classes = index + 1;
+  classes_[key_] = index;
+  return index;
+}
+
+void PersistentStore::sync() {
+  const size_t capacity = static_cast<size_t>(header_->capacity);
+  const size_t buffer = 1 - committed();
+  masks_.clear();
+  scripts_.clear();
+  ids_.clear();
+  auto slot_of = [&](Entity::Id id) {
+    const size_t index = id.index();
+    if ( index >= capacity )
+      throw std::runtime_error("persistent store is full");
+    if ( index >= masks_.size() ) {
+      masks_.resize(index + 1, 0);
+      scripts_.resize(index + 1, 0);
+      ids_.resize(index + 1, 0);
+    }
+    ids_[index] = id.id();
+    return index;
+  };
+
+  for ( size_t c = 0; c < stored_.size(); ++c ) {
+    const size_t size = stored_[c]->size();
+    char *data = column(buffer, c);
+    stored_[c]->each(entities_, [&](Entity::Id id, void *component) {
+      const size_t index = slot_of(id);
+      masks_[index] |= 1u << c;
+      std::memcpy(data + index * size, component, size);
+    });
+  }
+  entities_.each<PythonScript>([&](Entity entity, PythonScript &script) {
+    if ( !script.object )
+      return;
+    const uint32_t cls = class_index(script.object);
+    scripts_[slot_of(entity.id())] = cls + 1;
+  });
+
+  Slot *slot = slots(buffer);
+  for ( size_t i = 0; i < masks_.size(); ++i ) {
+    const bool used = masks_[i] != 0 || scripts_[i] != 0;
+    slot[i].id = used ? ids_[i] : 0;
+    slot[i].components = masks_[i];
+    slot[i].script = scripts_[i];
+  }
+  header_->used[buffer] = masks_.size();
+  // Only pages written since the last sync are flushed: the buffer and any
+  // new classes. The generation is published once they are on disk.
+  file_.sync(true);
+  ++header_->generation;
+  file_.sync();
+}
+
+void PersistentStore::close() {
+  classes_.clear();
+  if ( file_.is_open() )
+    file_.close();
+  header_ = nullptr;
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,123 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "entityx/Entity.h"
+#include "entityx/python/ComponentRegistry.hpp"
+#include "entityx/python/MappedFile.h"
+
+namespace py = pybind11;
+
+namespace entityx {
+namespace python {
+
+/**
+ * Keeps selected registered components and the class of every script in a
+ * memory-mapped file, so a persistent world outlives its process.
+ *
+ * The file holds two buffers of one slot per entity index, up to a fixed
+ * capacity, and one column of raw components per selected type:
+ *
+ *   header   magic "EXPYPERS", version, component count, capacity,
+ *            generation, slots in use per buffer, class count and class
+ *            capacity
+ *   per selected component: its name and size
+ *   classes  (module, class) of every script class seen
+ *   twice:
+ *     slots    per entity index: entity id (0 if unused), a bit per stored
+ *              component and the script's class + 1 (0 if none)
+ *     columns  per selected component, `capacity` raw components
+ *
+ * The buffer of the header's generation holds the last complete sync.
+ * sync() writes the world into the other buffer, waits for msync to flush
+ * it and only then bumps the generation, so a crash or power loss in the
+ * middle of a sync leaves the previous one intact. The price is a
+ * synchronous flush of the written pages per sync.
+ *
+ * reopen() copies the components straight out of the mapping; scripts get
+ * a new object of their class without running __init__, so script state
+ * that must survive belongs in components. Only files with the same
+ * components, component sizes and capacity can be reopened.
+ */
+class PersistentStore {
+public:
+  /// A script entity to re-bind: its new id, module and class.
+  typedef std::function<void(Entity::Id, const std::string &, const std::string &)> Bind;
+
+  static const size_t max_components = 32;
+  static const size_t class_capacity = 256;
+
+  PersistentStore(EntityManager &entities, const ComponentRegistry &components)
+    : entities_(entities), components_(components), header_(nullptr), slots_offset_(0),
+      buffer_size_(0) {}
+
+  /**
+   * Map `path`, creating it if needed, in place of the file open so far.
+   * `components` name registered components. Returns whether the file
+   * already held a world. Throws std::runtime_error if the file exists with
+   * a different layout, leaving the previous file open.
+   */
+  bool open(const std::string &path, const std::vector<std::string> &components, size_t capacity);
+
+  bool is_open() const {
+    return file_.is_open();
+  }
+
+  /**
+   * Create an entity for every stored one, assign its stored components and
+   * call `bind` for those with a script. Returns the new ids in slot order.
+   */
+  std::vector<Entity::Id> reopen(const Bind &bind);
+
+  /**
+   * Store the current world in the buffer not holding the last sync and
+   * commit it. Throws std::runtime_error if an entity index is beyond the
+   * capacity or there are too many script classes, leaving the last sync
+   * in place. Requires the GIL.
+   */
+  void sync();
+
+  /// Unmap the file. Requires the GIL.
+  void close();
+
+private:
+  struct Header;
+  struct Slot;
+
+  // The size of a file storing `stored` components, with the offsets of the
+  // first buffer's slots and columns and the size of a buffer.
+  static size_t layout(const std::vector<const ComponentInfo *> &stored, size_t capacity,
+                       size_t &slots_offset, std::vector<size_t> &columns, size_t &buffer_size);
+  uint32_t class_index(const py::object &object);
+  // The buffer holding the last sync.
+  size_t committed() const;
+  Slot *slots(size_t buffer) const;
+  char *column(size_t buffer, size_t component) const;
+
+  EntityManager &entities_;
+  const ComponentRegistry &components_;
+  MappedFile file_;
+  Header *header_;
+  std::vector<const ComponentInfo *> stored_;
+  size_t slots_offset_;
+  std::vector<size_t> columns_;
+  size_t buffer_size_;
+  // Class index of every "module:class" in the file, by class_key().
+  std::unordered_map<std::string, uint32_t> classes_;
+  std::string key_;
+  // Per entity index while syncing.
+  std::vector<uint32_t> masks_;
+  std::vector<uint32_t> scripts_;
+  std::vector<uint64_t> ids_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,162 @@
+// Copyright 2017 Bablawn3d5
+
+#include <algorithm>
+#include "entityx/python/PythonHost.h"
+
+namespace py = pybind11;
+
+namespace entityx {
+namespace python {
+
+// The thread state of the calling thread, or null. Unlike PyThreadState_Get()
+// this does not abort when there is none.
+static PyThreadState *current_thread_state() {
+#if PY_VERSION_HEX >= 0x030D0000
+  return PyThreadState_GetUnchecked();
+#elif PY_VERSION_HEX >= 0x03050200
+  return _PyThreadState_UncheckedGet();
+#elif PY_MAJOR_VERSION >= 3
+  return reinterpret_cast<PyThreadState *>(_Py_atomic_load_relaxed(&_PyThreadState_Current));
+#else
+  return _PyThreadState_Current;
+#endif
+}
+
+PythonHost::Lock::Lock(PythonHost &)
+  : ensured_(false) {
+  if ( current_thread_state() )
+    return;
+  gil_ = PyGILState_Ensure();
+  ensured_ = true;
+}
+
+PythonHost::Lock::~Lock() {
+  if ( ensured_ )
+    PyGILState_Release(gil_);
+}
+
+PythonHost::Release::Release()
+  : previous_(current_thread_state() ? PyEval_SaveThread() : nullptr) {}
+
+PythonHost::Release::~Release() {
+  if ( previous_ )
+    PyEval_RestoreThread(previous_);
+}
+
+std::shared_ptr<PythonHost> PythonHost::shared() {
+  static std::shared_ptr<PythonHost> host = std::make_shared<PythonHost>(false);
+  return host;
+}
+
+PythonHost::PythonHost(bool finalize)
+  : owns_interpreter_(!Py_IsInitialized()), finalize_(finalize) {
+  if ( owns_interpreter_ ) {
+    Py_Initialize();
+#if PY_VERSION_HEX < 0x03070000
+    // Create the GIL so that background threads can take it.
+    PyEval_InitThreads();
+#endif
+  }
+}
+
+PythonHost::~PythonHost() {
+  if ( owns_interpreter_ && finalize_ ) {
+    Py_Finalize();
+  }
+}
+
+void PythonHost::add_module(const std::string &name, ModuleInit init) {
+  Lock lock(*this);
+  std::lock_guard<std::mutex> guard(mutex_);
+  if ( std::find(modules_.begin(), modules_.end(), name) != modules_.end() )
+    return;
+  PyObject *module = init();
+  if ( !module )
+    throw py::error_already_set();
+  // Python 3 does not add modules created with PyModule_Create to
+  // sys.modules; Python 2 already has, and this is a no-op.
+  PyDict_SetItemString(PyImport_GetModuleDict(), name.c_str(), module);
+  modules_.push_back(name);
+}
+
+bool PythonHost::has_module(const std::string &name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::find(modules_.begin(), modules_.end(), name) != modules_.end();
+}
+
+void PythonHost::collect() {
+  Lock lock(*this);
+  py::module::import("gc").attr("collect")();
+}
+
+std::shared_ptr<JobPool> PythonHost::job_pool() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if ( !job_pool_ )
+    job_pool_ = std::make_shared<JobPool>();
+  return job_pool_;
+}
+
+void PythonHost::push_attr(const void *owner, py::object target, const std::string &name,
+                           py::object value) {
+  Lock lock(*this);
+  auto same = [&](const Original &original) {
+    return original.target.ptr() == target.ptr() && original.name == name;
+  };
+  if ( std::find_if(originals_.begin(), originals_.end(), same) == originals_.end() ) {
+    Original original;
+    original.target = target;
+    original.name = name;
+    if ( PyObject_HasAttrString(target.ptr(), name.c_str()) )
+      original.value = target.attr(name.c_str());
+    originals_.push_back(original);
+  }
+  target.attr(name.c_str()) = value;
+  Pushed pushed;
+  pushed.owner = owner;
+  pushed.target = target;
+  pushed.name = name;
+  pushed.value = value;
+  pushed_.push_back(pushed);
+}
+
+void PythonHost::pop_attrs(const void *owner) {
+  Lock lock(*this);
+  for ( size_t i = pushed_.size(); i-- > 0; ) {
+    if ( pushed_[i].owner != owner )
+      continue;
+    const Pushed popped = pushed_[i];
+    pushed_.erase(pushed_.begin() + i);
+    auto same = [&](const Pushed &pushed) {
+      return pushed.target.ptr() == popped.target.ptr() && pushed.name == popped.name;
+    };
+    // Only touch the attribute if it still holds the popped value: either
+    // another owner pushed since, or something else has replaced it.
+    PyObject *current = PyObject_GetAttrString(popped.target.ptr(), popped.name.c_str());
+    if ( !current )
+      PyErr_Clear();
+    const bool ours = current == popped.value.ptr();
+    Py_XDECREF(current);
+
+    auto newest = std::find_if(pushed_.rbegin(), pushed_.rend(), same);
+    if ( newest != pushed_.rend() ) {
+      if ( ours )
+        popped.target.attr(popped.name.c_str()) = newest->value;
+      continue;
+    }
+    // That was the last push, so the original value goes back.
+    auto original = std::find_if(originals_.begin(), originals_.end(), [&](const Original &o) {
+      return o.target.ptr() == popped.target.ptr() && o.name == popped.name;
+    });
+    if ( ours ) {
+      if ( original->value ) {
+        popped.target.attr(popped.name.c_str()) = original->value;
+      } else if ( PyObject_DelAttrString(popped.target.ptr(), popped.name.c_str()) != 0 ) {
+        PyErr_Clear();
+      }
+    }
+    originals_.erase(original);
+  }
+}
+
+}  // namespace python
+}  // namespace entityx
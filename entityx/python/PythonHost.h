@@ -0,0 +1,146 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "entityx/python/JobPool.h"
+
+namespace entityx {
+namespace python {
+
+/**
+ * Owns the embedded Python interpreter.
+ *
+ * The host initializes Python, registers extension modules exactly once and,
+ * if it started the interpreter, finalizes it when destroyed. PythonSystems
+ * share a host, so creating and destroying them (e.g. one per match) does
+ * not initialize Python or register modules again.
+ *
+ * pybind11 keeps type information across Py_Finalize(), so only finalize at
+ * process exit: create one host and let every PythonSystem share it.
+ */
+class PythonHost {
+public:
+  /// An extension module initializer, as defined by PYBIND11_PLUGIN.
+  typedef PyObject *(*ModuleInit)();
+
+  /**
+   * Attaches the calling thread to the interpreter and holds the GIL.
+   *
+   * Any thread may take a Lock, and nesting is cheap: if the thread already
+   * holds the GIL nothing happens.
+   */
+  class Lock {
+  public:
+    explicit Lock(PythonHost &host);
+    ~Lock();
+
+    Lock(const Lock &) = delete;
+    Lock &operator = (const Lock &) = delete;
+
+  private:
+    PyGILState_STATE gil_;
+    bool ensured_;
+  };
+
+  /**
+   * Releases the GIL if the calling thread holds it, so other threads can
+   * take it while this one waits.
+   */
+  class Release {
+  public:
+    Release();
+    ~Release();
+
+    Release(const Release &) = delete;
+    Release &operator = (const Release &) = delete;
+
+  private:
+    PyThreadState *previous_;
+  };
+
+  /**
+   * The host used by PythonSystem(EntityManager&). It lives until the
+   * process exits and never finalizes Python.
+   */
+  static std::shared_ptr<PythonHost> shared();
+
+  /**
+   * Initialize Python if it is not running yet. PythonSystem registers the
+   * _entityx module with its host.
+   *
+   * @param finalize Finalize Python in the destructor if this host
+   * initialized it.
+   */
+  explicit PythonHost(bool finalize = true);
+  ~PythonHost();
+
+  PythonHost(const PythonHost &) = delete;
+  PythonHost &operator = (const PythonHost &) = delete;
+
+  /**
+   * Register an extension module so that scripts can import it. Modules are
+   * only initialized the first time their name is added.
+   *
+   *   host->add_module("mygame", &mygame::pybind11_init);
+   */
+  void add_module(const std::string &name, ModuleInit init);
+
+  bool has_module(const std::string &name) const;
+
+  /// Run the Python garbage collector.
+  void collect();
+
+  /**
+   * The pool that PythonSystems on this host run script jobs on, unless
+   * given their own with set_job_pool(). Created with a worker per core on
+   * first use.
+   */
+  std::shared_ptr<JobPool> job_pool();
+
+  /**
+   * Set `target.name` to `value` on behalf of `owner` until pop_attrs(owner).
+   * PythonSystem uses this for sys.stdout, sys.stderr and _entityx._world.
+   */
+  void push_attr(const void *owner, pybind11::object target, const std::string &name,
+                 pybind11::object value);
+
+  /**
+   * Take back every value `owner` pushed, in any order. An attribute that
+   * still holds one of them goes back to the newest value another owner
+   * pushed, or to what it was before the first push.
+   */
+  void pop_attrs(const void *owner);
+
+private:
+  // A value push_attr() gave an attribute.
+  struct Pushed {
+    const void *owner;
+    pybind11::object target;
+    std::string name;
+    pybind11::object value;
+  };
+
+  // What an attribute held before its first push_attr(); null if unset.
+  struct Original {
+    pybind11::object target;
+    std::string name;
+    pybind11::object value;
+  };
+
+  mutable std::mutex mutex_;
+  std::vector<std::string> modules_;
+  std::shared_ptr<JobPool> job_pool_;
+  // Guarded by the GIL.
+  std::vector<Pushed> pushed_;
+  std::vector<Original> originals_;
+  bool owns_interpreter_;
+  bool finalize_;
+};
+
+}  // namespace python
+}  // namespace entityx
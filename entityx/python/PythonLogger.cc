@@ -0,0 +1,231 @@
+// Copyright 2017 Bablawn3d5
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <sstream>
+#include "entityx/python/PythonLogger.h"
+
+namespace entityx {
+namespace python {
+
+const size_t ScriptLogger::max_windows;
+
+const size_t PythonEntityXLogger::DEFAULT_CAPACITY;
+
+PythonEntityXLogger::PythonEntityXLogger(LoggerFunction logger, size_t capacity)
+  : logger_(logger), buffer_(capacity), head_(0), tail_(0), delivered_(0), stop_(false) {
+  assert(capacity > 0);
+  thread_ = std::thread(&PythonEntityXLogger::run, this);
+}
+
+PythonEntityXLogger::~PythonEntityXLogger() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+}
+
+void PythonEntityXLogger::write(const char *text, size_t size) {
+  std::lock_guard<std::mutex> writer(write_mutex_);
+  const size_t capacity = buffer_.size();
+  const bool newline = std::memchr(text, '\n', size) != nullptr;
+  while ( size ) {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    const uint64_t tail = tail_.load(std::memory_order_acquire);
+    const size_t available = capacity - static_cast<size_t>(head - tail);
+    if ( available == 0 ) {
+      // Full: let the logger thread make room.
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.notify_one();
+      progress_.wait(lock, [&] { return tail_.load(std::memory_order_acquire) != tail; });
+      continue;
+    }
+    const size_t count = std::min(size, available);
+    const size_t offset = static_cast<size_t>(head % capacity);
+    const size_t first = std::min(count, capacity - offset);
+    std::memcpy(&buffer_[offset], text, first);
+    std::memcpy(&buffer_[0], text + first, count - first);
+    head_.store(head + count, std::memory_order_release);
+    text += count;
+    size -= count;
+  }
+  // Only complete lines are worth waking the logger thread for.
+  if ( newline ) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wake_.notify_one();
+  }
+}
+
+void PythonEntityXLogger::flush() {
+  const uint64_t target = head_.load(std::memory_order_relaxed);
+  std::unique_lock<std::mutex> lock(mutex_);
+  wake_.notify_one();
+  progress_.wait(lock, [&] { return delivered_ >= target; });
+}
+
+void PythonEntityXLogger::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for ( ;; ) {
+    wake_.wait(lock, [this] {
+      return stop_ || head_.load(std::memory_order_acquire) != tail_.load(std::memory_order_relaxed);
+    });
+    const bool stop = stop_;
+    lock.unlock();
+    drain();
+    lock.lock();
+    if ( stop && head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_relaxed) )
+      break;
+  }
+  lock.unlock();
+  if ( !pending_.empty() ) {
+    try {
+      logger_(pending_);
+    }
+    catch ( ... ) {
+    }
+  }
+}
+
+void PythonEntityXLogger::drain() {
+  const size_t capacity = buffer_.size();
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+  const uint64_t head = head_.load(std::memory_order_acquire);
+  while ( tail != head ) {
+    const size_t offset = static_cast<size_t>(tail % capacity);
+    const size_t count = static_cast<size_t>(std::min<uint64_t>(head - tail, capacity - offset));
+    pending_.append(&buffer_[offset], count);
+    tail += count;
+  }
+  {
+    // Release the ring space before calling the logger, which may be slow.
+    std::lock_guard<std::mutex> lock(mutex_);
+    tail_.store(tail, std::memory_order_release);
+  }
+  progress_.notify_all();
+
+  // line_ and pending_ keep their capacity, so steady state logging does not
+  // allocate.
+  size_t start = 0, newline;
+  while ( (newline = pending_.find('\n', start)) != std::string::npos ) {
+    line_.assign(pending_, start, newline - start);
+    try {
+      logger_(line_);
+    }
+    catch ( ... ) {
+      // There is nobody to report to on the logger thread; drop the line.
+    }
+    start = newline + 1;
+  }
+  pending_.erase(0, start);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    delivered_ = tail;
+  }
+  progress_.notify_all();
+}
+
+const char *log_level_name(LogLevel level) {
+  switch ( level ) {
+    case LogLevel::Debug: return "DEBUG";
+    case LogLevel::Info: return "INFO";
+    case LogLevel::Warning: return "WARNING";
+    case LogLevel::Error: return "ERROR";
+  }
+  return "UNKNOWN";
+}
+
+ScriptLogger::ScriptLogger(RecordFunction records)
+  : records_(records), level_(LogLevel::Info), burst_(10),
+    interval_(std::chrono::seconds(1)), suppressed_(0) {}
+
+void ScriptLogger::set_records(RecordFunction records) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  records_ = records;
+}
+
+void ScriptLogger::set_rate_limit(size_t burst, double interval) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  burst_ = burst;
+  interval_ = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval));
+  windows_.clear();
+  suppressed_ = 0;
+}
+
+bool ScriptLogger::admit(LogLevel level, Entity::Id entity, const std::string &cls,
+                         const std::string &format) {
+  if ( !enabled(level) )
+    return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if ( burst_ == 0 )
+    return true;
+
+  auto key = std::make_pair(cls, format);
+  const Clock::time_point now = Clock::now();
+  auto it = windows_.find(key);
+  if ( it == windows_.end() ) {
+    if ( windows_.size() >= max_windows )
+      evict(now, false);
+    if ( windows_.size() >= max_windows )
+      return true;
+    Window window = { now, 1, 0, level, entity, cls, format };
+    windows_.emplace(std::move(key), window);
+    return true;
+  }
+
+  Window &window = it->second;
+  if ( now - window.start >= interval_ ) {
+    summarize(window);
+    window.start = now;
+    window.count = 0;
+  }
+  if ( window.count < burst_ ) {
+    ++window.count;
+    return true;
+  }
+  if ( !window.suppressed++ )
+    ++suppressed_;
+  window.level = level;
+  window.entity = entity;
+  return false;
+}
+
+void ScriptLogger::log(const LogRecord &record) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if ( records_ )
+    records_(record);
+}
+
+void ScriptLogger::flush_suppressed(bool force) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  evict(Clock::now(), force);
+}
+
+void ScriptLogger::evict(Clock::time_point now, bool force) {
+  for ( auto it = windows_.begin(); it != windows_.end(); ) {
+    if ( force || now - it->second.start >= interval_ ) {
+      summarize(it->second);
+      it = windows_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ScriptLogger::summarize(Window &window) {
+  if ( !window.suppressed )
+    return;
+  std::stringstream message;
+  message << "suppressed " << window.suppressed << " identical messages: " << window.format;
+  LogRecord record = { window.level, window.entity, window.cls, message.str() };
+  window.suppressed = 0;
+  --suppressed_;
+  if ( records_ )
+    records_(record);
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,198 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "entityx/Entity.h"
+
+namespace entityx {
+namespace python {
+
+/**
+ * A line-based logger for Python's sys.stdout and sys.stderr.
+ *
+ * write() copies text into a preallocated ring buffer and returns; a
+ * background thread splits the buffered text into lines (not including \n)
+ * and passes each one to the LoggerFunction. The LoggerFunction is therefore
+ * always called from the logger thread, never from the script.
+ *
+ * write() may be called from several threads, e.g. by scripts during a
+ * parallel PythonSystem::update(); whole writes are never interleaved.
+ */
+class PythonEntityXLogger {
+public:
+  typedef std::function<void(const std::string &)> LoggerFunction;
+
+  static const size_t DEFAULT_CAPACITY = 64 * 1024;
+
+  explicit PythonEntityXLogger(LoggerFunction logger, size_t capacity = DEFAULT_CAPACITY);
+  /// Logs any remaining partial line and stops the logger thread.
+  ~PythonEntityXLogger();
+
+  PythonEntityXLogger(const PythonEntityXLogger &) = delete;
+  PythonEntityXLogger &operator = (const PythonEntityXLogger &) = delete;
+
+  /**
+   * Append text to the buffer. Blocks only if the buffer is full.
+   */
+  void write(const char *text, size_t size);
+  void write(const std::string &text) {
+    write(text.data(), text.size());
+  }
+
+  /**
+   * Block until every complete line written so far has been logged.
+   */
+  void flush();
+
+private:
+  void run();
+  void drain();
+
+  LoggerFunction logger_;
+  std::vector<char> buffer_;
+  // Monotonic byte counts; the position in buffer_ is count % capacity.
+  std::atomic<uint64_t> head_;
+  std::atomic<uint64_t> tail_;
+
+  // Serializes writers; uncontended unless scripts run on several threads.
+  std::mutex write_mutex_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable progress_;
+  uint64_t delivered_;
+  bool stop_;
+
+  // Owned by the logger thread.
+  std::string pending_;
+  std::string line_;
+
+  std::thread thread_;
+};
+
+/**
+ * Severity of a script log record. Values match Python's logging module.
+ */
+enum class LogLevel : int {
+  Debug = 10,
+  Info = 20,
+  Warning = 30,
+  Error = 40
+};
+
+const char *log_level_name(LogLevel level);
+
+/**
+ * A log line emitted by a script through Entity.debug()/info()/warning()/
+ * error(), tagged with the emitting entity and its script class.
+ */
+struct LogRecord {
+  LogLevel level;
+  Entity::Id entity;
+  std::string cls;
+  std::string message;
+};
+
+/**
+ * Filters script log records by level and rate-limits identical messages.
+ *
+ * Messages are identical if they come from the same script class with the
+ * same format string, regardless of their arguments. At most `burst` of
+ * them are passed on per `interval`; the rest are counted and reported as a
+ * single summary record once the interval is over.
+ *
+ * Each (class, format) pair is remembered until its interval is over and
+ * flush_suppressed() runs, and at most `max_windows` at once; messages
+ * beyond that are passed on without limit, so scripts logging many unique
+ * strings cost bounded memory.
+ */
+class ScriptLogger {
+public:
+  typedef std::function<void(const LogRecord &)> RecordFunction;
+  typedef std::chrono::steady_clock Clock;
+
+  static const size_t max_windows = 4096;
+
+  explicit ScriptLogger(RecordFunction records);
+
+  void set_records(RecordFunction records);
+
+  void set_level(LogLevel level) {
+    level_.store(level, std::memory_order_relaxed);
+  }
+
+  LogLevel level() const {
+    return level_.load(std::memory_order_relaxed);
+  }
+
+  bool enabled(LogLevel level) const {
+    return level >= this->level();
+  }
+
+  /**
+   * Pass on at most `burst` identical messages per `interval` seconds.
+   * A burst of 0 disables rate limiting.
+   */
+  void set_rate_limit(size_t burst, double interval);
+
+  /**
+   * Returns true if a message with this class and format string should be
+   * logged now. Call before formatting the message.
+   */
+  bool admit(LogLevel level, Entity::Id entity, const std::string &cls,
+             const std::string &format);
+
+  /**
+   * Log a record that has passed admit().
+   */
+  void log(const LogRecord &record);
+
+  /**
+   * Report suppressed messages whose interval is over and forget those
+   * messages. With force, report and forget all of them.
+   */
+  void flush_suppressed(bool force = false);
+
+  /// The (class, format) pairs currently remembered.
+  size_t windows() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return windows_.size();
+  }
+
+private:
+  struct Window {
+    Clock::time_point start;
+    size_t count;
+    size_t suppressed;
+    LogLevel level;
+    Entity::Id entity;
+    std::string cls;
+    std::string format;
+  };
+
+  void summarize(Window &window);
+  // Summarize and forget windows whose interval is over, or all with force.
+  void evict(Clock::time_point now, bool force);
+
+  mutable std::mutex mutex_;
+  RecordFunction records_;
+  std::atomic<LogLevel> level_;
+  size_t burst_;
+  Clock::duration interval_;
+  size_t suppressed_;
+  // Keyed on the class and format themselves, as hashes could collide.
+  std::map<std::pair<std::string, std::string>, Window> windows_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,162 @@
+// Copyright 2017 Bablawn3d5
+
+#define CATCH_CONFIG_MAIN
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "entityx/python/3rdparty/catch.hpp"
+#include "entityx/python/BinaryLogSink.h"
+#include "entityx/python/PythonLogger.h"
+
+using namespace entityx;
+using namespace entityx::python;
+
+TEST_CASE("TestLoggerSplitsLines") {
+  std::vector<std::string> lines;
+  {
+    PythonEntityXLogger logger([&](const std::string &line) { lines.push_back(line); }, 8);
+    logger.write("hello\nwor");
+    logger.write("ld\n");
+    // Longer than the ring buffer, so write() has to wait for the logger thread.
+    logger.write("a line longer than the buffer\npartial");
+    logger.flush();
+    REQUIRE(lines.size() == 3);
+    REQUIRE(lines[0] == "hello");
+    REQUIRE(lines[1] == "world");
+    REQUIRE(lines[2] == "a line longer than the buffer");
+  }
+  // The partial line is logged when the logger is destroyed.
+  REQUIRE(lines.size() == 4);
+  REQUIRE(lines[3] == "partial");
+}
+
+TEST_CASE("TestLoggerManyWrites") {
+  std::vector<std::string> lines;
+  PythonEntityXLogger logger([&](const std::string &line) { lines.push_back(line); }, 64);
+  for ( int i = 0; i < 10000; ++i ) {
+    logger.write("line\n");
+  }
+  logger.flush();
+  REQUIRE(lines.size() == 10000);
+  REQUIRE(lines.back() == "line");
+}
+
+TEST_CASE("TestScriptLoggerRateLimit") {
+  std::vector<LogRecord> records;
+  ScriptLogger log([&](const LogRecord &record) { records.push_back(record); });
+  log.set_rate_limit(2, 1000.0);
+  Entity::Id id(1, 1);
+  for ( int i = 0; i < 10; ++i ) {
+    if ( log.admit(LogLevel::Info, id, "Player", "hit %d") ) {
+      LogRecord record = { LogLevel::Info, id, "Player", "hit" };
+      log.log(record);
+    }
+  }
+  // Other classes and other formats are limited separately.
+  REQUIRE(log.admit(LogLevel::Info, id, "Enemy", "hit %d"));
+  REQUIRE(log.admit(LogLevel::Info, id, "Player", "miss %d"));
+  REQUIRE(records.size() == 2);
+  log.flush_suppressed();
+  REQUIRE(records.size() == 2);
+  log.flush_suppressed(true);
+  REQUIRE(records.size() == 3);
+  REQUIRE(records[2].message == "suppressed 8 identical messages: hit %d");
+}
+
+TEST_CASE("TestScriptLoggerForgetsMessages") {
+  ScriptLogger log(nullptr);
+  Entity::Id id(1, 1);
+  // Unique messages under the limit are forgotten once their interval is
+  // over, even though none were suppressed.
+  log.set_rate_limit(2, 0.0);
+  for ( int i = 0; i < 100; ++i ) {
+    REQUIRE(log.admit(LogLevel::Info, id, "Player", "pos " + std::to_string(i)));
+  }
+  REQUIRE(log.windows() == 100);
+  log.flush_suppressed();
+  REQUIRE(log.windows() == 0);
+
+  // However many there are, only so many are remembered.
+  log.set_rate_limit(2, 1000.0);
+  for ( size_t i = 0; i < ScriptLogger::max_windows + 10; ++i ) {
+    REQUIRE(log.admit(LogLevel::Info, id, "Player", "pos " + std::to_string(i)));
+  }
+  REQUIRE(log.windows() == ScriptLogger::max_windows);
+}
+
+TEST_CASE("TestScriptLoggerLevel") {
+  ScriptLogger log(nullptr);
+  log.set_level(LogLevel::Warning);
+  REQUIRE(!log.admit(LogLevel::Info, Entity::Id(), "Player", "info"));
+  REQUIRE(log.admit(LogLevel::Error, Entity::Id(), "Player", "error"));
+}
+
+TEST_CASE("TestBinaryLogSinkRotatesSegments") {
+  const std::string path = "PythonLogger_test.log";
+  const size_t record_size = sizeof(BinaryLogRecordHeader) + 8;
+  const size_t segment_size = sizeof(BinaryLogSegmentHeader) + 2 * record_size;
+  {
+    BinaryLogSink sink(path, segment_size, 2);
+    // Five records of two per segment: segment 0 is reused for the fifth.
+    for ( int i = 0; i < 5; ++i ) {
+      std::string message = "line " + std::to_string(i);
+      sink.write(LogLevel::Info, Entity::Id(i, 1), message.data(), message.size());
+    }
+  }
+
+  MappedFile segment;
+  segment.open_readonly(path + ".0");
+  BinaryLogSegmentHeader header;
+  std::memcpy(&header, segment.data(), sizeof(header));
+  REQUIRE(std::string(header.magic) == "EXPYLOG");
+  REQUIRE(header.sequence == 2);
+  REQUIRE(header.size == record_size);
+  BinaryLogRecordHeader record;
+  std::memcpy(&record, segment.data() + sizeof(header), sizeof(record));
+  REQUIRE(record.entity == Entity::Id(4, 1).id());
+  REQUIRE(record.level == static_cast<uint32_t>(LogLevel::Info));
+  REQUIRE(std::string(segment.data() + sizeof(header) + sizeof(record), record.length) == "line 4");
+  segment.close();
+
+  segment.open_readonly(path + ".1");
+  std::memcpy(&header, segment.data(), sizeof(header));
+  REQUIRE(header.sequence == 1);
+  REQUIRE(header.size == 2 * record_size);
+  segment.close();
+
+  std::remove((path + ".0").c_str());
+  std::remove((path + ".1").c_str());
+}
+
+TEST_CASE("TestBinaryLogSinkContinuesSequence") {
+  const std::string path = "PythonLogger_test_restart.log";
+  const size_t record_size = sizeof(BinaryLogRecordHeader) + 8;
+  const size_t segment_size = sizeof(BinaryLogSegmentHeader) + 2 * record_size;
+  for ( int run = 0; run < 2; ++run ) {
+    // Three records of two per segment: segments 0 and 1 in the first run.
+    BinaryLogSink sink(path, segment_size, 3);
+    for ( int i = 0; i < 3; ++i ) {
+      sink.write(LogLevel::Info, Entity::Id(i, 1), "line", 4);
+    }
+  }
+
+  // The second run went on with sequences 2 and 3, overwriting the oldest.
+  BinaryLogSegmentHeader header;
+  MappedFile segment;
+  segment.open_readonly(path + ".0");
+  std::memcpy(&header, segment.data(), sizeof(header));
+  REQUIRE(header.sequence == 3);
+  segment.open_readonly(path + ".1");
+  std::memcpy(&header, segment.data(), sizeof(header));
+  REQUIRE(header.sequence == 1);
+  segment.open_readonly(path + ".2");
+  std::memcpy(&header, segment.data(), sizeof(header));
+  REQUIRE(header.sequence == 2);
+  segment.close();
+
+  for ( int i = 0; i < 3; ++i ) {
+    std::remove((path + "." + std::to_string(i)).c_str());
+  }
+}
@@ -11,10 +11,22 @@
  // http://docs.python.org/2/extending/extending.html
 #include <pybind11/pybind11.h>
 #include <pybind11/eval.h>
+#include <marshal.h>
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
 #include <string>
 #include <iostream>
 #include <sstream>
+#include "entityx/python/LevelLoader.h"
+#include "entityx/python/MappedFile.h"
+#include "entityx/python/PythonLogger.h"
+#include "entityx/python/ScriptArchive.h"
 #include "entityx/python/PythonScript.hpp"
 #include "entityx/python/PythonSystem.h"
 #include "entityx/python/config.h"
@@ -24,35 +36,6 @@ namespace py = pybind11;
 namespace entityx {
 namespace python {
 
-class PythonEntityXLogger {
-public:
-  PythonEntityXLogger() {}
-  explicit PythonEntityXLogger(PythonSystem::LoggerFunction logger) : logger_(logger) {}
-  ~PythonEntityXLogger() { flush(true); }
-
-  void write(const std::string &text) {
-    line_ += text;
-    flush();
-  }
-
-private:
-  void flush(bool force = false) {
-    size_t offset;
-    while ( (offset = line_.find('\n')) != std::string::npos ) {
-      std::string text = line_.substr(0, offset);
-      logger_(text);
-      line_ = line_.substr(offset + 1);
-    }
-    if ( force && line_.size() ) {
-      logger_(line_);
-      line_ = "";
-    }
-  }
-
-  PythonSystem::LoggerFunction logger_;
-  std::string line_;
-};
-
 /**
  * Base class for Python entities.
  */
@@ -84,23 +67,250 @@ struct PythonEntity {
   Entity _entity;
 };*/
 
+static void Logger_write(PythonEntityXLogger &logger, py::handle text) {
+  // Read the text in place rather than converting to std::string first.
+#if PY_MAJOR_VERSION >= 3
+  Py_ssize_t size = 0;
+  const char *data = PyUnicode_AsUTF8AndSize(text.ptr(), &size);
+  if ( !data )
+    throw py::error_already_set();
+#else
+  char *data = NULL;
+  Py_ssize_t size = 0;
+  if ( PyString_AsStringAndSize(text.ptr(), &data, &size) != 0 )
+    throw py::error_already_set();
+#endif
+  logger.write(data, static_cast<size_t>(size));
+}
+
+static void ScriptLogger_write(ScriptLogger &log, int level, Entity::Id id,
+                               const std::string &cls, py::str format, py::tuple args) {
+  const LogLevel log_level = static_cast<LogLevel>(level);
+  const std::string format_string = py::cast<std::string>(format);
+  // Rate limit on the format string so suppressed messages are never formatted.
+  if ( !log.admit(log_level, id, cls, format_string) )
+    return;
+  LogRecord record = { log_level, id, cls, format_string };
+  if ( py::len(args) != 0 ) {
+    record.message = py::cast<std::string>(format.attr("__mod__")(args));
+  }
+  log.log(record);
+}
+
+static std::string ScriptArchive_filename(const ScriptArchive &archive,
+                                          const std::string &name, bool package) {
+  std::string path = name;
+  std::replace(path.begin(), path.end(), '.', '/');
+  return archive.path() + "/" + path + (package ? "/__init__.py" : ".py");
+}
+
+static ScriptArchive::Module ScriptArchive_find(const ScriptArchive &archive,
+                                                const std::string &name) {
+  ScriptArchive::Module code;
+  if ( !archive.find(name, code) ) {
+    PyErr_SetString(PyExc_ImportError, ("No module named " + name).c_str());
+    throw py::error_already_set();
+  }
+  return code;
+}
+
+// Set the attributes of an archived module and run its code in it.
+static void ScriptArchive_exec(py::object importer, const std::string &name, py::object module) {
+  const ScriptArchive &archive = importer.cast<const ScriptArchive &>();
+  const ScriptArchive::Module code = ScriptArchive_find(archive, name);
+  module.attr("__file__") = py::str(ScriptArchive_filename(archive, name, code.package));
+  module.attr("__loader__") = importer;
+  if ( code.package ) {
+    std::string path = name;
+    std::replace(path.begin(), path.end(), '.', '/');
+    py::list package_path;
+    package_path.append(py::str(archive.path() + "/" + path));
+    module.attr("__path__") = package_path;
+    module.attr("__package__") = py::str(name);
+  } else {
+    const size_t dot = name.rfind('.');
+    module.attr("__package__") = py::str(dot == std::string::npos ? std::string() : name.substr(0, dot));
+  }
+
+  // Unmarshal straight from the mapping.
+  py::object code_object = py::reinterpret_steal<py::object>(
+    PyMarshal_ReadObjectFromString(const_cast<char *>(code.code), static_cast<Py_ssize_t>(code.size)));
+  if ( !code_object )
+    throw py::error_already_set();
+  PyObject *dict = PyModule_GetDict(module.ptr());
+  if ( !PyDict_GetItemString(dict, "__builtins__") )
+    PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins());
+#if PY_MAJOR_VERSION >= 3
+  PyObject *result = PyEval_EvalCode(code_object.ptr(), dict, dict);
+#else
+  PyObject *result = PyEval_EvalCode(reinterpret_cast<PyCodeObject *>(code_object.ptr()), dict, dict);
+#endif
+  if ( !result )
+    throw py::error_already_set();
+  Py_DECREF(result);
+}
+
+// PEP 302 finder, used by Python 2.
+static py::object ArchiveImporter_find_module(py::object self, const std::string &fullname,
+                                              py::object path) {
+  if ( self.cast<const ScriptArchive &>().contains(fullname) )
+    return self;
+  return py::none();
+}
+
+// PEP 302 loader, used by Python 2.
+static py::object ArchiveImporter_load_module(py::object self, const std::string &fullname) {
+  py::object modules = py::module::import("sys").attr("modules");
+  PyObject *existing = PyDict_GetItemString(modules.ptr(), fullname.c_str());
+  if ( existing )
+    return py::reinterpret_borrow<py::object>(existing);
+  py::object module = py::reinterpret_borrow<py::object>(PyImport_AddModule(fullname.c_str()));
+  if ( !module )
+    throw py::error_already_set();
+  try {
+    ScriptArchive_exec(self, fullname, module);
+  }
+  catch ( const py::error_already_set& ) {
+    PyDict_DelItemString(modules.ptr(), fullname.c_str());
+    throw;
+  }
+  // A module may replace itself in sys.modules.
+  return py::reinterpret_borrow<py::object>(PyDict_GetItemString(modules.ptr(), fullname.c_str()));
+}
+
+// PEP 451 finder, used by Python 3.
+static py::object ArchiveImporter_find_spec(py::object self, const std::string &fullname,
+                                            py::object path, py::object target) {
+  const ScriptArchive &archive = self.cast<const ScriptArchive &>();
+  ScriptArchive::Module code;
+  if ( !archive.find(fullname, code) )
+    return py::none();
+  py::object spec_from_loader = py::module::import("importlib.util").attr("spec_from_loader");
+  py::kwargs kwargs;
+  kwargs["origin"] = py::str(ScriptArchive_filename(archive, fullname, code.package));
+  kwargs["is_package"] = py::bool_(code.package);
+  return spec_from_loader(py::str(fullname), self, **kwargs);
+}
+
+static py::object ArchiveImporter_create_module(py::object self, py::object spec) {
+  // Use the default module creation.
+  return py::none();
+}
+
+static void ArchiveImporter_exec_module(py::object self, py::object module) {
+  ScriptArchive_exec(self, py::cast<std::string>(module.attr("__name__")), module);
+}
+
 static std::string Entity_Id_repr(Entity::Id id) {
   std::stringstream repr;
   repr << "<Entity::Id " << id.index() << "." << id.version() << ">";
   return repr.str();
 }
 
+static bool Entity_Id_eq(Entity::Id a, Entity::Id b) {
+  return a == b;
+}
+
+static bool Entity_Id_ne(Entity::Id a, Entity::Id b) {
+  return a != b;
+}
+
 Entity EntityManager_new_entity(EntityManager& entity_manager, py::object self) {
   Entity entity = entity_manager.create();
   entity.assign<PythonScript>(self);
   return entity;
 }
+
+// Scripts may keep their world after its PythonSystem is destroyed.
+static void check_world(const PythonWorld &world) {
+  if ( !world.system )
+    throw std::runtime_error("the PythonSystem of this world has been destroyed");
+}
+
+static EntityManager *World_entity_manager(const PythonWorld &world) {
+  check_world(world);
+  return world.entity_manager;
+}
+
+static EventManager *World_event_manager(const PythonWorld &world) {
+  check_world(world);
+  return world.event_manager;
+}
+
+static ScriptLogger *World_log(const PythonWorld &world) {
+  check_world(world);
+  return world.log;
+}
+
+static int World_log_level(const PythonWorld &world) {
+  check_world(world);
+  return static_cast<int>(world.log->level());
+}
+
+// The worker a thread is running during a parallel update.
+static thread_local size_t update_worker = 0;
+
+static std::string World_to_json(PythonWorld &world, py::object id) {
+  check_world(world);
+  std::ostringstream out;
+  if ( id.ptr() == Py_None ) {
+    world.system->write_json(out);
+  } else {
+    world.system->write_json(out, py::cast<Entity::Id>(id));
+  }
+  return out.str();
+}
+
+static std::shared_ptr<JobFuture> World_submit(PythonWorld &world, const std::string &name,
+                                               py::args args) {
+  check_world(world);
+  return world.jobs->submit(name, args);
+}
+
+static bool World_parallel(const PythonWorld &world) {
+  check_world(world);
+  return world.parallel;
+}
+
+static bool World_tracks_changes(const PythonWorld &world) {
+  return world.system && world.system->tracks_changes();
+}
+
+// Called for every script attribute write while tracking, so a world whose
+// system is gone just ignores it.
+static void World_changed(PythonWorld &world, Entity::Id id) {
+  if ( world.system )
+    world.system->mark_changed(id);
+}
+
+static void World_defer(PythonWorld &world, py::object call) {
+  check_world(world);
+  if ( !world.parallel ) {
+    call();
+    return;
+  }
+  world.deferred[update_worker].push_back(call);
+}
+
 namespace _py_entityx {
 PYBIND11_PLUGIN(_entityx) {
   py::module m("_entityx");
 
-  py::class_<PythonEntityXLogger>(m, "Logger") // no init
-    .def("write", &PythonEntityXLogger::write);
+  py::class_<PythonEntityXLogger, std::shared_ptr<PythonEntityXLogger>>(m, "Logger") // no init
+    .def("write", &Logger_write)
+    .def("flush", release_gil(&PythonEntityXLogger::flush));
+
+  py::class_<ScriptLogger>(m, "ScriptLogger") // no init
+    .def("write", &ScriptLogger_write);
+
+  py::class_<ScriptArchive, std::shared_ptr<ScriptArchive>>(m, "ArchiveImporter") // no init
+    .def_property_readonly("path", &ScriptArchive::path)
+    .def("find_module", &ArchiveImporter_find_module, py::arg("fullname"), py::arg("path") = py::none())
+    .def("load_module", &ArchiveImporter_load_module)
+    .def("find_spec", &ArchiveImporter_find_spec,
+         py::arg("fullname"), py::arg("path") = py::none(), py::arg("target") = py::none())
+    .def("create_module", &ArchiveImporter_create_module)
+    .def("exec_module", &ArchiveImporter_exec_module);
 
   py::class_<Entity>(m, "_Entity")
     .def(py::init<EntityManager*, Entity::Id>())
@@ -122,6 +332,9 @@ PYBIND11_PLUGIN(_entityx) {
     .def_property_readonly("id", &Entity::Id::id)
     .def_property_readonly("index", &Entity::Id::index)
     .def_property_readonly("version", &Entity::Id::version)
+    .def("__eq__", &Entity_Id_eq)
+    .def("__ne__", &Entity_Id_ne)
+    .def("__hash__", &Entity::Id::id)
     .def("__repr__", &Entity_Id_repr);
 
   py::class_<PythonScript>(m, "PythonScript")
@@ -133,6 +346,25 @@ PYBIND11_PLUGIN(_entityx) {
   py::class_<EntityManager>(m, "EntityManager") // no init
     .def("new_entity", &EntityManager_new_entity, py::return_value_policy::copy);
 
+  py::class_<EventManager>(m, "EventManager"); // no init
+
+  py::class_<PythonWorld, std::shared_ptr<PythonWorld>>(m, "World") // no init
+    .def_property_readonly("entity_manager", &World_entity_manager)
+    .def_property_readonly("event_manager", &World_event_manager)
+    .def_property_readonly("log", &World_log)
+    .def_property_readonly("log_level", &World_log_level)
+    .def_property_readonly("parallel", &World_parallel)
+    .def_property_readonly("tracks_changes", &World_tracks_changes)
+    .def("changed", &World_changed)
+    .def("defer", &World_defer)
+    .def("submit", &World_submit)
+    .def("to_json", &World_to_json, py::arg("id") = py::none());
+
+  py::class_<JobFuture, std::shared_ptr<JobFuture>>(m, "Future") // no init
+    .def("done", &JobFuture::done)
+    .def("result", &JobFuture::result)
+    .def("then", &JobFuture::then);
+
   return m.ptr();
 }
 } // namespace _py_entityx
@@ -145,40 +377,120 @@ static void log_to_stdout(const std::string &text) {
   std::cout << "python stdout: " << text << std::endl;
 }
 
-// PythonSystem below here
+/**
+ * Make `world` the world that scripts create new entities in
+ * (`_entityx._world`) for the lifetime of the scope.
+ */
+class WorldScope {
+public:
+  explicit WorldScope(const py::object &world)
+    : module_(py::module::import("_entityx")), changed_(false) {
+    PyObject *current = PyObject_GetAttrString(module_.ptr(), "_world");
+    if ( !current )
+      PyErr_Clear();
+    previous_ = py::reinterpret_steal<py::object>(current);
+    if ( world && current != world.ptr() ) {
+      module_.attr("_world") = world;
+      changed_ = true;
+    }
+  }
 
-bool PythonSystem::initialized_ = false;
+  ~WorldScope() {
+    // Runs while exceptions unwind, so use the C API and swallow failures.
+    if ( !changed_ )
+      return;
+    const int result = previous_
+      ? PyObject_SetAttrString(module_.ptr(), "_world", previous_.ptr())
+      : PyObject_DelAttrString(module_.ptr(), "_world");
+    if ( result != 0 )
+      PyErr_Clear();
+  }
 
-PythonSystem::PythonSystem(EntityManager& entity_manager)
-  : em_(entity_manager), stdout_(log_to_stdout), stderr_(log_to_stderr) {
-  Py_Initialize();
-  if ( !initialized_ ) {
-    initialize_python_module();
-    initialized_ = true;
+private:
+  py::object module_;
+  py::object previous_;
+  bool changed_;
+};
+
+// PythonEventProxy below here
+
+void PythonEventProxy::replay(const char *, size_t) {
+  throw std::runtime_error("event proxy " + handler_name + " cannot replay events");
+}
+
+void PythonEventProxy::send(const py::object &py_event) {
+  PythonHost::Lock lock(*host_);
+  WorldScope scope(world_);
+  // Whatever the handlers emit follows from this event.
+  ReplayRecorder::Running running(recorder_);
+  // Handlers may destroy entities, which removes them from `entities`.
+  std::vector<Entity> receivers(entities);
+  for ( auto entity : receivers ) {
+    send_to(entity, py_event);
+  }
+}
+
+void PythonEventProxy::send_to(Entity entity, const py::object &py_event) {
+  if ( !entity.valid() )
+    return;
+  auto script = entity.component<PythonScript>();
+  if ( !script || !script->object )
+    return;
+  try {
+    script->object.attr(handler_name.c_str())(py_event);
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
   }
 }
 
+// PythonSystem below here
+
+PythonSystem::PythonSystem(EntityManager& entity_manager)
+  : PythonSystem(entity_manager, PythonHost::shared()) {}
+
+PythonSystem::PythonSystem(EntityManager& entity_manager, std::shared_ptr<PythonHost> host)
+  : host_(host), em_(entity_manager), stdout_(log_to_stdout), stderr_(log_to_stderr),
+    log_([this](const LogRecord &record) { log_record(record); }), jobs_(*host),
+    serializer_(entity_manager, components_), tracker_(entity_manager, components_, serializer_),
+    snapshot_(entity_manager, components_, serializer_),
+    persistent_(entity_manager, components_), hasher_(entity_manager, components_, tracker_),
+    world_(std::make_shared<PythonWorld>()), loading_(false), preload_budget_(0),
+    update_threads_(1), frame_(0), frame_dt_(0) {
+  host_->add_module("_entityx", &_py_entityx::pybind11_init);
+  PythonHost::Lock lock(*host_);
+  world_->system = this;
+  world_->entity_manager = &em_;
+  world_->event_manager = nullptr;
+  world_->log = &log_;
+  world_->jobs = &jobs_;
+  world_->parallel = false;
+  py_world_ = py::cast(world_);
+}
+
 
 PythonSystem::~PythonSystem() {
-  // TODO(SMA): Look into cleaning up our module.
-  //try {
-  //  py::object entityx = py::module::import("_entityx");
-  //  entityx.attr("_entity_manager");
-  //  entityx.attr("_event_manager").del();
-  //  py::object sys = py::module::import("sys");
-  //  sys.attr("stdout").del();
-  //  sys.attr("stderr").del();
-  //  py::object gc = py::module::import("gc");
-  //  gc.attr("collect")();
-  //}
-  //catch ( ... ) {
-  //  PyErr_Print();
-  //  PyErr_Clear();
-  //  throw;
-  //}
-  // FIXME: It would be good to do this, but it is not supported by boost::python:
-  // http://www.boost.org/doc/libs/1_53_0/libs/python/todo.html#pyfinalize-safety
-  // Py_Finalize();
+  if ( async_thread_.joinable() ) {
+    async_thread_.join();
+    async_release_.reset();
+  }
+  PythonHost::Lock lock(*host_);
+  try {
+    jobs_.clear();
+    serializer_.clear();
+    teardown();
+  }
+  catch ( const py::error_already_set& e ) {
+    // Destructors must not throw; report and carry on.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+  }
+  // Members are destroyed after the lock is gone.
+  py_world_ = py::object();
 }
 
 void PythonSystem::add_installed_library_path() {
@@ -189,12 +501,176 @@ void PythonSystem::add_path(const std::string &path) {
   python_paths_.push_back(path);
 }
 
-void PythonSystem::initialize_python_module() {
-  _py_entityx::pybind11_init();
+void PythonSystem::add_archive(const std::string &path) {
+  auto archive = std::make_shared<ScriptArchive>(path);
+  PythonHost::Lock lock(*host_);
+  if ( archive->python_magic() != static_cast<uint32_t>(PyImport_GetMagicNumber()) )
+    throw std::runtime_error(path + " was built for a different Python version");
+  try {
+    // Ahead of the path based finders, so archived modules never touch disk.
+    py::object sys = py::module::import("sys");
+    py::object importer = py::cast(archive);
+    sys.attr("meta_path").attr("insert")(0, importer);
+    archives_.push_back(importer);
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+}
+
+PythonSystem::Manifest PythonSystem::read_manifest(const std::string &path) {
+  std::ifstream file(path.c_str());
+  if ( !file )
+    throw std::runtime_error("failed to open manifest " + path);
+  Manifest manifest;
+  std::string line;
+  while ( std::getline(file, line) ) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    std::string module, cls;
+    if ( fields >> module >> cls )
+      manifest.push_back(std::make_pair(module, cls));
+  }
+  return manifest;
+}
+
+void PythonSystem::preload(const Manifest &manifest) {
+  PythonHost::Lock lock(*host_);
+  for ( auto &entry : manifest ) {
+    preload_class(entry.first, entry.second);
+  }
+}
+
+void PythonSystem::preload_async(const Manifest &manifest, double budget) {
+  PythonHost::Lock lock(*host_);
+  preload_queue_.insert(preload_queue_.end(), manifest.begin(), manifest.end());
+  preload_budget_ = budget;
+}
+
+bool PythonSystem::preload_step(double budget) {
+  typedef std::chrono::steady_clock Clock;
+  PythonHost::Lock lock(*host_);
+  const Clock::time_point start = Clock::now();
+  while ( !preload_queue_.empty() ) {
+    const auto entry = preload_queue_.front();
+    preload_queue_.pop_front();
+    preload_class(entry.first, entry.second);
+    if ( std::chrono::duration<double>(Clock::now() - start).count() >= budget )
+      break;
+  }
+  return !preload_queue_.empty();
+}
+
+void PythonSystem::wait_for_preload() {
+  while ( preload_step(std::numeric_limits<double>::infinity()) ) {}
+}
+
+std::vector<PythonSystem::PreloadTiming> PythonSystem::preload_timings() const {
+  std::lock_guard<std::mutex> lock(classes_mutex_);
+  return preload_timings_;
+}
+
+void PythonSystem::preload_class(const std::string &module, const std::string &cls) {
+  typedef std::chrono::steady_clock Clock;
+  PreloadTiming timing = { module, cls, 0.0, true, std::string() };
+  const Clock::time_point start = Clock::now();
+  try {
+    py::object py_cls = py::module::import(module.c_str()).attr(cls.c_str());
+    std::lock_guard<std::mutex> lock(classes_mutex_);
+    classes_[module + ":" + cls] = py_cls;
+  }
+  catch ( const py::error_already_set& e ) {
+    // Report the failure; spawning the class will raise it again.
+    timing.ok = false;
+    timing.error = e.what();
+    PyErr_Clear();
+  }
+  timing.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  std::lock_guard<std::mutex> lock(classes_mutex_);
+  preload_timings_.push_back(timing);
+}
+
+py::object PythonSystem::find_class(const std::string &module, const std::string &cls) {
+  {
+    std::lock_guard<std::mutex> lock(classes_mutex_);
+    auto it = classes_.find(module + ":" + cls);
+    if ( it != classes_.end() )
+      return it->second;
+  }
+  // TODO(SMA): use system.importer and import objects while always "hot reloading" them.
+  // this might be a -little- inefficent, try to measure cost here.
+  py::object importer = py::module::import("entityx.importer");
+  py::object import_f = importer.attr("reload");
+  py::object py_module = import_f(module);
+  py::object py_cls = py_module.attr(cls.c_str());
+  // Loading spawns many scripts of few classes, so keep them like preloaded
+  // ones.
+  if ( loading_ ) {
+    std::lock_guard<std::mutex> lock(classes_mutex_);
+    classes_[module + ":" + cls] = py_cls;
+  }
+  return py_cls;
+}
+
+void PythonSystem::teardown() {
+  flush_logs();
+
+  // Other systems may have been configured since, and may be destroyed
+  // before or after this one, so the host decides what goes back.
+  host_->pop_attrs(this);
+
+  py::object sys = py::module::import("sys");
+  for ( auto &archive : archives_ ) {
+    py::object meta_path = sys.attr("meta_path");
+    if ( py::cast<bool>(meta_path.attr("__contains__")(archive)) )
+      meta_path.attr("remove")(archive);
+  }
+  archives_.clear();
+  for ( auto &path : inserted_paths_ ) {
+    py::object sys_path = sys.attr("path");
+    if ( py::cast<bool>(sys_path.attr("__contains__")(path)) )
+      sys_path.attr("remove")(path);
+  }
+  inserted_paths_.clear();
+
+  // Proxies may outlive the system, e.g. through an add_event_queue() queue,
+  // so drop their Python references while holding the lock.
+  for ( auto &proxy : event_proxies_ ) {
+    proxy->close();
+    proxy->world_ = py::object();
+    proxy->recorder_ = nullptr;
+  }
+  event_proxies_.clear();
+  persistent_.close();
+  recorder_.stop();
+  hasher_.disable();
+  telemetry_.clear();
+  export_.reset();
+  {
+    std::lock_guard<std::mutex> lock(classes_mutex_);
+    classes_.clear();
+  }
+  // Scripts may still hold the world; empty it so that using it raises.
+  world_->system = nullptr;
+  world_->entity_manager = nullptr;
+  world_->event_manager = nullptr;
+  world_->log = nullptr;
+  world_->jobs = nullptr;
+  world_->deferred.clear();
+  host_->collect();
 }
 
 void PythonSystem::configure(EventManager& ev) {
   ev.subscribe<ComponentAddedEvent<PythonScript>>(*this);
+  ev.subscribe<ComponentRemovedEvent<PythonScript>>(*this);
+  ev.subscribe<EntityDestroyedEvent>(*this);
+  for ( auto &subscribe : subscribe_components_ ) {
+    subscribe(ev);
+  }
+  PythonHost::Lock lock(*host_);
 
   try {
     py::object main_module = py::module::import("__main__");
@@ -202,17 +678,22 @@ void PythonSystem::configure(EventManager& ev) {
 
     // Initialize logging.
     py::object sys = py::module::import("sys");
-    sys.attr("stdout") = PythonEntityXLogger(stdout_);
-    sys.attr("stderr") = PythonEntityXLogger(stderr_);
+    stdout_logger_ = std::make_shared<PythonEntityXLogger>(stdout_);
+    stderr_logger_ = std::make_shared<PythonEntityXLogger>(stderr_);
+    host_->push_attr(this, sys, "stdout", py::cast(stdout_logger_));
+    host_->push_attr(this, sys, "stderr", py::cast(stderr_logger_));
 
     // Add paths to interpreter sys.path
     for ( auto path : python_paths_ ) {
       py::str dir(path.c_str());
       sys.attr("path").attr("insert")(0, dir);
+      inserted_paths_.push_back(dir);
     }
 
-    py::object entityx = py::module::import("_entityx");
-    entityx.attr("_entity_manager") = &em_;
+    // Entities created outside of update() and event handlers go into the
+    // most recently configured world.
+    world_->event_manager = &ev;
+    host_->push_attr(this, py::module::import("_entityx"), "_world", py_world_);
   }
   catch ( const py::error_already_set& e ) {
     // TODO(SMA) : Really!? fix this. Should handle execption e better here.
@@ -225,20 +706,637 @@ void PythonSystem::configure(EventManager& ev) {
 
 void PythonSystem::update(EntityManager & em,
                           EventManager & events, TimeDelta dt) {
-  em.each<PythonScript>(
-    [=](Entity entity, PythonScript& python) {
+  log_.flush_suppressed();
+  PythonHost::Lock lock(*host_);
+  WorldScope scope(py_world_);
+  frame_dt_ = dt;
+  ReplayRecorder::Running running(&recorder_);
+  resolve_jobs();
+  deliver_queued_events();
+  if ( update_threads_ > 1 ) {
+    update_parallel(em, dt);
+  } else {
+    em.each<PythonScript>(
+      [=](Entity entity, PythonScript& python) {
+      try {
+        // Access PythonEntity and call Update.
+        python.object.attr("update")(dt);
+      }
+      catch ( const py::error_already_set& e ) {
+        // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        PyErr_Print();
+        PyErr_Clear();
+        throw;
+      }
+    });
+  }
+  end_frame();
+}
+
+void PythonSystem::set_update_threads(size_t threads) {
+  update_threads_ = std::max<size_t>(threads, 1);
+  update_pool_.reset(update_threads_ > 1 ? new ThreadPool(update_threads_) : nullptr);
+}
+
+void PythonSystem::update_parallel(EntityManager &em, TimeDelta dt) {
+  std::vector<py::object> scripts;
+  em.each<PythonScript>([&](Entity entity, PythonScript &python) {
+    scripts.push_back(python.object);
+  });
+  const size_t workers = std::min(update_threads_, scripts.size());
+  if ( workers == 0 )
+    return;
+
+  std::vector<ThreadPool::Task> tasks;
+  for ( size_t worker = 0; worker < workers; ++worker ) {
+    const size_t begin = scripts.size() * worker / workers;
+    const size_t end = scripts.size() * (worker + 1) / workers;
+    tasks.push_back([this, &scripts, worker, begin, end, dt]() {
+      PythonHost::Lock lock(*host_);
+      ReplayRecorder::Running running(&recorder_);
+      update_worker = worker;
+      try {
+        for ( size_t i = begin; i < end; ++i ) {
+          scripts[i].attr("update")(dt);
+        }
+      }
+      catch ( const py::error_already_set& e ) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        PyErr_Print();
+        PyErr_Clear();
+        // The pool hands the exception back to update() as it is.
+        throw;
+      }
+    });
+  }
+
+  world_->deferred.assign(workers, std::vector<py::object>());
+  world_->parallel = true;
+  snapshot_buffers();
+  try {
+    PythonHost::Release release;
+    update_pool_->run(tasks);
+  }
+  catch ( ... ) {
+    world_->parallel = false;
+    world_->deferred.clear();
+    sync_buffers();
+    throw;
+  }
+  world_->parallel = false;
+  // Deferred calls may assign components, so merge and unfreeze the copies.
+  sync_buffers();
+  run_deferred();
+}
+
+void PythonSystem::run_deferred() {
+  // Apply the deferred changes in entity order.
+  std::vector<std::vector<py::object>> deferred;
+  deferred.swap(world_->deferred);
+  try {
+    for ( auto &calls : deferred ) {
+      for ( auto &call : calls ) {
+        call();
+      }
+    }
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+}
+
+void PythonSystem::write_json(std::ostream &out, Entity::Id id) {
+  PythonHost::Lock lock(*host_);
+  JsonWriter json(out);
+  serializer_.write_json(json, id);
+}
+
+void PythonSystem::write_json(std::ostream &out) {
+  PythonHost::Lock lock(*host_);
+  JsonWriter json(out);
+  serializer_.write_json(json);
+}
+
+void PythonSystem::save_snapshot(const std::string &path) {
+  std::string snapshot;
+  {
+    PythonHost::Lock lock(*host_);
     try {
-      // Access PythonEntity and call Update.
-      python.object.attr("update")(dt);
+      snapshot_.save(snapshot, tracker_.frame());
+    }
+    catch ( const py::error_already_set& e ) {
+      PyErr_SetString(PyExc_RuntimeError, e.what());
+      PyErr_Print();
+      PyErr_Clear();
+      throw;
+    }
+  }
+  replace_file(path, snapshot.data(), snapshot.size());
+}
+
+std::vector<Entity::Id> PythonSystem::load_snapshot(const std::string &path) {
+  MappedFile file;
+  file.open_readonly(path);
+  PythonHost::Lock lock(*host_);
+  try {
+    return snapshot_.restore(file.data(), file.size());
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+}
+
+LoadTiming PythonSystem::load_level(const std::string &path, std::vector<Entity::Id> *ids) {
+  typedef std::chrono::steady_clock Clock;
+  MappedFile file;
+  file.open_readonly(path);
+  LoadTiming timing;
+  PythonHost::Lock lock(*host_);
+  loading_ = true;
+  try {
+    std::vector<Entity::Id> spawned;
+    if ( SnapshotWriter::is_snapshot(file.data(), file.size()) ) {
+      spawned = snapshot_.restore(file.data(), file.size(), &timing);
+    } else {
+      const Clock::time_point start = Clock::now();
+      std::string level;
+      py::list scripts = level_to_snapshot(components_, file.data(), file.size(), level);
+      timing.parse = std::chrono::duration<double>(Clock::now() - start).count();
+      spawned = snapshot_.restore(level.data(), level.size(), scripts, &timing);
+    }
+    loading_ = false;
+    if ( ids )
+      ids->swap(spawned);
+  }
+  catch ( const py::error_already_set& e ) {
+    loading_ = false;
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+  catch ( ... ) {
+    loading_ = false;
+    throw;
+  }
+  return timing;
+}
+
+std::vector<Entity::Id> PythonSystem::persist(const std::string &path,
+                                              const std::vector<std::string> &components,
+                                              size_t capacity) {
+  PythonHost::Lock lock(*host_);
+  loading_ = true;
+  try {
+    std::vector<Entity::Id> ids;
+    if ( persistent_.open(path, components, capacity) ) {
+      WorldScope scope(py_world_);
+      ids = persistent_.reopen([this](Entity::Id id, const std::string &module,
+                                      const std::string &cls) {
+        PythonScript script(module, cls);
+        script.object = find_class(module, cls).attr("_rebind")(em_.get(id), py_world_);
+        em_.assign<PythonScript>(id, script);
+      });
+    }
+    loading_ = false;
+    persistent_.sync();
+    return ids;
+  }
+  catch ( const py::error_already_set& e ) {
+    loading_ = false;
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+  catch ( ... ) {
+    loading_ = false;
+    throw;
+  }
+}
+
+void PythonSystem::hash_frames(const std::string &path,
+                               const std::vector<std::string> &attributes) {
+  PythonHost::Lock lock(*host_);
+  hasher_.enable(path, attributes);
+}
+
+void PythonSystem::stop_hashing() {
+  PythonHost::Lock lock(*host_);
+  hasher_.disable();
+}
+
+void PythonSystem::sample_fields(const std::string &path, const std::string &component,
+                                 const std::vector<std::string> &fields, size_t every,
+                                 size_t capacity, size_t slots) {
+  const ComponentInfo *info = components_.find(component);
+  if ( !info )
+    throw std::runtime_error("sampled component " + component + " is not registered");
+  telemetry_.emplace_back(new TelemetryStream(em_, *info, fields, path, every, capacity, slots));
+}
+
+void PythonSystem::stop_sampling() {
+  telemetry_.clear();
+}
+
+void PythonSystem::export_components(const std::string &path,
+                                     const std::vector<std::string> &components,
+                                     size_t capacity) {
+  std::vector<const ComponentInfo *> exported;
+  for ( auto &name : components ) {
+    const ComponentInfo *info = components_.find(name);
+    if ( !info )
+      throw std::runtime_error("exported component " + name + " is not registered");
+    exported.push_back(info);
+  }
+  // First, as it removes its file, which may be at the same path.
+  export_.reset();
+  export_.reset(new ComponentExport(em_, exported, path, capacity));
+}
+
+void PythonSystem::stop_export() {
+  export_.reset();
+}
+
+void PythonSystem::record(const std::string &path) {
+  PythonHost::Lock lock(*host_);
+  std::string snapshot;
+  try {
+    snapshot_.save(snapshot, frame_);
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+  recorder_.start(path, snapshot, serializer_.entities());
+}
+
+void PythonSystem::stop_recording() {
+  PythonHost::Lock lock(*host_);
+  recorder_.stop();
+}
+
+void PythonSystem::record_spawn(Entity::Id id, const PythonScript &script) {
+  py::object pickled = pickle_module().attr("dumps")(script.args, 2);
+  char *data = nullptr;
+  Py_ssize_t size = 0;
+  if ( PyBytes_AsStringAndSize(pickled.ptr(), &data, &size) != 0 )
+    throw py::error_already_set();
+  // Components assigned before the script go with it, so the replayed
+  // script finds them when it is constructed.
+  if ( !recorder_.known(id) ) {
+    recorder_.create(id);
+    for ( auto &component : components_.components() ) {
+      const void *value = component->get(em_, id);
+      if ( value )
+        recorder_.component(id, component->name(), value, component->size());
+    }
+  }
+  recorder_.spawn(id, script.module, script.cls, data, static_cast<size_t>(size));
+}
+
+void PythonSystem::replay_spawn(EntityManager &entities, Entity::Id id,
+                                const ReplayReader::Record &record) {
+  PythonHost::Lock lock(*host_);
+  try {
+    py::object args = serializer_.unpickle(record.data, record.size);
+    if ( !PyList_Check(args.ptr()) )
+      throw std::runtime_error("malformed replay log: spawn args must be a list");
+    PythonScript script(record.module, record.cls);
+    script.args = py::reinterpret_borrow<py::list>(args.ptr());
+    entities.assign<PythonScript>(id, script);
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+}
+
+uint64_t PythonSystem::replay(const std::string &path, EntityManager &entities,
+                              EventManager &events, std::function<void(uint64_t)> before_update) {
+  ReplayReader reader(path);
+  // The local entity of every entity the log numbers.
+  std::vector<Entity::Id> numbered;
+  {
+    PythonHost::Lock lock(*host_);
+    try {
+      numbered = snapshot_.restore(reader.snapshot(), reader.snapshot_size());
     }
     catch ( const py::error_already_set& e ) {
-      // TODO(SMA) : Really!? fix this. Should handle execption e better here.
       PyErr_SetString(PyExc_RuntimeError, e.what());
       PyErr_Print();
       PyErr_Clear();
       throw;
     }
+  }
+  auto entity = [&](const ReplayReader::Record &record) {
+    if ( record.entity >= numbered.size() || !entities.valid(numbered[record.entity]) )
+      throw std::runtime_error("replay log names entity " + std::to_string(record.entity) +
+                               " which does not exist");
+    return numbered[record.entity];
+  };
+  auto component = [&](const ReplayReader::Record &record) {
+    const ComponentInfo *info = components_.find(record.name);
+    if ( !info )
+      throw std::runtime_error("replay log component " + record.name + " is not registered");
+    return info;
+  };
+  uint64_t frames = 0;
+  ReplayReader::Record record;
+  while ( reader.next(record) ) {
+    switch ( record.kind ) {
+      case ReplayRecord::Update:
+        if ( before_update )
+          before_update(frame_ + 1);
+        update(entities, events, record.dt);
+        ++frames;
+        break;
+      case ReplayRecord::Spawn:
+        replay_spawn(entities, entity(record), record);
+        break;
+      case ReplayRecord::Create:
+        numbered.push_back(entities.create().id());
+        break;
+      case ReplayRecord::Component: {
+        const ComponentInfo *info = component(record);
+        if ( info->size() != record.size )
+          throw std::runtime_error("replay log component " + record.name +
+                                   " has a different size");
+        std::memcpy(info->assign(entities, entity(record)), record.data, record.size);
+        break;
+      }
+      case ReplayRecord::Remove:
+        component(record)->remove(entities, entity(record));
+        break;
+      case ReplayRecord::Destroy:
+        entities.destroy(entity(record));
+        break;
+      case ReplayRecord::Event:
+      case ReplayRecord::QueuedEvent:
+        if ( record.proxy >= event_proxies_.size() )
+          throw std::runtime_error("replay log names event proxy " +
+                                   std::to_string(record.proxy) + " which is not registered");
+        event_proxies_[record.proxy]->replay(record.data, record.size);
+        break;
+    }
+  }
+  return frames;
+}
+
+void PythonSystem::track_changes(size_t history, bool scan) {
+  tracker_.enable(history, scan);
+  PythonHost::Lock lock(*host_);
+  try {
+    // Scripts report their attribute writes once the entityx package knows
+    // a world tracks changes. If it is not imported yet, Entity.__new__
+    // finds out later.
+    py::object modules = py::module::import("sys").attr("modules");
+    if ( PyDict_GetItemString(modules.ptr(), "entityx") )
+      py::module::import("entityx").attr("_track_changes")();
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+}
+
+void PythonSystem::snapshot(std::string &out) {
+  PythonHost::Lock lock(*host_);
+  try {
+    snapshot_.save(out, tracker_.frame());
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+}
+
+void PythonSystem::delta_snapshot(std::string &out, uint64_t since) {
+  if ( !tracker_.enabled() )
+    throw std::runtime_error("delta_snapshot() requires track_changes()");
+  PythonHost::Lock lock(*host_);
+  try {
+    snapshot_.save_delta(out, tracker_, since);
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+}
+
+std::vector<Entity::Id> PythonSystem::apply_snapshot(const char *data, size_t size,
+                                                     SnapshotEntities &entities) {
+  PythonHost::Lock lock(*host_);
+  try {
+    return snapshot_.apply(data, size, entities);
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+}
+
+void PythonSystem::enable_rollback(size_t frames) {
+  PythonHost::Lock lock(*host_);
+  rollback_ = SnapshotRing(frames != 0 ? frames + 1 : 0);
+  rollback_entities_.clear();
+  if ( frames == 0 )
+    return;
+  try {
+    snapshot_.save(rollback_.push(frame_, 0).data, frame_);
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+}
+
+void PythonSystem::rollback(uint64_t frame) {
+  const SnapshotRing::Entry *entry = rollback_.find(frame);
+  if ( !entry )
+    throw std::runtime_error("frame " + std::to_string(frame) + " is not kept for rollback");
+  PythonHost::Lock lock(*host_);
+  try {
+    snapshot_.rewind(entry->data.data(), entry->data.size(), rollback_entities_);
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+  frame_ = frame;
+  rollback_.truncate(frame);
+}
+
+void PythonSystem::resimulate(uint64_t frame, EntityManager &entities, EventManager &events,
+                              std::function<void(uint64_t)> before_update) {
+  std::vector<TimeDelta> dts;
+  for ( uint64_t replayed = frame + 1; replayed <= frame_; ++replayed ) {
+    const SnapshotRing::Entry *entry = rollback_.find(replayed);
+    if ( !entry )
+      throw std::runtime_error("frame " + std::to_string(replayed) + " is not kept for rollback");
+    dts.push_back(entry->dt);
+  }
+  rollback(frame);
+  for ( size_t i = 0; i < dts.size(); ++i ) {
+    if ( before_update )
+      before_update(frame + 1 + i);
+    update(entities, events, dts[i]);
+  }
+}
+
+void PythonSystem::set_job_pool(std::shared_ptr<JobPool> pool) {
+  jobs_.set_pool(pool);
+}
+
+void PythonSystem::resolve_jobs() {
+  try {
+    jobs_.resolve();
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+}
+
+void PythonSystem::deliver_queued_events() {
+  for ( auto &proxy : event_proxies_ ) {
+    proxy->deliver();
+  }
+}
+
+void PythonSystem::snapshot_buffers() {
+  for ( auto &buffer : buffers_ ) {
+    buffer->snapshot();
+  }
+}
+
+void PythonSystem::sync_buffers() {
+  for ( auto &buffer : buffers_ ) {
+    buffer->sync();
+  }
+}
+
+void PythonSystem::end_frame() {
+  sync_buffers();
+  ++frame_;
+  recorder_.end_frame(frame_dt_);
+  try {
+    if ( tracker_.enabled() )
+      tracker_.commit(frame_);
+    if ( rollback_.size() != 0 )
+      snapshot_.save(rollback_.push(frame_, frame_dt_).data, frame_);
+    if ( persistent_.is_open() )
+      persistent_.sync();
+    if ( hasher_.enabled() )
+      hasher_.commit(frame_);
+    for ( auto &stream : telemetry_ )
+      stream->end_frame(frame_);
+    if ( export_ )
+      export_->publish(frame_);
+    // Scripts have run, so imports no longer delay them.
+    if ( !preload_queue_.empty() && preload_budget_ > 0 )
+      preload_step(preload_budget_);
+  }
+  catch ( const py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    throw;
+  }
+}
+
+void PythonSystem::start_update(EntityManager &em, EventManager &events, TimeDelta dt) {
+  if ( async_thread_.joinable() )
+    throw std::runtime_error("start_update() called twice without finish_update()");
+  log_.flush_suppressed();
+  // Shared rather than copied into the thread, as copying Python objects
+  // needs the lock.
+  auto scripts = std::make_shared<std::vector<py::object>>();
+  {
+    PythonHost::Lock lock(*host_);
+    ReplayRecorder::Running running(&recorder_);
+    {
+      WorldScope scope(py_world_);
+      resolve_jobs();
+      deliver_queued_events();
+    }
+    em.each<PythonScript>([&](Entity entity, PythonScript &python) {
+      scripts->push_back(python.object);
+    });
+    world_->deferred.assign(1, std::vector<py::object>());
+    world_->parallel = true;
+    frame_dt_ = dt;
+  }
+  // Copy the components here, as C++ systems may change them meanwhile.
+  snapshot_buffers();
+  async_error_ = nullptr;
+  async_thread_ = std::thread([this, scripts, dt]() {
+    PythonHost::Lock lock(*host_);
+    WorldScope scope(py_world_);
+    // C++ on other threads meanwhile is still recorded.
+    ReplayRecorder::Running running(&recorder_);
+    update_worker = 0;
+    try {
+      for ( auto &script : *scripts ) {
+        script.attr("update")(dt);
+      }
+    }
+    catch ( const py::error_already_set& e ) {
+      PyErr_SetString(PyExc_RuntimeError, e.what());
+      PyErr_Print();
+      PyErr_Clear();
+      async_error_ = std::make_exception_ptr(std::runtime_error(e.what()));
+    }
+    catch ( ... ) {
+      async_error_ = std::current_exception();
+    }
+    // Drop the references while holding the lock.
+    scripts->clear();
   });
+  async_release_.reset(new PythonHost::Release());
+}
+
+void PythonSystem::finish_update() {
+  if ( !async_thread_.joinable() )
+    return;
+  async_thread_.join();
+  async_release_.reset();
+  PythonHost::Lock lock(*host_);
+  ReplayRecorder::Running running(&recorder_);
+  world_->parallel = false;
+  // Deferred calls may assign components, so merge and unfreeze the copies.
+  sync_buffers();
+  if ( async_error_ ) {
+    world_->deferred.clear();
+    std::rethrow_exception(async_error_);
+  }
+  run_deferred();
+  end_frame();
 }
 
 void PythonSystem::log_to(LoggerFunction sout, LoggerFunction serr) {
@@ -246,17 +1344,68 @@ void PythonSystem::log_to(LoggerFunction sout, LoggerFunction serr) {
   stderr_ = serr;
 }
 
+void PythonSystem::log_to(std::shared_ptr<BinaryLogSink> sink) {
+  // Stream output is not tied to an entity.
+  log_to([sink](const std::string &line) {
+           sink->write(LogLevel::Info, Entity::INVALID, line.data(), line.size());
+         },
+         [sink](const std::string &line) {
+           sink->write(LogLevel::Error, Entity::INVALID, line.data(), line.size());
+         });
+  log_records_to([sink](const LogRecord &record) { sink->write(record); });
+}
+
+void PythonSystem::log_records_to(RecordFunction records) {
+  log_.set_records(records);
+}
+
+void PythonSystem::set_log_level(LogLevel level) {
+  log_.set_level(level);
+}
+
+void PythonSystem::set_log_rate_limit(size_t burst, TimeDelta interval) {
+  log_.set_rate_limit(burst, interval);
+}
+
+void PythonSystem::log_record(const LogRecord &record) {
+  std::stringstream line;
+  line << "[" << log_level_name(record.level) << "] " << record.cls << " "
+       << record.entity.index() << "." << record.entity.version() << ": " << record.message;
+  const std::string text = line.str();
+  if ( record.level >= LogLevel::Warning ) {
+    if ( stderr_logger_ ) {
+      stderr_logger_->write(text + "\n");
+    } else {
+      stderr_(text);
+    }
+  } else {
+    if ( stdout_logger_ ) {
+      stdout_logger_->write(text + "\n");
+    } else {
+      stdout_(text);
+    }
+  }
+}
+
+void PythonSystem::flush_logs() {
+  log_.flush_suppressed(true);
+  if ( stdout_logger_ )
+    stdout_logger_->flush();
+  if ( stderr_logger_ )
+    stderr_logger_->flush();
+}
+
 void PythonSystem::receive(const ComponentAddedEvent<PythonScript> &event) {
+  tracker_.mark(event.entity.id());
+  PythonHost::Lock lock(*host_);
   // If the component was created in C++ it won't have a Python object
   // associated with it. Create one.
   if ( !event.component->object ) {
     try {
-      // TODO(SMA): use system.importer and import objects while always "hot reloading" them.
-      // this might be a -little- inefficent, try to measure cost here.
-      py::object importer = py::module::import("entityx.importer");
-      py::object import_f = importer.attr("reload");
-      py::object module = import_f(event.component->module);
-      py::object cls = module.attr(event.component->cls.c_str());
+      if ( !loading_ && recorder_.external() )
+        record_spawn(event.entity.id(), *event.component);
+      WorldScope scope(py_world_);
+      py::object cls = find_class(event.component->module, event.component->cls);
       py::object from_raw_entity = cls.attr("_from_raw_entity");
       py::list args;
       if ( py::len(event.component->args) != 0 ) {
@@ -264,6 +1413,7 @@ void PythonSystem::receive(const ComponentAddedEvent<PythonScript> &event) {
       }
       py::kwargs kwargs;
       kwargs["entity"] = Entity(event.entity);
+      kwargs["world"] = py_world_;
       // Access PythonEntity and call Update.
       ComponentHandle<PythonScript> scripthandle = event.component;
       scripthandle->object = from_raw_entity.operator()<py::return_value_policy::reference_internal>(*args, **kwargs);
@@ -275,6 +1425,64 @@ void PythonSystem::receive(const ComponentAddedEvent<PythonScript> &event) {
       throw;
     }
   }
+
+  for ( auto proxy : event_proxies_ ) {
+    if ( proxy->can_send(event.component->object) ) {
+      proxy->add_receiver(event.entity);
+    }
+  }
+}
+
+void PythonSystem::receive(const ComponentRemovedEvent<PythonScript> &event) {
+  tracker_.mark(event.entity.id());
+  PythonHost::Lock lock(*host_);
+  for ( auto proxy : event_proxies_ ) {
+    proxy->delete_receiver(event.entity);
+  }
+}
+
+void PythonSystem::receive(const EntityDestroyedEvent &event) {
+  if ( !recorder_.recording() )
+    return;
+  PythonHost::Lock lock(*host_);
+  if ( recorder_.external() )
+    recorder_.destroy(event.entity.id());
+  else
+    recorder_.forget(event.entity.id());
+}
+
+void PythonSystem::component_added(size_t component, Entity::Id id, const void *data) {
+  tracker_.added(component, id, data);
+  if ( !recorder_.recording() )
+    return;
+  PythonHost::Lock lock(*host_);
+  if ( recorder_.external() && recorder_.known(id) ) {
+    const ComponentInfo &info = *components_.components()[component];
+    recorder_.component(id, info.name(), data, info.size());
+  }
+}
+
+void PythonSystem::component_removed(size_t component, Entity::Id id, const void *data) {
+  tracker_.removed(component, id, data);
+  if ( !recorder_.recording() )
+    return;
+  PythonHost::Lock lock(*host_);
+  if ( recorder_.external() && recorder_.known(id) )
+    recorder_.remove(id, components_.components()[component]->name());
+}
+
+void PythonSystem::add_proxy(std::shared_ptr<PythonEventProxy> proxy) {
+  PythonHost::Lock lock(*host_);
+  proxy->world_ = py_world_;
+  proxy->host_ = host_;
+  proxy->recorder_ = &recorder_;
+  proxy->index_ = static_cast<uint32_t>(event_proxies_.size());
+  em_.each<PythonScript>([&](Entity entity, PythonScript &script) {
+    if ( script.object && proxy->can_send(script.object) ) {
+      proxy->add_receiver(entity);
+    }
+  });
+  event_proxies_.push_back(proxy);
 }
 
 }  // namespace python
@@ -12,12 +12,40 @@
 
  // http://docs.python.org/2/extending/extending.html
 #include <pybind11/pybind11.h>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <string>
 #include "entityx/System.h"
 #include "entityx/Entity.h"
 #include "entityx/Event.h"
+#include "entityx/python/BinaryLogSink.h"
+#include "entityx/python/ChangeTracker.h"
+#include "entityx/python/ComponentBuffer.hpp"
+#include "entityx/python/ComponentExport.h"
+#include "entityx/python/ComponentRegistry.hpp"
+#include "entityx/python/EventQueue.hpp"
+#include "entityx/python/PythonHost.h"
+#include "entityx/python/PythonLogger.h"
+#include "entityx/python/PersistentStore.h"
+#include "entityx/python/PythonScript.hpp"
+#include "entityx/python/ReplayLog.h"
+#include "entityx/python/ScriptJobs.h"
+#include "entityx/python/SnapshotRing.hpp"
+#include "entityx/python/TelemetryStream.h"
+#include "entityx/python/ThreadPool.h"
+#include "entityx/python/WorldHasher.h"
+#include "entityx/python/WorldSerializer.h"
+#include "entityx/python/WorldSnapshot.h"
 
 namespace py = pybind11;
 
@@ -25,7 +53,270 @@ namespace entityx {
 namespace python {
 
 class PythonSystem;
-struct PythonScript;
+
+/**
+ * The managers a PythonSystem exposes to its scripts, bound to Python as
+ * `_entityx.World`. Every script object keeps the world it was created in as
+ * `self._world`, so several EntityManagers can be scripted from one
+ * interpreter without sharing state.
+ *
+ * Scripts share ownership of the world. Once its PythonSystem is destroyed
+ * the members are null and using the world from Python raises RuntimeError.
+ */
+struct PythonWorld {
+  PythonSystem *system;
+  EntityManager *entity_manager;
+  EventManager *event_manager;
+  ScriptLogger *log;
+  ScriptJobs *jobs;
+  /// True while update() runs scripts on several threads.
+  std::atomic<bool> parallel;
+  /// Calls deferred by each worker during a parallel update, run in worker
+  /// order once every worker is done.
+  std::vector<std::vector<py::object>> deferred;
+};
+
+/**
+ * How a PythonEventProxy hands a C++ event to Python.
+ */
+enum class EventConversion {
+  /// Copy the event into a new Python object. Handlers may keep it.
+  Copy,
+  /// Wrap the C++ event in place without copying. The Python object borrows
+  /// the event and is only valid while the handlers run; handlers must not
+  /// store it. Expose the event fields with def_readonly.
+  View
+};
+
+/**
+ * An entityx::Receiver that proxies events to Python entities.
+ *
+ * Subclass this and entityx::Receiver<Derived> to filter which entities an
+ * event is delivered to. Take a PythonHost::Lock on host(), then convert the
+ * event with to_python() once per emit and pass the result to send() or
+ * send_to(), so that every handler shares the same Python object.
+ */
+class PythonEventProxy {
+public:
+  /**
+   * @param handler_name The default implementation of can_send() tests for
+   * the existence of this attribute on an Entity.
+   * @param conversion Whether events are copied into Python or viewed.
+   */
+  explicit PythonEventProxy(const std::string &handler_name,
+                            EventConversion conversion = EventConversion::Copy)
+    : handler_name(handler_name), conversion(conversion), recorder_(nullptr), index_(0) {}
+  virtual ~PythonEventProxy() {}
+
+  /**
+   * Return true if this event proxy can deliver events to the given Python
+   * entity.
+   */
+  virtual bool can_send(const py::object &object) const {
+    return PyObject_HasAttrString(object.ptr(), handler_name.c_str()) == 1;
+  }
+
+protected:
+  friend class PythonSystem;
+
+  /// The host of the PythonSystem the proxy was added to.
+  PythonHost &host() const {
+    return *host_;
+  }
+
+  /**
+   * Convert an event to Python according to the proxy's EventConversion.
+   */
+  template <typename Event>
+  py::object to_python(const Event &event) const {
+    if ( conversion == EventConversion::View ) {
+      return py::cast(&event, py::return_value_policy::reference);
+    }
+    return py::cast(event, py::return_value_policy::copy);
+  }
+
+  /**
+   * Called by PythonSystem::update() with the lock held, before any script
+   * updates. Proxies fed from other threads deliver their events here.
+   */
+  virtual void deliver() {}
+
+  /**
+   * Called when the PythonSystem is destroyed, with the lock held. Proxies
+   * fed from other threads stop accepting events here.
+   */
+  virtual void close() {}
+
+  /**
+   * Deliver an event read back from a replay log, see
+   * PythonSystem::replay(). The default cannot replay.
+   */
+  virtual void replay(const char *data, size_t size);
+
+  /**
+   * Record an event about to be delivered if the system is recording and
+   * the event comes from outside the scripts, see ReplayRecorder. Queued
+   * events are recorded as they are taken, during an update. Requires the
+   * lock.
+   */
+  template <typename Event>
+  void record(const Event &event, bool queued = false) {
+    if ( !recorder_ || !(queued ? recorder_->recording() : recorder_->external()) )
+      return;
+    record(event, queued, std::integral_constant<bool, is_replayable<Event>::value>());
+  }
+
+  /// Pass the event in a replayed record to `consume(const Event&)`.
+  template <typename Event, typename Consumer>
+  static void replayed(const char *data, size_t size, Consumer consume) {
+    replayed<Event>(data, size, consume,
+                    std::integral_constant<bool, is_replayable<Event>::value>());
+  }
+
+  /**
+   * Deliver an already converted event to every receiver.
+   */
+  void send(const py::object &py_event);
+
+  /**
+   * Deliver an already converted event to a single receiver.
+   */
+  void send_to(Entity entity, const py::object &py_event);
+
+  const std::string handler_name;
+  const EventConversion conversion;
+  std::vector<Entity> entities;
+
+private:
+  template <typename Event>
+  void record(const Event &event, bool queued, std::true_type) {
+    std::string data;
+    ReplayWriter out(data);
+    ReplayEvent<Event>::save(event, out);
+    recorder_->event(queued ? ReplayRecord::QueuedEvent : ReplayRecord::Event, index_,
+                     data.data(), data.size());
+  }
+
+  template <typename Event>
+  void record(const Event &, bool, std::false_type) {
+    recorder_->skip();
+  }
+
+  template <typename Event, typename Consumer>
+  static void replayed(const char *data, size_t size, Consumer consume, std::true_type) {
+    ReplayFields in(data, size);
+    const Event event = ReplayEvent<Event>::load(in);
+    in.finish();
+    consume(event);
+  }
+
+  template <typename Event, typename Consumer>
+  static void replayed(const char *, size_t, Consumer, std::false_type) {
+    throw std::runtime_error("only events with a ReplayEvent specialization can be replayed");
+  }
+
+  // The _entityx.World of the PythonSystem the proxy was added to. Entities
+  // created by handlers go into this world.
+  py::object world_;
+  std::shared_ptr<PythonHost> host_;
+  ReplayRecorder *recorder_;
+  // Position among the system's proxies, naming the proxy in replay logs.
+  uint32_t index_;
+
+  /**
+   * Add an Entity receiver to this proxy. This is called automatically by
+   * PythonSystem.
+   */
+  void add_receiver(Entity entity) {
+    entities.push_back(entity);
+  }
+
+  /**
+   * Delete an Entity receiver. This is called automatically by PythonSystem
+   * when the PythonScript component is removed from the entity.
+   */
+  void delete_receiver(Entity entity) {
+    for ( auto i = entities.begin(); i != entities.end(); ++i ) {
+      if ( entity == *i ) {
+        entities.erase(i);
+        break;
+      }
+    }
+  }
+};
+
+/**
+ * A PythonEventProxy that broadcasts events to all entities with a matching
+ * handler method.
+ */
+template <typename Event>
+struct BroadcastPythonEventProxy : public PythonEventProxy,
+                                   public Receiver<BroadcastPythonEventProxy<Event>> {
+  explicit BroadcastPythonEventProxy(const std::string &handler_name,
+                                     EventConversion conversion = EventConversion::Copy)
+    : PythonEventProxy(handler_name, conversion) {}
+  virtual ~BroadcastPythonEventProxy() {}
+
+  void receive(const Event &event) {
+    if ( entities.empty() )
+      return;
+    PythonHost::Lock lock(host());
+    record(event);
+    send(to_python(event));
+  }
+
+protected:
+  void replay(const char *data, size_t size) override {
+    replayed<Event>(data, size, [this](const Event &event) { receive(event); });
+  }
+};
+
+/**
+ * A PythonEventProxy fed from other threads through an EventQueue rather
+ * than by an EventManager. Each update() passes the events queued since the
+ * previous one to the handlers as a single list.
+ */
+template <typename Event>
+class QueuedPythonEventProxy : public PythonEventProxy {
+public:
+  explicit QueuedPythonEventProxy(const std::string &handler_name,
+                                  EventConversion conversion = EventConversion::Copy)
+    : PythonEventProxy(handler_name, conversion) {}
+  virtual ~QueuedPythonEventProxy() {}
+
+  EventQueue<Event> &queue() {
+    return queue_;
+  }
+
+protected:
+  void deliver() override {
+    std::vector<Event> events;
+    queue_.drain([&events](Event &&event) { events.push_back(std::move(event)); });
+    if ( events.empty() )
+      return;
+    if ( entities.empty() ) {
+      queue_.drop(events.size());
+      return;
+    }
+    py::list batch;
+    for ( const auto &event : events ) {
+      record(event, true);
+      batch.append(to_python(event));
+    }
+    send(batch);
+  }
+
+  void close() override {
+    queue_.close();
+  }
+
+  void replay(const char *data, size_t size) override {
+    replayed<Event>(data, size, [this](const Event &event) { queue_.push(event); });
+  }
+
+private:
+  EventQueue<Event> queue_;
+};
 
 /**
  * A helper function for class_ to assign a component to an entity.
@@ -41,12 +332,78 @@ void assign_to(Component& component, EntityManager& entity_manager, Entity::Id i
  */
 template <typename Component>
 static Component* get_component(EntityManager& em, Entity::Id id) {
+  if ( ComponentBuffer<Component> *buffer = ComponentBuffer<Component>::find(em) )
+    return buffer->get(id);
   auto handle = em.component<Component>(id);
   if ( !handle )
     return NULL;
   return handle.get();
 }
 
+/**
+ * Bind `member` as a read/write property of `cls`, like def_readwrite, whose
+ * setter tells change tracking about the write, see ChangeTracker:
+ *
+ *   py::class_<Position> position(m, "Position");
+ *   def_tracked(position, "x", &Position::x);
+ */
+template <typename Class, typename Component, typename T>
+void def_tracked(Class &cls, const char *name, T Component::*member) {
+  cls.def_property(name,
+                   py::cpp_function([member](const Component &component) {
+                     return component.*member;
+                   }),
+                   py::cpp_function([member](Component &component, const T &value) {
+                     component.*member = value;
+                     mark_written(&component);
+                   }));
+}
+
+/**
+ * A helper function for class_ to emit an event from Python.
+ */
+template <typename Event>
+void emit(const Event &event, EventManager &event_manager) {
+  event_manager.emit<Event>(event);
+}
+
+/**
+ * A function that runs without the GIL, see release_gil().
+ */
+template <typename Return, typename... Args>
+struct GilReleased {
+  std::function<Return(Args...)> function;
+
+  Return operator()(Args... args) const {
+    PythonHost::Release release;
+    return function(std::forward<Args>(args)...);
+  }
+};
+
+/**
+ * Wrap a long-running C++ function for class_::def() so that other threads
+ * can run Python while it works:
+ *
+ *   .def("find_path", release_gil(&NavMesh::find_path))
+ *
+ * Arguments are converted before and the result after the GIL is released,
+ * so only the function itself must not touch Python objects.
+ */
+template <typename Return, typename... Args>
+GilReleased<Return, Args...> release_gil(Return (*function)(Args...)) {
+  return GilReleased<Return, Args...>{function};
+}
+
+template <typename Return, typename Class, typename... Args>
+GilReleased<Return, Class&, Args...> release_gil(Return (Class::*method)(Args...)) {
+  return GilReleased<Return, Class&, Args...>{std::mem_fn(method)};
+}
+
+template <typename Return, typename Class, typename... Args>
+GilReleased<Return, const Class&, Args...> release_gil(Return (Class::*method)(Args...) const) {
+  return GilReleased<Return, const Class&, Args...>{std::mem_fn(method)};
+}
+
 /**
  * An entityx::System that bridges EntityX and Python.
  *
@@ -58,11 +415,45 @@ static Component* get_component(EntityManager& em, Entity::Id id) {
  */
 class PythonSystem : public entityx::System<PythonSystem>, public entityx::Receiver<PythonSystem> {
 public:
-  typedef std::function<void(const std::string &)> LoggerFunction;
+  typedef PythonEntityXLogger::LoggerFunction LoggerFunction;
+  typedef ScriptLogger::RecordFunction RecordFunction;
+  /// (module, class) pairs to import ahead of time.
+  typedef std::vector<std::pair<std::string, std::string>> Manifest;
 
+  /// How long preloading one manifest entry took.
+  struct PreloadTiming {
+    std::string module;
+    std::string cls;
+    /// Import and class lookup time. Modules are only imported for their
+    /// first class, so later classes of the same module are cheap.
+    double seconds;
+    bool ok;
+    std::string error;
+  };
+
+  /// Use the process-wide PythonHost::shared() interpreter.
   PythonSystem(EntityManager& entity_manager);  // NOLINT
+  /**
+   * Run scripts in `host`. Methods that touch Python take the host's Lock,
+   * so a system can be driven from any thread.
+   */
+  PythonSystem(EntityManager& entity_manager, std::shared_ptr<PythonHost> host);
+  /**
+   * Undo configure(): restore sys.stdout, sys.stderr and the current
+   * _entityx world, remove this system's sys.path entries and archives, and collect
+   * garbage. The interpreter itself belongs to the PythonHost.
+   */
   virtual ~PythonSystem();
 
+  const std::shared_ptr<PythonHost> &host() const {
+    return host_;
+  }
+
+  /// The `_entityx.World` scripts of this system are bound to.
+  const py::object &world() const {
+    return py_world_;
+  }
+
   /**
    * Add system-installed entityx Python path to the interpreter.
    */
@@ -83,28 +474,508 @@ public:
     }
   }
 
+  /**
+   * Serve the modules in a script archive built by tools/bundle.py. The
+   * archive is memory-mapped and takes precedence over sys.path. Throws
+   * std::runtime_error if the archive was built by another Python version.
+   */
+  void add_archive(const std::string &path);
+
+  /**
+   * Read a manifest file with one "module Class" pair per line. Text after
+   * '#' is ignored.
+   */
+  static Manifest read_manifest(const std::string &path);
+
+  /**
+   * Import and resolve the classes in `manifest` now, so that spawning them
+   * later does not pay for the import. Preloaded classes are reused by every
+   * spawn instead of being hot reloaded. Call after configure().
+   */
+  void preload(const Manifest &manifest);
+
+  /**
+   * Like preload(), but spread over frames: the classes are queued, and
+   * every update() ends by importing queued classes for up to `budget`
+   * seconds, after the scripts have run. At least one class is imported per
+   * frame, however long it takes. With a budget of 0, classes are only
+   * imported by preload_step().
+   */
+  void preload_async(const Manifest &manifest, double budget = 0.002);
+
+  /**
+   * Import queued classes for up to `budget` seconds, e.g. from the
+   * application's idle time between frames. Returns whether classes remain.
+   */
+  bool preload_step(double budget);
+
+  /// Import every class still queued by preload_async().
+  void wait_for_preload();
+
+  /// Per-class import times of everything preloaded so far.
+  std::vector<PreloadTiming> preload_timings() const;
+
   /// Return the Python paths the system is configured with.
   const std::vector<std::string> &python_paths() const {
     return python_paths_;
   }
 
+  /**
+   * Proxy events of type Event to any Python entity with a handler_name method.
+   */
+  template <typename Event>
+  void add_event_proxy(EventManager &event_manager, const std::string &handler_name,
+                       EventConversion conversion = EventConversion::Copy) {
+    auto proxy = std::make_shared<BroadcastPythonEventProxy<Event>>(handler_name, conversion);
+    add_event_proxy<Event>(event_manager, proxy);
+  }
+
+  /**
+   * Proxy events of type Event using the given PythonEventProxy implementation.
+   */
+  template <typename Event, typename Proxy>
+  void add_event_proxy(EventManager &event_manager, std::shared_ptr<Proxy> proxy) {
+    event_manager.subscribe<Event>(*proxy);
+    add_proxy(std::static_pointer_cast<PythonEventProxy>(proxy));
+  }
+
+  /**
+   * Return a queue that any thread may push Events into, for events from
+   * threads that must not touch an EventManager. At the start of every
+   * update(), after job futures are resolved and before scripts update, the
+   * events queued so far are passed as one list to the handler_name method
+   * of every Python entity that has one.
+   *
+   * Events with no entity to handle them, and every event pushed after the
+   * system is destroyed, are dropped and counted by EventQueue::dropped().
+   */
+  template <typename Event>
+  std::shared_ptr<EventQueue<Event>> add_event_queue(const std::string &handler_name,
+                                                     EventConversion conversion = EventConversion::Copy) {
+    auto proxy = std::make_shared<QueuedPythonEventProxy<Event>>(handler_name, conversion);
+    add_proxy(proxy);
+    // Shares ownership of the proxy, so producers may outlive the system.
+    return std::shared_ptr<EventQueue<Event>>(proxy, &proxy->queue());
+  }
+
   virtual void configure(EventManager& event_manager) override;
   virtual void update(EntityManager& entities, EventManager& event_manager, TimeDelta dt) override;
 
+  /**
+   * Split update() across `threads` worker threads, each calling update() on
+   * a contiguous slice of the scripted entities. Scripts only run
+   * concurrently on free-threaded Python builds; with a GIL they take turns.
+   *
+   * While the workers run, scripts may read any component and write the
+   * components of their own entity; get_component() is safe. Calls that
+   * change the world (assign_to(), new_entity(), destroy, emit) are not, and
+   * the entityx package defers them until every worker is done, see
+   * Entity.defer(). 1 (the default) updates on the calling thread.
+   */
+  void set_update_threads(size_t threads);
+
+  /**
+   * Give scripts their own copy of every Component, merged back after each
+   * update. Required for start_update(); register every component type
+   * scripts use before spawning scripts. Components must be trivially
+   * copyable and default constructible. Where a script and C++ both changed
+   * a component during the update, the script's copy wins as a whole.
+   */
+  template <typename Component>
+  void double_buffer() {
+    buffers_.emplace_back(new ComponentBuffer<Component>(em_));
+  }
+
+  /**
+   * Run update() on a background thread, so that C++ systems can run on the
+   * calling thread meanwhile. Scripts see the double_buffer() components as
+   * of this call and their changes to the world are deferred, as in a
+   * parallel update. The calling thread leaves Python until finish_update().
+   */
+  void start_update(EntityManager& entities, EventManager& event_manager, TimeDelta dt);
+
+  /**
+   * Wait for start_update() and sync: apply deferred calls, merge the
+   * components scripts changed and refresh their copies. Rethrows script
+   * errors as std::runtime_error.
+   */
+  void finish_update();
+
+  /**
+   * Register a component type for serialization under `name`, then declare
+   * the fields to save on the result. Components must be trivially copyable
+   * and default constructible.
+   */
+  template <typename Component>
+  ComponentFields<Component> register_component(const std::string &name) {
+    ComponentFields<Component> fields = components_.add<Component>(name);
+    auto events = new ComponentEvents<Component>(*this, components_.components().size() - 1);
+    component_events_.emplace_back(events);
+    subscribe_components_.push_back([events](EventManager &ev) {
+      ev.subscribe<ComponentAddedEvent<Component>>(*events);
+      ev.subscribe<ComponentRemovedEvent<Component>>(*events);
+    });
+    if ( world_->event_manager )
+      subscribe_components_.back()(*world_->event_manager);
+    return fields;
+  }
+
+  const ComponentRegistry &components() const {
+    return components_;
+  }
+
+  /**
+   * Write an entity's registered components and script state as JSON, see
+   * WorldSerializer::write_json(). Scripts get the same with
+   * Entity.to_json().
+   */
+  void write_json(std::ostream &out, Entity::Id id);
+
+  /// Write every entity with a script or a registered component as JSON.
+  void write_json(std::ostream &out);
+
+  /**
+   * Save every entity with a script or a registered component to a binary
+   * snapshot at `path`, see WorldSnapshot. The file is written with
+   * replace_file(), so a crash leaves either the old or the new snapshot.
+   * Script state must be picklable.
+   */
+  void save_snapshot(const std::string &path);
+
+  /**
+   * Map a snapshot written by save_snapshot() and add its entities to the
+   * world. Returns the new entity ids in snapshot order. If any entity fails
+   * to restore, none are added. Script state may only hold the globals
+   * allowed by allow_global().
+   */
+  std::vector<Entity::Id> load_snapshot(const std::string &path);
+
+  /**
+   * Let saved script state hold `name` from `module`, e.g. a class of the
+   * game's own. Loading snapshots refuses any other global besides builtin
+   * containers, see WorldSerializer::unpickle().
+   */
+  void allow_global(const std::string &module, const std::string &name) {
+    serializer_.allow_global(module, name);
+  }
+
+  /**
+   * Spawn the entities of a level file: either a JSON level, see
+   * level_to_snapshot(), or a binary snapshot from save_snapshot(). All
+   * entities are created before any component is assigned. Script classes
+   * are imported once rather than once per entity and, like preloaded
+   * ones, are reused by later spawns instead of being hot reloaded. A
+   * snapshot's script state is unpickled with the restricted unpickler,
+   * see allow_global().
+   * Returns the seconds spent parsing, spawning and instantiating
+   * scripts. `ids`, if given, receives the new entity ids in level order.
+   */
+  LoadTiming load_level(const std::string &path, std::vector<Entity::Id> *ids = nullptr);
+
+  /**
+   * Keep the registered `components` and every script's class in a
+   * memory-mapped file at `path` that outlives the process, see
+   * PersistentStore. Every frame ends by writing them to the file and
+   * flushing it, so a crash reopens the last complete frame. If the
+   * file already holds a world, its entities are created first: their
+   * components are copied straight from the file and scripts get a new
+   * object of their class without running __init__. Returns the reopened
+   * entity ids. Entity indices must stay below `capacity`.
+   */
+  std::vector<Entity::Id> persist(const std::string &path,
+                                  const std::vector<std::string> &components,
+                                  size_t capacity);
+
+  /**
+   * Record in which frame registered components and script state change,
+   * for delta_snapshot(). Every update() ends a frame by comparing the
+   * entities marked changed with the previous frame, see ChangeTracker.
+   * Removals are remembered for `history` frames, so deltas may start that
+   * far back. With `scan` every registered component is compared too, so
+   * C++ may write them in place without mark_changed().
+   */
+  void track_changes(size_t history = 600, bool scan = false);
+
+  bool tracks_changes() const {
+    return tracker_.enabled();
+  }
+
+  /**
+   * Note that registered components of `id` were written in place from C++,
+   * unless track_changes() scans them, or its script state changed without
+   * assigning an attribute. Other changes are noticed without this, see
+   * ChangeTracker.
+   */
+  void mark_changed(Entity::Id id) {
+    tracker_.mark(id);
+  }
+
+  /// The number of frames ended by update() or finish_update().
+  uint64_t frame() const {
+    return frame_;
+  }
+
+  /// Replace `out` with an in-memory snapshot of the world.
+  void snapshot(std::string &out);
+
+  /**
+   * Replace `out` with the entities, components and script state that
+   * changed after frame `since`. Requires track_changes().
+   */
+  void delta_snapshot(std::string &out, uint64_t since);
+
+  /**
+   * Apply a snapshot or delta of another world, e.g. for a spectator.
+   * `entities` maps the other world's entities to this one's and must be
+   * kept between deltas. Returns the local ids of the applied entities.
+   */
+  std::vector<Entity::Id> apply_snapshot(const char *data, size_t size,
+                                         SnapshotEntities &entities);
+
+  /**
+   * Snapshot the world in memory whenever a frame ends, keeping the last
+   * `frames` frames and the current one for rollback() and resimulate().
+   * 0 stops taking snapshots.
+   */
+  void enable_rollback(size_t frames);
+
+  /**
+   * Return the world to the end of `frame`, which must be one of the kept
+   * frames, and forget the frames after it. Entities keep their ids and
+   * scripts keep their objects; entities destroyed since are created again
+   * under new ids. Throws std::runtime_error if the frame is not kept.
+   */
+  void rollback(uint64_t frame);
+
+  /**
+   * Roll back to `frame` and update again through the current frame with the
+   * recorded time steps. `before_update` is called with the number of each
+   * frame before it is updated, e.g. to apply corrected inputs and run C++
+   * systems.
+   */
+  void resimulate(uint64_t frame, EntityManager &entities, EventManager &events,
+                  std::function<void(uint64_t)> before_update = nullptr);
+
+  /**
+   * Hash registered components and the script `attributes` at the end of
+   * every frame, see WorldHasher, and append the hashes to a log at `path`
+   * unless it is empty. Compare the logs of two runs with
+   * tools/hashdiff.py.
+   */
+  void hash_frames(const std::string &path = std::string(),
+                   const std::vector<std::string> &attributes = std::vector<std::string>());
+
+  void stop_hashing();
+
+  /// The hash of the last frame, with hash_frames().
+  uint64_t frame_hash() const {
+    return hasher_.hash();
+  }
+
+  /**
+   * Every `every` frames, copy the registered `fields` of `component` for
+   * up to `capacity` entities into a file at `path` keeping the last
+   * `slots` samples, see TelemetryStream. A background thread writes the
+   * file, so it can be read with tools/telemetry.py while the world runs.
+   * Several components may be sampled at once; frames cost nothing extra
+   * when none are.
+   */
+  void sample_fields(const std::string &path, const std::string &component,
+                     const std::vector<std::string> &fields, size_t every = 1,
+                     size_t capacity = 16384, size_t slots = 256);
+
+  /// Stop sampling, after writing out samples already taken.
+  void stop_sampling();
+
+  /**
+   * Mirror the registered `components` of up to `capacity` entities each
+   * into a file at `path` at the end of every frame, see ComponentExport.
+   * Other processes read it in place with ComponentExportReader. `path`
+   * should be on a memory-backed file system such as /dev/shm.
+   */
+  void export_components(const std::string &path, const std::vector<std::string> &components,
+                         size_t capacity);
+
+  /// Stop exporting and remove the file.
+  void stop_export();
+
+  /**
+   * Record a replay log at `path`, see ReplayRecorder: a snapshot of the
+   * world now, then every time step, every event delivered to scripts from
+   * outside them, every script assigned from C++ and the registered
+   * components C++ assigns to and removes from those entities, and their
+   * destruction, until stop_recording(). Events need a ReplayEvent
+   * specialization. Register the event proxies and components of a replay
+   * in the same order as while recording.
+   */
+  void record(const std::string &path);
+
+  void stop_recording();
+
+  /**
+   * Replay a log written by record() into this system's empty world: its
+   * snapshot is restored, then spawns and events are repeated and update()
+   * is called with each recorded time step. `before_update` is called with
+   * the number of each frame before it is updated. Returns the number of
+   * frames replayed.
+   */
+  uint64_t replay(const std::string &path, EntityManager &entities, EventManager &events,
+                  std::function<void(uint64_t)> before_update = nullptr);
+
+  /**
+   * Let scripts run `job` off the scripting thread with
+   * `self.submit(name, *args)`. The returned Future is resolved by a later
+   * update(), which then calls its callbacks or resumes the generator
+   * waiting on it, see Entity.run_async(). The job must not touch Python.
+   */
+  template <typename Result, typename... Args>
+  void add_job(const std::string &name, std::function<Result(Args...)> job) {
+    jobs_.add(name, job);
+  }
+
+  template <typename Result, typename... Args>
+  void add_job(const std::string &name, Result (*job)(Args...)) {
+    jobs_.add(name, job);
+  }
+
+  /**
+   * Run jobs on `pool` instead of the host's shared job_pool(), e.g. to keep
+   * one system's jobs from queueing behind another's.
+   */
+  void set_job_pool(std::shared_ptr<JobPool> pool);
+
   /**
    * Set line-based (not including \n) logger for stdout and stderr.
+   *
+   * Must be called before configure(). Loggers are called from a background
+   * thread owned by each stream, see PythonEntityXLogger.
    */
   void log_to(LoggerFunction sout, LoggerFunction serr);
 
+  /**
+   * Record stdout (as LogLevel::Info), stderr (as LogLevel::Error) and
+   * entity log records into a binary log. Must be called before configure().
+   */
+  void log_to(std::shared_ptr<BinaryLogSink> sink);
+
+  /**
+   * Send records logged with Entity.debug()/info()/warning()/error() to
+   * `records` instead of the stdout and stderr loggers.
+   */
+  void log_records_to(RecordFunction records);
+
+  /**
+   * Drop entity log records below `level`. Scripts check the level before
+   * formatting, so disabled levels cost a comparison.
+   */
+  void set_log_level(LogLevel level);
+
+  /**
+   * Log at most `burst` identical messages per script class every
+   * `interval` seconds, followed by a count of the suppressed ones.
+   * A burst of 0 disables rate limiting.
+   */
+  void set_log_rate_limit(size_t burst, TimeDelta interval);
+
+  /**
+   * Report suppressed log records, then block until every complete line
+   * written to stdout and stderr so far has been passed to the loggers.
+   */
+  void flush_logs();
+
   void receive(const ComponentAddedEvent<PythonScript> &event);
+  void receive(const ComponentRemovedEvent<PythonScript> &event);
+  void receive(const EntityDestroyedEvent &event);
 
 private:
-  void initialize_python_module();
+  /**
+   * Tells the system which entities gain or lose a registered component,
+   * for change tracking and replay logs. register_component() subscribes
+   * one per component type.
+   */
+  template <typename Component>
+  class ComponentEvents : public Receiver<ComponentEvents<Component>> {
+  public:
+    ComponentEvents(PythonSystem &system, size_t component)
+      : system_(system), component_(component) {}
+
+    void receive(const ComponentAddedEvent<Component> &event) {
+      system_.component_added(component_, event.entity.id(), event.component.get());
+    }
+
+    void receive(const ComponentRemovedEvent<Component> &event) {
+      system_.component_removed(component_, event.entity.id(), event.component.get());
+    }
+
+  private:
+    PythonSystem &system_;
+    size_t component_;
+  };
+
+  // The `component`th registered component at `data` was assigned to or is
+  // being removed from `id`.
+  void component_added(size_t component, Entity::Id id, const void *data);
+  void component_removed(size_t component, Entity::Id id, const void *data);
+  void teardown();
+  void add_proxy(std::shared_ptr<PythonEventProxy> proxy);
+  void log_record(const LogRecord &record);
+  void preload_class(const std::string &module, const std::string &cls);
+  void update_parallel(EntityManager &entities, TimeDelta dt);
+  void run_deferred();
+  void snapshot_buffers();
+  void sync_buffers();
+  void end_frame();
+  void record_spawn(Entity::Id id, const PythonScript &script);
+  void replay_spawn(EntityManager &entities, Entity::Id id, const ReplayReader::Record &record);
+  void resolve_jobs();
+  void deliver_queued_events();
+  py::object find_class(const std::string &module, const std::string &cls);
 
+  std::shared_ptr<PythonHost> host_;
   EntityManager& em_;
   std::vector<std::string> python_paths_;
   LoggerFunction stdout_, stderr_;
-  static bool initialized_;
+  std::shared_ptr<PythonEntityXLogger> stdout_logger_, stderr_logger_;
+  ScriptLogger log_;
+  ScriptJobs jobs_;
+  ComponentRegistry components_;
+  WorldSerializer serializer_;
+  ChangeTracker tracker_;
+  // One per registered component, destroyed before tracker_.
+  std::vector<std::unique_ptr<BaseReceiver>> component_events_;
+  std::vector<std::function<void(EventManager &)>> subscribe_components_;
+  WorldSnapshot snapshot_;
+  PersistentStore persistent_;
+  ReplayRecorder recorder_;
+  WorldHasher hasher_;
+  std::vector<std::unique_ptr<TelemetryStream>> telemetry_;
+  std::unique_ptr<ComponentExport> export_;
+  // Shared with py_world_, so a script that keeps its world past the system
+  // finds it invalidated rather than freed.
+  std::shared_ptr<PythonWorld> world_;
+  py::object py_world_;
+  std::vector<std::shared_ptr<PythonEventProxy>> event_proxies_;
+  mutable std::mutex classes_mutex_;
+  std::unordered_map<std::string, py::object> classes_;
+  // Whether load_level() or persist() is spawning; the classes they import
+  // are kept in classes_.
+  bool loading_;
+  std::vector<PreloadTiming> preload_timings_;
+  // Classes queued by preload_async(), guarded by the GIL.
+  std::deque<std::pair<std::string, std::string>> preload_queue_;
+  double preload_budget_;
+  std::vector<py::object> inserted_paths_;
+  std::vector<py::object> archives_;
+  size_t update_threads_;
+  std::unique_ptr<ThreadPool> update_pool_;
+  std::vector<std::unique_ptr<BaseComponentBuffer>> buffers_;
+  std::thread async_thread_;
+  std::unique_ptr<PythonHost::Release> async_release_;
+  std::exception_ptr async_error_;
+  uint64_t frame_;
+  TimeDelta frame_dt_;
+  SnapshotRing rollback_;
+  SnapshotEntities rollback_entities_;
 };
 }  // namespace python
 }  // namespace entityx
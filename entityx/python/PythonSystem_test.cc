@@ -16,12 +16,23 @@
 #include <cassert>
 #include <vector>
 #include <string>
+#include <fstream>
+#include <iterator>
+#include <cstring>
 #include <iostream>
+#include <sstream>
 #include <memory>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
 #include "entityx/python/3rdparty/catch.hpp"
 #include "entityx/entityx.h"
 #include "entityx/python/PythonScript.hpp"
 #include "entityx/python/PythonSystem.h"
+#include "entityx/python/SharedComponents.hpp"
+#include "entityx/python/ShardedWorld.h"
 
 namespace py = pybind11;
 using std::cerr;
@@ -42,47 +53,107 @@ struct Direction {
   float x, y;
 };
 
+struct Collision {
+  Collision(Entity a, Entity b) : a(a), b(b) {}
+
+  Entity a, b;
+};
+
+struct Damage {
+  explicit Damage(int amount = 0) : amount(amount) {}
+
+  int amount;
+};
+
+namespace entityx {
+namespace python {
+
+template <>
+struct ReplayEvent<Damage> {
+  static void save(const Damage &event, ReplayWriter &out) {
+    out(event.amount);
+  }
+
+  static Damage load(ReplayFields &in) {
+    Damage event;
+    in(event.amount);
+    return event;
+  }
+};
+
+}  // namespace python
+}  // namespace entityx
+
+static std::atomic<bool> python_thread_ran(false);
+
+// Returns true once another thread has run Python, which needs the GIL, or
+// false if none has after `timeout` seconds.
+static bool wait_for_python_thread(double timeout) {
+  const auto deadline = std::chrono::steady_clock::now() +
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+  while ( !python_thread_ran ) {
+    if ( std::chrono::steady_clock::now() > deadline )
+      return false;
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+static int add_ints(int a, int b) {
+  return a + b;
+}
+
+static int fail_job() {
+  throw std::runtime_error("no path");
+}
+
 PYBIND11_PLUGIN(entityx_python_test) {
   using namespace pybind11::literals;
   py::module m("entityx_python_test");
-  py::class_<Position>(m, "Position")
+  py::class_<Position> position(m, "Position");
+  position
     .def(py::init<float, float>(), "x"_a = 0.f, "y"_a = 0.f)
     .def("assign_to", &assign_to<Position>)
     .def_static("get_component", &get_component<Position>,
-         py::return_value_policy::reference)
-    .def_readwrite("x", &Position::x)
-    .def_readwrite("y", &Position::y);
+         py::return_value_policy::reference);
+  def_tracked(position, "x", &Position::x);
+  def_tracked(position, "y", &Position::y);
 
-  py::class_<Direction>(m, "Direction")
+  py::class_<Direction> direction(m, "Direction");
+  direction
     .def(py::init<float, float>(), "x"_a = 0.f, "y"_a = 0.f)
     .def("assign_to", &assign_to<Direction>)
     .def_static("get_component", &get_component<Direction>,
-                py::return_value_policy::reference)
-    .def_readwrite("x", &Direction::x)
-    .def_readwrite("y", &Direction::y);
+                py::return_value_policy::reference);
+  def_tracked(direction, "x", &Direction::x);
+  def_tracked(direction, "y", &Direction::y);
+
+  py::class_<Collision>(m, "Collision")
+    .def(py::init<Entity, Entity>())
+    .def("emit", &emit<Collision>)
+    .def_readonly("a", &Collision::a)
+    .def_readonly("b", &Collision::b);
+
+  py::class_<Damage>(m, "Damage")
+    .def_readonly("amount", &Damage::amount);
+
+  m.def("wait_for_python_thread", release_gil(&wait_for_python_thread));
   return m.ptr();
 }
 
 class PythonSystemTest {
 protected:
   PythonSystemTest() : python(entity_manager), entity_manager(event_manager) {
-    Py_Initialize();
+    python.host()->add_module("entityx_python_test", &pybind11_init);
     python.add_path(ENTITYX_PYTHON_TEST_DATA);
-    if ( !initialized ) {
-      pybind11_init();
-      initialized = true;
-    }
     python.configure(event_manager);
   }
 
   PythonSystem python;
   EventManager event_manager;
   EntityManager entity_manager;
-  static bool initialized;
 };
 
-bool PythonSystemTest::initialized = false;
-
 TEST_CASE_METHOD(PythonSystemTest, "TestSystemUpdateCallsEntityUpdate") {
   try {
     Entity e = entity_manager.create();
@@ -206,38 +277,61 @@ TEST_CASE_METHOD(PythonSystemTest, "TestEntityCreationFromPython") {
 
 TEST_CASE_METHOD(PythonSystemTest, "TestJSONOutputCpp") {
     try {
+        python.register_component<Position>("Position")
+          .field("x", &Position::x)
+          .field("y", &Position::y);
+        python.register_component<Direction>("Direction")
+          .field("x", &Direction::x)
+          .field("y", &Direction::y);
         Entity e = entity_manager.create();
         e.assign<Position>(2.f, 4.f);
         e.assign<Direction>(1.f, -1.f);
         auto script = e.assign<PythonScript>("entityx.tests.json_test", "JsonTest");
-        REQUIRE(static_cast<bool>(e.component<Position>()));
-        REQUIRE(static_cast<bool>(e.component<Direction>()));
         REQUIRE(script->object);
-        REQUIRE(script->object.attr("to_json").ptr());
         py::object o = script->object.attr("to_json")();
-        auto position = e.component<Position>();
-        REQUIRE(static_cast<bool>(position));
-        REQUIRE(position->x == 2.0);
-        REQUIRE(position->y == 4.0);
-        auto direction = e.component<Direction>();
-        REQUIRE(static_cast<bool>(direction));
-        REQUIRE(direction->x == 1.0);
-        REQUIRE(direction->y == -1.0);
         py::module m("json");
         py::dict parsed = py::cast<py::dict>(m.attr("loads")(o));
         // Incase you need to debug.
         //for ( auto item : parsed )
         //    py::print("key: {}, value={}"_s.format(item.first, item.second));
 
-        REQUIRE(py::cast<std::string>(parsed["entity"]["id"]) == "<Entity::Id 0.1>");
-        REQUIRE(py::cast<std::string>(parsed["id"]) == "<Entity::Id 0.1>");
-        REQUIRE(py::cast<std::string>(parsed["py_array"]) == "[1, 2, 3]");
-        py::dict py_pos = py::cast<py::dict>(parsed["position"]);
+        REQUIRE(py::cast<uint64_t>(parsed["id"]) == e.id().id());
+        REQUIRE(py::cast<uint32_t>(parsed["index"]) == e.id().index());
+        REQUIRE(py::cast<uint32_t>(parsed["version"]) == e.id().version());
+        py::dict components = py::cast<py::dict>(parsed["components"]);
+        py::dict py_pos = py::cast<py::dict>(components["Position"]);
         REQUIRE((float)py::float_(py_pos["x"]) == 2.0f);
         REQUIRE((float)py::float_(py_pos["y"]) == 4.0f);
-        py::dict py_dir = py::cast<py::dict>(parsed["direction"]);
+        py::dict py_dir = py::cast<py::dict>(components["Direction"]);
         REQUIRE((float)py::float_(py_dir["x"]) == 1.0f);
         REQUIRE((float)py::float_(py_dir["y"]) == -1.0f);
+
+        py::dict py_script = py::cast<py::dict>(parsed["script"]);
+        REQUIRE(py::cast<std::string>(py_script["module"]) == "entityx.tests.json_test");
+        REQUIRE(py::cast<std::string>(py_script["class"]) == "JsonTest");
+        py::dict state = py::cast<py::dict>(py_script["state"]);
+        REQUIRE(py::cast<std::vector<int>>(state["py_array"]) == std::vector<int>({1, 2, 3}));
+        REQUIRE(py::cast<std::string>(state["name"]) == "json \"test\"");
+        // Components and the entity itself are not part of the state.
+        REQUIRE(py::len(state) == 2);
+
+        std::ostringstream world;
+        python.write_json(world);
+        py::dict parsed_world = py::cast<py::dict>(m.attr("loads")(world.str()));
+        REQUIRE(py::len(py::object(parsed_world["entities"])) == 1);
+
+        // Integers outside 64 bits keep every digit, and keys UTF-8 cannot
+        // encode are escaped rather than dropped.
+        py::object big = py::reinterpret_steal<py::object>(
+          PyLong_FromString(const_cast<char *>("-123456789012345678901234567890"), nullptr, 10));
+        py::dict odd;
+        odd[py::reinterpret_steal<py::object>(PyUnicode_FromOrdinal(0xdc80))] = py::int_(1);
+        script->object.attr("big") = big;
+        script->object.attr("odd") = odd;
+        parsed = py::cast<py::dict>(m.attr("loads")(script->object.attr("to_json")()));
+        state = py::cast<py::dict>(py::cast<py::dict>(parsed["script"])["state"]);
+        REQUIRE(PyObject_RichCompareBool(py::object(state["big"]).ptr(), big.ptr(), Py_EQ) == 1);
+        REQUIRE(py::len(py::object(state["odd"])) == 1);
     }
     catch ( py::error_already_set& e ) {
         // TODO(SMA) : Really!? fix this. Should handle execption e better here.
@@ -246,4 +340,1377 @@ TEST_CASE_METHOD(PythonSystemTest, "TestJSONOutputCpp") {
         PyErr_Clear();
         REQUIRE(false);
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestSnapshot") {
+  try {
+    python.register_component<Position>("Position")
+      .field("x", &Position::x)
+      .field("y", &Position::y);
+    const std::string path = "/tmp/entityx_python_snapshot_" + std::to_string(::getpid());
+    Entity scripted = entity_manager.create();
+    scripted.assign<Position>(2.f, 4.f);
+    auto script = scripted.assign<PythonScript>("entityx.tests.json_test", "JsonTest");
+    script->object.attr("name") = py::str("restored");
+    script->object.attr("py_array") = py::cast(std::vector<int>({4, 5}));
+    Entity plain = entity_manager.create();
+    plain.assign<Position>(-1.f, 1.f);
+    python.save_snapshot(path);
+
+    entity_manager.reset();
+    std::vector<Entity::Id> ids = python.load_snapshot(path);
+    ::unlink(path.c_str());
+    REQUIRE(ids.size() == 2);
+    Entity restored = entity_manager.get(ids[0]);
+    REQUIRE(restored.component<Position>()->x == 2.f);
+    REQUIRE(restored.component<Position>()->y == 4.f);
+    // Components the script adds itself keep their defaults.
+    REQUIRE(restored.component<Direction>());
+    py::object object = restored.component<PythonScript>()->object;
+    REQUIRE(py::cast<std::string>(object.attr("name")) == "restored");
+    REQUIRE(py::cast<std::vector<int>>(object.attr("py_array")) == std::vector<int>({4, 5}));
+    REQUIRE(py::cast<float>(object.attr("position").attr("y")) == 4.f);
+    Entity other = entity_manager.get(ids[1]);
+    REQUIRE(other.component<Position>()->x == -1.f);
+    REQUIRE(!other.component<PythonScript>());
+
+    // Truncated snapshots are rejected without touching the world.
+    std::ofstream(path) << "EXPYSNAP";
+    REQUIRE_THROWS_AS(python.load_snapshot(path), std::runtime_error);
+    ::unlink(path.c_str());
+    REQUIRE(entity_manager.size() == 2);
+
+    // Script state may not name arbitrary globals.
+    object.attr("hook") = py::module::import("os").attr("getcwd");
+    python.save_snapshot(path);
+    REQUIRE_THROWS(python.load_snapshot(path));
+    REQUIRE(entity_manager.size() == 2);
+    PyObject_DelAttrString(object.ptr(), "hook");
+
+    // A script failing partway through leaves nothing behind.
+    Entity fragile = entity_manager.create();
+    fragile.assign<PythonScript>("entityx.tests.json_test", "FragileTest");
+    python.save_snapshot(path);
+    py::object fragile_class = py::module::import("entityx.tests.json_test").attr("FragileTest");
+    fragile_class.attr("fail") = py::bool_(true);
+    REQUIRE_THROWS(python.load_snapshot(path));
+    REQUIRE(entity_manager.size() == 3);
+    fragile_class.attr("fail") = py::bool_(false);
+    REQUIRE(python.load_snapshot(path).size() == 3);
+    REQUIRE(entity_manager.size() == 6);
+    ::unlink(path.c_str());
+  }
+  catch ( py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestSnapshotReleasesReloadedClasses") {
+  const std::string path = "/tmp/entityx_python_reloaded_" + std::to_string(::getpid());
+  try {
+    // Spawning from C++ reloads the module, so each spawn has a new class.
+    Entity first = entity_manager.create();
+    py::object cls =
+      first.assign<PythonScript>("entityx.tests.json_test", "JsonTest")->object.attr("__class__");
+    py::object ref = py::module::import("weakref").attr("ref")(cls);
+    cls = py::object();
+    python.save_snapshot(path);
+    first.destroy();
+
+    Entity second = entity_manager.create();
+    second.assign<PythonScript>("entityx.tests.json_test", "JsonTest");
+    python.save_snapshot(path);
+    py::module::import("gc").attr("collect")();
+    // The snapshot's class cache let go of the class it replaced.
+    REQUIRE(ref().ptr() == Py_None);
+  }
+  catch ( py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+  ::unlink(path.c_str());
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestEventDelivery") {
+  try {
+    python.add_event_proxy<Collision>(event_manager, "on_collision");
+    Entity a = entity_manager.create();
+    Entity b = entity_manager.create();
+    Entity c = entity_manager.create();
+    auto script_a = a.assign<PythonScript>("entityx.tests.event_test", "KeepEventTest");
+    auto script_b = b.assign<PythonScript>("entityx.tests.event_test", "KeepEventTest");
+    auto script_c = c.assign<PythonScript>("entityx.tests.update_test", "UpdateTest");
+    event_manager.emit<Collision>(a, b);
+    REQUIRE(py::cast<bool>(script_a->object.attr("collided")));
+    REQUIRE(py::cast<bool>(script_b->object.attr("collided")));
+    REQUIRE(!PyObject_HasAttrString(script_c->object.ptr(), "collided"));
+    // Both receivers share a single conversion of the event: the same object,
+    // kept alive by both, so its address can not have been reused.
+    py::list events_a = py::cast<py::list>(script_a->object.attr("events"));
+    py::list events_b = py::cast<py::list>(script_b->object.attr("events"));
+    REQUIRE(py::len(events_a) == 1);
+    REQUIRE(py::len(events_b) == 1);
+    REQUIRE(py::object(events_a[0]).ptr() == py::object(events_b[0]).ptr());
+
+    // Removed scripts no longer receive events.
+    b.remove<PythonScript>();
+    script_a->object.attr("collided") = py::cast(false);
+    event_manager.emit<Collision>(a, b);
+    REQUIRE(py::cast<bool>(script_a->object.attr("collided")));
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestEventDeliveryAsView") {
+  try {
+    python.add_event_proxy<Collision>(event_manager, "on_collision", EventConversion::View);
+    Entity a = entity_manager.create();
+    Entity b = entity_manager.create();
+    auto script_a = a.assign<PythonScript>("entityx.tests.event_test", "EventTest");
+    auto script_b = b.assign<PythonScript>("entityx.tests.event_test", "EventTest");
+    event_manager.emit<Collision>(a, b);
+    REQUIRE(py::cast<bool>(script_a->object.attr("collided")));
+    REQUIRE(py::cast<bool>(script_b->object.attr("collided")));
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestEventQueue") {
+  try {
+    auto queue = python.add_event_queue<Damage>("on_damage");
+    Entity e = entity_manager.create();
+    auto script = e.assign<PythonScript>("entityx.tests.event_test", "DamageTest");
+    std::vector<std::thread> producers;
+    for ( int thread = 0; thread < 4; ++thread ) {
+      producers.push_back(std::thread([queue]() {
+        for ( int i = 1; i <= 100; ++i ) {
+          queue->push(Damage(i));
+        }
+      }));
+    }
+    for ( auto &producer : producers ) {
+      producer.join();
+    }
+    py::object batches = script->object.attr("batches");
+    REQUIRE(py::len(batches) == 0);
+
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    REQUIRE(py::len(batches) == 1);
+    auto amounts = py::cast<std::vector<int>>(batches.attr("__getitem__")(0));
+    REQUIRE(amounts.size() == 400);
+    int total = 0;
+    for ( auto amount : amounts ) {
+      total += amount;
+    }
+    REQUIRE(total == 4 * 5050);
+
+    // Empty batches are not delivered.
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    REQUIRE(py::len(batches) == 1);
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE("TestEventQueueOutlivesSystem") {
+  try {
+    auto host = PythonHost::shared();
+    std::shared_ptr<EventQueue<Damage>> queue;
+    {
+      EventManager events;
+      EntityManager entities(events);
+      PythonSystem python(entities, host);
+      python.configure(events);
+      queue = python.add_event_queue<Damage>("on_damage");
+      // No entity handles the events, so the batch is dropped.
+      REQUIRE(queue->push(Damage(1)));
+      python.update(entities, events, static_cast<TimeDelta>(0.1));
+      REQUIRE(queue->dropped() == 1);
+      queue->push(Damage(2));
+      queue->push(Damage(3));
+    }
+    // The producer outlived the system: nothing is kept for it any more.
+    REQUIRE(queue->dropped() == 3);
+    REQUIRE(!queue->push(Damage(4)));
+    REQUIRE(queue->dropped() == 4);
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE("TestEventQueueCloseWhilePushing") {
+  const size_t producers = 4, pushes = 2000;
+  for ( int round = 0; round < 2000; ++round ) {
+    EventQueue<int> queue;
+    std::atomic<size_t> accepted(0);
+    std::vector<std::thread> threads;
+    for ( size_t thread = 0; thread < producers; ++thread ) {
+      threads.push_back(std::thread([&queue, &accepted]() {
+        for ( size_t i = 0; i < pushes; ++i ) {
+          if ( queue.push(1) )
+            ++accepted;
+        }
+      }));
+    }
+    size_t delivered = queue.drain([](int &&) {});
+    // Some pushes are usually still running.
+    queue.close();
+    for ( auto &thread : threads ) {
+      thread.join();
+    }
+    // Nothing landed after close(), and every event is accounted for.
+    REQUIRE(queue.drain([](int &&) {}) == 0);
+    const size_t handled = delivered + queue.dropped();
+    REQUIRE(handled == producers * pushes);
+    REQUIRE(accepted.load() >= delivered);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestEventEmitFromPython") {
+  try {
+    python.add_event_proxy<Collision>(event_manager, "on_collision");
+    py::object test = py::module::import("entityx.tests.event_emit_test");
+    test.attr("emit_collision_from_python")();
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestEntityLogging") {
+  try {
+    std::vector<LogRecord> records;
+    python.log_records_to([&](const LogRecord &record) { records.push_back(record); });
+    python.set_log_level(LogLevel::Info);
+    python.set_log_rate_limit(5, 1000.0);
+    Entity e = entity_manager.create();
+    e.assign<PythonScript>("entityx.tests.log_test", "LogTest");
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    // Debug is disabled and all but 5 "hit" warnings are suppressed.
+    REQUIRE(records.size() == 6);
+    REQUIRE(records[0].level == LogLevel::Warning);
+    REQUIRE(records[0].entity == e.id());
+    REQUIRE(records[0].cls == "entityx.tests.log_test.LogTest");
+    REQUIRE(records[0].message == "hit 0");
+    REQUIRE(records[5].message == "done");
+    python.flush_logs();
+    REQUIRE(records.size() == 7);
+    REQUIRE(records[6].message == "suppressed 95 identical messages: hit %d");
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+#ifdef ENTITYX_PYTHON_TEST_ARCHIVE
+TEST_CASE_METHOD(PythonSystemTest, "TestScriptArchiveImport") {
+  try {
+    python.add_archive(ENTITYX_PYTHON_TEST_ARCHIVE);
+    // archived.scripted is not on sys.path, only in the archive.
+    Entity e = entity_manager.create();
+    auto script = e.assign<PythonScript>("archived.scripted", "ArchivedTest");
+    REQUIRE(py::cast<bool>(script->object.attr("from_archive")()));
+    Entity e2 = entity_manager.create();
+    auto script2 = e2.assign<PythonScript>("archived.scripted", "ArchivedTest");
+    REQUIRE(script2->object.attr("__class__").ptr() == script->object.attr("__class__").ptr());
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+#endif
+
+TEST_CASE_METHOD(PythonSystemTest, "TestPreloadManifest") {
+  try {
+    PythonSystem::Manifest manifest;
+    manifest.push_back(std::make_pair("entityx.tests.constructor_test", "ConstructorTest"));
+    manifest.push_back(std::make_pair("entityx.tests.missing_module", "Missing"));
+    python.preload(manifest);
+    auto timings = python.preload_timings();
+    REQUIRE(timings.size() == 2);
+    REQUIRE(timings[0].ok);
+    REQUIRE(timings[0].module == "entityx.tests.constructor_test");
+    REQUIRE(timings[0].seconds >= 0.0);
+    REQUIRE(!timings[1].ok);
+    REQUIRE(!timings[1].error.empty());
+
+    Entity e = entity_manager.create();
+    e.assign<PythonScript>("entityx.tests.constructor_test", "ConstructorTest", 4.0, 5.0);
+    REQUIRE(e.component<Position>()->x == 4.0);
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestPreloadManifestAsync") {
+  try {
+    PythonSystem::Manifest manifest;
+    manifest.push_back(std::make_pair("entityx.tests.deep_subclass_test", "DeepSubclassTest"));
+    manifest.push_back(std::make_pair("entityx.tests.deep_subclass_test", "DeepSubclassTest2"));
+    // A budget too small for more than the one class every frame imports.
+    python.preload_async(manifest, 1e-9);
+    REQUIRE(python.preload_timings().empty());
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    REQUIRE(python.preload_timings().size() == 1);
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    auto timings = python.preload_timings();
+    REQUIRE(timings.size() == 2);
+    REQUIRE(timings[0].ok);
+    REQUIRE(timings[1].ok);
+    REQUIRE(!python.preload_step(1.0));
+    python.wait_for_preload();
+
+    Entity e = entity_manager.create();
+    auto script = e.assign<PythonScript>("entityx.tests.deep_subclass_test", "DeepSubclassTest2");
+    script->object.attr("test_deeper_subclass")();
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestParallelUpdate") {
+  try {
+    std::vector<Entity> entities;
+    for ( int i = 0; i < 100; ++i ) {
+      Entity e = entity_manager.create();
+      e.assign<PythonScript>("entityx.tests.parallel_test", "ParallelTest", i == 50);
+      entities.push_back(e);
+    }
+    python.set_update_threads(4);
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    for ( auto e : entities ) {
+      REQUIRE(e.component<Position>()->x == 1.f);
+    }
+    // The spawn was deferred until every worker was done.
+    REQUIRE(entity_manager.size() == 101);
+    REQUIRE(!py::cast<bool>(python.world().attr("parallel")));
+    python.set_update_threads(1);
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestReleaseGil") {
+  try {
+    python_thread_ran = false;
+    std::thread other([this]() {
+      PythonHost::Lock lock(*python.host());
+      py::module::import("sys");
+      python_thread_ran = true;
+    });
+    py::object wait = py::module::import("entityx_python_test").attr("wait_for_python_thread");
+    const bool ran = py::cast<bool>(wait(5.0));
+    {
+      // If the GIL was not released, let the other thread finish now.
+      PythonHost::Release release;
+      other.join();
+    }
+    REQUIRE(ran);
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestDoubleBufferedUpdate") {
+  try {
+    python.double_buffer<Position>();
+    Entity scripted = entity_manager.create();
+    scripted.assign<Position>(5.f, 0.f);
+    scripted.assign<PythonScript>("entityx.tests.parallel_test", "ParallelTest", true);
+    Entity other = entity_manager.create();
+    other.assign<Position>(0.f, 0.f);
+
+    Entity doomed = entity_manager.create();
+    doomed.assign<Position>(0.f, 0.f);
+
+    python.start_update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    // A C++ system running alongside the scripts.
+    other.component<Position>()->y = 7.f;
+    scripted.component<Position>()->y = 3.f;
+    doomed.destroy();
+    REQUIRE(scripted.component<Position>()->x == 5.f);
+    python.finish_update();
+
+    REQUIRE(scripted.component<Position>()->x == 6.f);
+    // The script changed the component too, so its copy replaced the C++
+    // write; components only C++ changed keep it.
+    REQUIRE(scripted.component<Position>()->y == 0.f);
+    REQUIRE(other.component<Position>()->y == 7.f);
+    // The spawn was deferred to finish_update().
+    REQUIRE(entity_manager.size() == 3);
+
+    // The next update starts from the merged components.
+    python.start_update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    python.finish_update();
+    REQUIRE(scripted.component<Position>()->x == 7.f);
+
+    // Handlers of queued events write the copies just before they are
+    // snapshotted, and those writes are kept.
+    auto queue = python.add_event_queue<Damage>("on_damage");
+    queue->push(Damage(4));
+    python.start_update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    python.finish_update();
+    REQUIRE(scripted.component<Position>()->x == 8.f);
+    REQUIRE(scripted.component<Position>()->y == 4.f);
+    queue->push(Damage(2));
+    python.set_update_threads(2);
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    REQUIRE(scripted.component<Position>()->x == 9.f);
+    REQUIRE(scripted.component<Position>()->y == 6.f);
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestJobs") {
+  try {
+    std::vector<LogRecord> records;
+    python.log_records_to([&](const LogRecord &record) { records.push_back(record); });
+    python.add_job("add", &add_ints);
+    python.add_job("fail", &fail_job);
+    Entity e = entity_manager.create();
+    auto script = e.assign<PythonScript>("entityx.tests.job_test", "JobTest");
+    // Futures are only resolved by update().
+    REQUIRE(script->object.attr("sum").ptr() == Py_None);
+    for ( int frame = 0; frame < 1000 &&
+          (script->object.attr("product").ptr() == Py_None || records.empty()); ++frame ) {
+      python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(py::cast<int>(script->object.attr("sum")) == 5);
+    REQUIRE(py::cast<int>(script->object.attr("product")) == 12);
+    REQUIRE(py::cast<std::string>(script->object.attr("error")) == "no path");
+    // The crashed generator was logged for its entity instead of failing update().
+    REQUIRE(records.size() == 1);
+    REQUIRE(records[0].level == LogLevel::Error);
+    REQUIRE(records[0].entity == e.id());
+    REQUIRE(records[0].message.find("ValueError: lost the path") != std::string::npos);
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE("TestManyPythonSystems") {
+  try {
+    auto host = PythonHost::shared();
+    host->add_module("entityx_python_test", &pybind11_init);
+    py::object sys = py::module::import("sys");
+    py::object entityx = py::module::import("_entityx");
+    for ( int i = 0; i < 10; ++i ) {
+      EventManager events;
+      EntityManager entities(events);
+      {
+        PythonSystem python(entities, host);
+        python.add_path(ENTITYX_PYTHON_TEST_DATA);
+        python.configure(events);
+        Entity e = entities.create();
+        auto script = e.assign<PythonScript>("entityx.tests.update_test", "UpdateTest");
+        python.update(entities, events, static_cast<TimeDelta>(0.1));
+        REQUIRE(py::cast<bool>(script->object.attr("updated")));
+        entities.reset();
+      }
+      // Nothing from the destroyed system is left behind.
+      REQUIRE(!PyObject_HasAttrString(entityx.ptr(), "_world"));
+      REQUIRE(sys.attr("stdout").ptr() == sys.attr("__stdout__").ptr());
+      REQUIRE(!py::cast<bool>(sys.attr("path").attr("__contains__")(ENTITYX_PYTHON_TEST_DATA)));
+    }
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE("TestTwoWorlds") {
+  try {
+    auto host = PythonHost::shared();
+    host->add_module("entityx_python_test", &pybind11_init);
+    EventManager events_a, events_b;
+    EntityManager entities_a(events_a), entities_b(events_b);
+    PythonSystem python_a(entities_a, host), python_b(entities_b, host);
+    python_a.add_path(ENTITYX_PYTHON_TEST_DATA);
+    python_a.configure(events_a);
+    python_b.configure(events_b);
+
+    Entity a = entities_a.create();
+    auto script_a = a.assign<PythonScript>("entityx.tests.world_test", "WorldTest");
+    Entity b = entities_b.create();
+    auto script_b = b.assign<PythonScript>("entityx.tests.world_test", "WorldTest");
+    REQUIRE(static_cast<bool>(a.component<Position>()));
+    REQUIRE(static_cast<bool>(b.component<Position>()));
+    REQUIRE(script_a->object.attr("_world").ptr() == python_a.world().ptr());
+    REQUIRE(script_b->object.attr("_world").ptr() == python_b.world().ptr());
+
+    python_a.update(entities_a, events_a, static_cast<TimeDelta>(0.1));
+    REQUIRE(entities_a.size() == 2);
+    REQUIRE(entities_b.size() == 1);
+    python_b.update(entities_b, events_b, static_cast<TimeDelta>(0.1));
+    REQUIRE(entities_b.size() == 2);
+
+    // python_b was configured last, but the script spawns into its own world.
+    script_a->object.attr("spawn_child")();
+    REQUIRE(entities_a.size() == 3);
+    REQUIRE(entities_b.size() == 2);
+    entities_a.reset();
+    entities_b.reset();
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE("TestSystemsDestroyedOutOfOrder") {
+  try {
+    auto host = PythonHost::shared();
+    host->add_module("entityx_python_test", &pybind11_init);
+    py::object sys = py::module::import("sys");
+    EventManager events_a, events_b;
+    EntityManager entities_a(events_a), entities_b(events_b);
+    std::unique_ptr<PythonSystem> python_a(new PythonSystem(entities_a, host));
+    std::unique_ptr<PythonSystem> python_b(new PythonSystem(entities_b, host));
+    py::object entityx = py::module::import("_entityx");
+    REQUIRE(!PyObject_HasAttrString(entityx.ptr(), "_world"));
+
+    python_a->configure(events_a);
+    python_b->configure(events_b);
+    REQUIRE(entityx.attr("_world").ptr() == python_b->world().ptr());
+
+    // Destroying the older system leaves the newer one in place...
+    python_a.reset();
+    REQUIRE(entityx.attr("_world").ptr() == python_b->world().ptr());
+
+    // ...and destroying the newer one must not bring back the older one.
+    python_b.reset();
+    REQUIRE(!PyObject_HasAttrString(entityx.ptr(), "_world"));
+    REQUIRE(sys.attr("stdout").ptr() == sys.attr("__stdout__").ptr());
+    REQUIRE(sys.attr("stderr").ptr() == sys.attr("__stderr__").ptr());
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE("TestWorldOutlivesSystem") {
+  try {
+    auto host = PythonHost::shared();
+    host->add_module("entityx_python_test", &pybind11_init);
+    py::object world;
+    {
+      EventManager events;
+      EntityManager entities(events);
+      PythonSystem python(entities, host);
+      python.configure(events);
+      world = python.world();
+      REQUIRE(py::object(world.attr("entity_manager")).ptr() != Py_None);
+    }
+    // A script kept the world: it is still safe to touch, but raises.
+    PyObject *entity_manager = PyObject_GetAttrString(world.ptr(), "entity_manager");
+    REQUIRE(entity_manager == nullptr);
+    REQUIRE(PyErr_ExceptionMatches(PyExc_RuntimeError));
+    PyErr_Clear();
+  }
+  catch ( py::error_already_set& e ) {
+    // TODO(SMA) : Really!? fix this. Should handle execption e better here.
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestRollback") {
+  try {
+    python.register_component<Position>("Position")
+      .field("x", &Position::x)
+      .field("y", &Position::y);
+    python.enable_rollback(4);
+    Entity e = entity_manager.create();
+    e.assign<Position>(0.f, 0.f);
+    auto script = e.assign<PythonScript>("entityx.tests.rollback_test", "RollbackTest");
+    py::object object = script->object;
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    e.component<Position>()->x = 1.f;
+    object.attr("label") = py::str("one");
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.2));
+    REQUIRE(python.frame() == 2);
+
+    e.component<Position>()->x = 2.f;
+    object.attr("label") = py::str("two");
+    object.attr("later") = py::int_(1);
+    Entity spawned = entity_manager.create();
+    spawned.assign<Position>();
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.4));
+
+    python.rollback(2);
+    REQUIRE(python.frame() == 2);
+    REQUIRE(e.valid());
+    REQUIRE(e.component<Position>()->x == 1.f);
+    REQUIRE(!spawned.valid());
+    // The same script object, with its state as of frame 2.
+    REQUIRE(e.component<PythonScript>()->object.ptr() == object.ptr());
+    REQUIRE(py::cast<std::string>(object.attr("label")) == "one");
+    REQUIRE(py::cast<double>(object.attr("elapsed")) == Approx(0.3));
+    REQUIRE(!PyObject_HasAttrString(object.ptr(), "later"));
+
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.5));
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.5));
+    std::vector<uint64_t> replayed;
+    python.resimulate(2, entity_manager, event_manager, [&](uint64_t frame) {
+      replayed.push_back(frame);
+    });
+    REQUIRE(replayed == std::vector<uint64_t>({3, 4}));
+    REQUIRE(python.frame() == 4);
+    REQUIRE(py::cast<double>(object.attr("elapsed")) == Approx(1.3));
+
+    // State that does not pickle is skipped instead of failing the frame,
+    // and rolling back leaves it alone.
+    py::object task = object.attr("ticker")();
+    object.attr("task") = task;
+    python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    python.rollback(5);
+    REQUIRE(object.attr("task").ptr() == task.ptr());
+
+    // Only kept frames can be rolled back to.
+    REQUIRE_THROWS_AS(python.rollback(7), std::runtime_error);
+  }
+  catch ( py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestLoadLevel") {
+  try {
+    python.register_component<Position>("Position")
+      .field("x", &Position::x)
+      .field("y", &Position::y);
+    std::vector<Entity::Id> ids;
+    LoadTiming timing = python.load_level(
+      ENTITYX_PYTHON_TEST_DATA "entityx/tests/level_test.json", &ids);
+    REQUIRE(timing.entities == 4);
+    REQUIRE(ids.size() == 4);
+    Entity plain = entity_manager.get(ids[0]);
+    REQUIRE(plain.component<Position>()->x == 1.5f);
+    REQUIRE(plain.component<Position>()->y == 2.f);
+    REQUIRE(!plain.component<PythonScript>());
+    py::object first;
+    for ( size_t i = 1; i < ids.size(); ++i ) {
+      Entity scripted = entity_manager.get(ids[i]);
+      // Fields left out keep their default.
+      REQUIRE(scripted.component<Position>()->x == 0.f);
+      REQUIRE(scripted.component<Position>()->y == 4.f);
+      py::object object = scripted.component<PythonScript>()->object;
+      REQUIRE(py::cast<int>(object.attr("speed")) == 2);
+      REQUIRE(py::len(object.attr("waypoints")) == 2);
+      if ( first ) {
+        // Copies share nothing mutable.
+        REQUIRE(object.attr("waypoints").ptr() != first.attr("waypoints").ptr());
+      }
+      first = object;
+    }
+
+    // Binary levels may only name allowed globals.
+    const std::string path = "/tmp/entityx_python_level_" + std::to_string(::getpid());
+    first.attr("hook") = py::module::import("os").attr("getcwd");
+    python.save_snapshot(path);
+    REQUIRE_THROWS(python.load_level(path));
+    REQUIRE(entity_manager.size() == 4);
+    PyObject_DelAttrString(first.ptr(), "hook");
+
+    // A saved world loads as a level too.
+    python.save_snapshot(path);
+    entity_manager.reset();
+    REQUIRE(python.load_level(path).entities == 4);
+    REQUIRE(entity_manager.size() == 4);
+    ::unlink(path.c_str());
+
+    {
+      std::ofstream out(path);
+      out << "{\"entities\": [{\"components\": {\"Velocity\": {}}}]}";
+    }
+    REQUIRE_THROWS_AS(python.load_level(path), std::runtime_error);
+    ::unlink(path.c_str());
+  }
+  catch ( py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE("TestPersistentStore") {
+  const std::string path = "/tmp/entityx_python_persistent_" + std::to_string(::getpid());
+  try {
+    auto host = PythonHost::shared();
+    host->add_module("entityx_python_test", &pybind11_init);
+    EventManager events, reopened_events;
+    EntityManager entities(events), reopened_entities(reopened_events);
+    {
+      PythonSystem python(entities, host);
+      python.add_path(ENTITYX_PYTHON_TEST_DATA);
+      python.configure(events);
+      python.register_component<Position>("Position")
+        .field("x", &Position::x)
+        .field("y", &Position::y);
+      REQUIRE(python.persist(path, {"Position"}, 64).empty());
+      // Each spawn from C++ reloads the class; the store does not keep the
+      // old ones alive.
+      Entity temporary = entities.create();
+      py::object cls = temporary.assign<PythonScript>("entityx.tests.persistent_test",
+                                                      "PersistentTest")->object.attr("__class__");
+      py::object ref = py::module::import("weakref").attr("ref")(cls);
+      cls = py::object();
+      python.update(entities, events, static_cast<TimeDelta>(0.1));
+      temporary.destroy();
+      python.update(entities, events, static_cast<TimeDelta>(0.1));
+      py::module::import("gc").attr("collect")();
+      REQUIRE(ref().ptr() == Py_None);
+
+      Entity scripted = entities.create();
+      scripted.assign<PythonScript>("entityx.tests.persistent_test", "PersistentTest");
+      Entity plain = entities.create();
+      plain.assign<Position>(5.f, 6.f);
+      Entity gone = entities.create();
+      gone.assign<Position>();
+      python.update(entities, events, static_cast<TimeDelta>(0.1));
+      gone.destroy();
+      python.update(entities, events, static_cast<TimeDelta>(0.1));
+
+      entities.reset();
+    }
+
+    // As if after a restart.
+    PythonSystem python(reopened_entities, host);
+    python.configure(reopened_events);
+    python.register_component<Position>("Position")
+      .field("x", &Position::x)
+      .field("y", &Position::y);
+    std::vector<Entity::Id> ids = python.persist(path, {"Position"}, 64);
+    REQUIRE(ids.size() == 2);
+    Entity scripted = reopened_entities.get(ids[0]);
+    Entity plain = reopened_entities.get(ids[1]);
+    REQUIRE(scripted.component<Position>()->x == 2.f);
+    REQUIRE(plain.component<Position>()->y == 6.f);
+    REQUIRE(!plain.component<PythonScript>());
+    py::object object = scripted.component<PythonScript>()->object;
+    REQUIRE(py::cast<std::string>(object.attr("__class__").attr("__name__")) == "PersistentTest");
+    // Re-bound, not constructed again.
+    REQUIRE(!PyObject_HasAttrString(object.ptr(), "label"));
+    python.update(reopened_entities, reopened_events, static_cast<TimeDelta>(0.1));
+    REQUIRE(scripted.component<Position>()->x == 3.f);
+
+    // A different layout is refused rather than overwritten, and the store
+    // open so far keeps syncing.
+    REQUIRE_THROWS_AS(python.persist(path, {"Position"}, 128), std::runtime_error);
+    python.update(reopened_entities, reopened_events, static_cast<TimeDelta>(0.1));
+    {
+      EventManager latest_events;
+      EntityManager latest_entities(latest_events);
+      PythonSystem latest(latest_entities, host);
+      latest.configure(latest_events);
+      latest.register_component<Position>("Position")
+        .field("x", &Position::x)
+        .field("y", &Position::y);
+      std::vector<Entity::Id> latest_ids = latest.persist(path, {"Position"}, 64);
+      REQUIRE(latest_ids.size() == 2);
+      REQUIRE(latest_entities.get(latest_ids[0]).component<Position>()->x == 4.f);
+      latest_entities.reset();
+    }
+    reopened_entities.reset();
+  }
+  catch ( py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+  ::unlink(path.c_str());
+}
+
+TEST_CASE("TestReplay") {
+  const std::string path = "/tmp/entityx_python_replay_" + std::to_string(::getpid());
+  try {
+    auto host = PythonHost::shared();
+    host->add_module("entityx_python_test", &pybind11_init);
+    EventManager events, replay_events;
+    EntityManager entities(events), replay_entities(replay_events);
+    PythonSystem python(entities, host), replayer(replay_entities, host);
+    python.add_path(ENTITYX_PYTHON_TEST_DATA);
+    python.configure(events);
+    replayer.configure(replay_events);
+    for ( PythonSystem *system : {&python, &replayer} ) {
+      system->register_component<Position>("Position")
+        .field("x", &Position::x)
+        .field("y", &Position::y);
+    }
+    python.add_event_proxy<Damage>(events, "on_hit");
+    replayer.add_event_proxy<Damage>(replay_events, "on_hit");
+
+    // In the recorded snapshot.
+    Entity plain = entities.create();
+    plain.assign<Position>(1.f, 1.f);
+    Entity doomed = entities.create();
+    doomed.assign<Position>();
+    python.record(path);
+    Entity scripted = entities.create();
+    scripted.assign<PythonScript>("entityx.tests.replay_test", "ReplayTest", 2);
+    // Components C++ assigns before the script are recorded with it.
+    Entity placed = entities.create();
+    placed.assign<Position>(10.f, 0.f);
+    placed.assign<PythonScript>("entityx.tests.replay_test", "ReplayTest", 1);
+    python.update(entities, events, static_cast<TimeDelta>(0.1));
+    // As are C++ destroying entities and changing their components.
+    doomed.destroy();
+    plain.remove<Position>();
+    plain.assign<Position>(7.f, 0.f);
+    events.emit<Damage>(3);
+    python.update(entities, events, static_cast<TimeDelta>(0.2));
+    python.stop_recording();
+    REQUIRE(scripted.component<Position>()->x == Approx(0.6));
+
+    std::vector<uint64_t> frames;
+    REQUIRE(replayer.replay(path, replay_entities, replay_events, [&](uint64_t frame) {
+      frames.push_back(frame);
+    }) == 2);
+    REQUIRE(frames == std::vector<uint64_t>({1, 2}));
+    REQUIRE(replay_entities.size() == 3);
+    int replayed_scripts = 0;
+    replay_entities.each<Position>([&](Entity entity, Position &position) {
+      auto script = entity.component<PythonScript>();
+      if ( !script ) {
+        REQUIRE(position.x == 7.f);
+        return;
+      }
+      ++replayed_scripts;
+      const int speed = py::cast<int>(script->object.attr("speed"));
+      REQUIRE(position.x == Approx(speed == 2 ? 0.6 : 10.3));
+      REQUIRE(py::cast<int>(script->object.attr("damage")) == 3);
+    });
+    REQUIRE(replayed_scripts == 2);
+    REQUIRE(placed.component<Position>()->x == Approx(10.3));
+    entities.reset();
+    replay_entities.reset();
+  }
+  catch ( py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+  ::unlink(path.c_str());
+}
+
+TEST_CASE("TestReplayAsyncUpdate") {
+  const std::string path = "/tmp/entityx_python_replay_async_" + std::to_string(::getpid());
+  try {
+    auto host = PythonHost::shared();
+    host->add_module("entityx_python_test", &pybind11_init);
+    EventManager events, replay_events;
+    EntityManager entities(events), replay_entities(replay_events);
+    PythonSystem python(entities, host), replayer(replay_entities, host);
+    python.add_path(ENTITYX_PYTHON_TEST_DATA);
+    python.configure(events);
+    replayer.configure(replay_events);
+    for ( PythonSystem *system : {&python, &replayer} ) {
+      system->register_component<Position>("Position")
+        .field("x", &Position::x)
+        .field("y", &Position::y);
+    }
+    python.double_buffer<Position>();
+    python.add_event_proxy<Damage>(events, "on_hit");
+    replayer.add_event_proxy<Damage>(replay_events, "on_hit");
+
+    Entity doomed = entities.create();
+    doomed.assign<Position>();
+    Entity scripted = entities.create();
+    scripted.assign<PythonScript>("entityx.tests.replay_test", "ReplayTest", 2);
+    python.record(path);
+    // C++ keeps running while the scripts do, and is recorded.
+    python.start_update(entities, events, static_cast<TimeDelta>(0.1));
+    events.emit<Damage>(3);
+    doomed.destroy();
+    python.finish_update();
+    python.stop_recording();
+    REQUIRE(py::cast<int>(scripted.component<PythonScript>()->object.attr("damage")) == 3);
+
+    REQUIRE(replayer.replay(path, replay_entities, replay_events) == 1);
+    REQUIRE(replay_entities.size() == 1);
+    int replayed_scripts = 0;
+    replay_entities.each<PythonScript>([&](Entity entity, PythonScript &script) {
+      ++replayed_scripts;
+      REQUIRE(entity.component<Position>()->x == Approx(0.2));
+      REQUIRE(py::cast<int>(script.object.attr("damage")) == 3);
+    });
+    REQUIRE(replayed_scripts == 1);
+    entities.reset();
+    replay_entities.reset();
+  }
+  catch ( py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+  ::unlink(path.c_str());
+}
+
+TEST_CASE("TestFrameHashes") {
+  try {
+    auto host = PythonHost::shared();
+    host->add_module("entityx_python_test", &pybind11_init);
+    EventManager events_a, events_b;
+    EntityManager entities_a(events_a), entities_b(events_b);
+    PythonSystem python_a(entities_a, host), python_b(entities_b, host);
+    python_a.add_path(ENTITYX_PYTHON_TEST_DATA);
+    python_a.configure(events_a);
+    python_b.configure(events_b);
+    std::vector<py::object> scripts;
+    typedef std::pair<PythonSystem *, EntityManager *> Run;
+    for ( Run run : {Run(&python_a, &entities_a), Run(&python_b, &entities_b)} ) {
+      run.first->register_component<Position>("Position")
+        .field("x", &Position::x)
+        .field("y", &Position::y);
+      run.first->hash_frames("", {"label", "elapsed"});
+      run.second->create().assign<Position>(1.f, 2.f);
+      Entity scripted = run.second->create();
+      scripts.push_back(
+        scripted.assign<PythonScript>("entityx.tests.rollback_test", "RollbackTest")->object);
+    }
+    // b only rehashes what its tracker finds changed, a everything.
+    python_b.track_changes();
+
+    for ( int frame = 0; frame < 3; ++frame ) {
+      python_a.update(entities_a, events_a, static_cast<TimeDelta>(0.1));
+      python_b.update(entities_b, events_b, static_cast<TimeDelta>(0.1));
+      REQUIRE(python_a.frame_hash() == python_b.frame_hash());
+    }
+    REQUIRE(python_a.frame_hash() != 0);
+
+    // A selected attribute diverges.
+    scripts[1].attr("label") = py::str("other");
+    python_a.update(entities_a, events_a, static_cast<TimeDelta>(0.1));
+    python_b.update(entities_b, events_b, static_cast<TimeDelta>(0.1));
+    REQUIRE(python_a.frame_hash() != python_b.frame_hash());
+
+    // So does a component, written in place and so marked.
+    scripts[1].attr("label") = py::str("new");
+    entities_b.each<Position>([&python_b](Entity entity, Position &position) {
+      position.y += 1.f;
+      python_b.mark_changed(entity.id());
+    });
+    python_a.update(entities_a, events_a, static_cast<TimeDelta>(0.1));
+    python_b.update(entities_b, events_b, static_cast<TimeDelta>(0.1));
+    REQUIRE(python_a.frame_hash() != python_b.frame_hash());
+    entities_a.each<Position>([](Entity, Position &position) { position.y += 1.f; });
+
+    // Containers hash by content, dicts whatever order they were filled in.
+    py::dict first, second;
+    for ( int i = 0; i < 40; ++i ) {
+      first[py::str("key" + std::to_string(i))] = py::int_(i);
+      second[py::str("key" + std::to_string(39 - i))] = py::int_(39 - i);
+    }
+    scripts[0].attr("label") = first;
+    scripts[1].attr("label") = second;
+    python_a.update(entities_a, events_a, static_cast<TimeDelta>(0.1));
+    python_b.update(entities_b, events_b, static_cast<TimeDelta>(0.1));
+    REQUIRE(python_a.frame_hash() == python_b.frame_hash());
+
+    // An object whose repr() is its address can not be hashed.
+    py::module builtins = py::module::import(PY_MAJOR_VERSION < 3 ? "__builtin__" : "builtins");
+    scripts[0].attr("label") = builtins.attr("object")();
+    REQUIRE_THROWS(python_a.update(entities_a, events_a, static_cast<TimeDelta>(0.1)));
+    scripts.clear();
+    entities_a.reset();
+    entities_b.reset();
+  }
+  catch ( py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+TEST_CASE("TestTelemetry") {
+  const std::string path = "/tmp/entityx_python_telemetry_" + std::to_string(::getpid());
+  try {
+    auto host = PythonHost::shared();
+    host->add_module("entityx_python_test", &pybind11_init);
+    EventManager events;
+    EntityManager entities(events);
+    PythonSystem python(entities, host);
+    // Read back with the tool analysts use.
+    python.add_path(std::string(ENTITYX_PYTHON_TEST_DATA) + "tools");
+    python.configure(events);
+    python.register_component<Position>("Position")
+      .field("x", &Position::x)
+      .field("y", &Position::y);
+    REQUIRE_THROWS_AS(python.sample_fields(path, "Position", {"z"}), std::runtime_error);
+    REQUIRE_THROWS_AS(python.sample_fields(path, "Direction", {"x"}), std::runtime_error);
+
+    // Every other frame, two entities per sample and three samples kept.
+    // Four samples fit the in-memory ring, so none are dropped.
+    python.sample_fields(path, "Position", {"x", "y"}, 2, 2, 3);
+    std::vector<Entity> sampled;
+    for ( int i = 0; i < 3; ++i ) {
+      sampled.push_back(entities.create());
+      sampled.back().assign<Position>(static_cast<float>(i), 0.f);
+    }
+    for ( int frame = 0; frame < 8; ++frame ) {
+      entities.each<Position>([](Entity, Position &position) { position.y += 1.f; });
+      python.update(entities, events, static_cast<TimeDelta>(0.1));
+    }
+    python.stop_sampling();
+
+    py::tuple read = py::cast<py::tuple>(py::module::import("telemetry").attr("read_samples")(path));
+    REQUIRE(py::cast<std::string>(read[0]) == "Position");
+    py::list samples = py::cast<py::list>(read[1]);
+    REQUIRE(py::len(samples) == 3);
+    for ( size_t i = 0; i < 3; ++i ) {
+      py::object sample = samples[i];
+      const uint64_t frame = 4 + 2 * i;
+      REQUIRE(py::cast<uint64_t>(sample.attr("frame")) == frame);
+      REQUIRE(py::cast<uint64_t>(sample.attr("total")) == 3);
+      REQUIRE(py::cast<std::vector<uint64_t>>(sample.attr("ids")) ==
+              std::vector<uint64_t>({sampled[0].id().id(), sampled[1].id().id()}));
+      py::dict columns = py::cast<py::dict>(sample.attr("columns"));
+      REQUIRE(py::cast<std::vector<float>>(columns["x"]) == std::vector<float>({0.f, 1.f}));
+      REQUIRE(py::cast<std::vector<float>>(columns["y"]) ==
+              std::vector<float>(2, static_cast<float>(frame)));
+    }
+
+    // With the writer paused, samples beyond the four in memory are dropped
+    // and the rest are written once it resumes.
+    {
+      TelemetryStream stream(entities, *python.components().find("Position"), {"x"}, path,
+                             1, 2, 8);
+      stream.pause();
+      for ( uint64_t frame = 1; frame <= 6; ++frame ) {
+        stream.end_frame(frame);
+      }
+      REQUIRE(stream.dropped() == 2);
+      stream.resume();
+    }
+    read = py::cast<py::tuple>(py::module::import("telemetry").attr("read_samples")(path));
+    samples = py::cast<py::list>(read[1]);
+    REQUIRE(py::len(samples) == 4);
+    for ( size_t i = 0; i < 4; ++i ) {
+      py::object sample = samples[i];
+      REQUIRE(py::cast<uint64_t>(sample.attr("frame")) == i + 1);
+    }
+    entities.reset();
+  }
+  catch ( py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+  ::unlink(path.c_str());
+}
+
+TEST_CASE_METHOD(PythonSystemTest, "TestComponentExport") {
+  const std::string path = "/tmp/entityx_python_export_" + std::to_string(::getpid());
+  const std::string dead = path + "_dead";
+  try {
+    python.register_component<Position>("Position")
+      .field("x", &Position::x)
+      .field("y", &Position::y);
+    REQUIRE_THROWS_AS(python.export_components(path, {"Direction"}, 2), std::runtime_error);
+    python.export_components(path, {"Position"}, 2);
+    std::vector<Entity> exported;
+    for ( int i = 0; i < 3; ++i ) {
+      exported.push_back(entity_manager.create());
+      exported.back().assign<Position>(0.f, static_cast<float>(i));
+    }
+
+    typedef std::vector<ComponentExportReader::View> Views;
+    ComponentExportReader reader(path);
+    std::atomic<bool> done(false), torn(false);
+    // Every frame sets every x to its number, so a whole frame agrees.
+    std::thread monitor([&] {
+      while ( !done ) {
+        bool consistent = true;
+        reader.read([&](uint64_t frame, const Views &views) {
+          consistent = true;
+          for ( size_t row = 0; row < views[0].count; ++row ) {
+            const Position *position = static_cast<const Position *>(views[0].component(row));
+            if ( frame != 0 && position->x != static_cast<float>(frame) )
+              consistent = false;
+          }
+        });
+        if ( !consistent )
+          torn = true;
+      }
+    });
+    for ( int frame = 1; frame <= 200; ++frame ) {
+      entity_manager.each<Position>([&](Entity, Position &position) {
+        position.x = static_cast<float>(frame);
+      });
+      python.update(entity_manager, event_manager, static_cast<TimeDelta>(0.1));
+    }
+    done = true;
+    monitor.join();
+    REQUIRE(!torn);
+
+    reader.read([&](uint64_t frame, const Views &views) {
+      REQUIRE(frame == 200);
+      REQUIRE(views.size() == 1);
+      REQUIRE(views[0].name == "Position");
+      // Cut off at the capacity.
+      REQUIRE(views[0].count == 2);
+      REQUIRE(views[0].total == 3);
+      REQUIRE(views[0].entity(1) == exported[1].id().id());
+      REQUIRE(static_cast<const Position *>(views[0].component(1))->y == 1.f);
+    });
+
+    // A writer that died mid-frame leaves the sequence odd for good.
+    {
+      std::ifstream in(path, std::ios::binary);
+      std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+      ExportHeader header;
+      std::memcpy(&header, data.data(), sizeof(header));
+      header.sequence |= 1;
+      std::memcpy(&data[0], &header, sizeof(header));
+      std::ofstream(dead, std::ios::binary).write(data.data(), data.size());
+    }
+    ComponentExportReader dead_reader(dead);
+    REQUIRE_THROWS_AS(dead_reader.read([](uint64_t, const Views &) {},
+                                       std::chrono::milliseconds(10)),
+                      std::runtime_error);
+
+    python.stop_export();
+    REQUIRE(::access(path.c_str(), F_OK) != 0);
+  }
+  catch ( py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+  ::unlink(path.c_str());
+  ::unlink(dead.c_str());
+}
+
+TEST_CASE("TestDeltaSnapshot") {
+  try {
+    auto host = PythonHost::shared();
+    host->add_module("entityx_python_test", &pybind11_init);
+    EventManager events, spectator_events;
+    EntityManager entities(events), spectator_entities(spectator_events);
+    PythonSystem python(entities, host), spectator(spectator_entities, host);
+    python.add_path(ENTITYX_PYTHON_TEST_DATA);
+    python.configure(events);
+    spectator.configure(spectator_events);
+    for ( PythonSystem *system : {&python, &spectator} ) {
+      system->register_component<Position>("Position")
+        .field("x", &Position::x)
+        .field("y", &Position::y);
+    }
+    python.track_changes();
+
+    Entity scripted = entities.create();
+    auto script = scripted.assign<PythonScript>("entityx.tests.delta_test", "DeltaTest");
+    Entity plain = entities.create();
+    plain.assign<Position>(1.f, 1.f);
+    python.update(entities, events, static_cast<TimeDelta>(0.1));
+    REQUIRE(python.frame() == 1);
+
+    std::string snapshot;
+    python.snapshot(snapshot);
+    SnapshotEntities mapped;
+    REQUIRE(spectator.apply_snapshot(snapshot.data(), snapshot.size(), mapped).size() == 2);
+    Entity remote_scripted = spectator_entities.get(mapped[scripted.id().id()]);
+    Entity remote_plain = spectator_entities.get(mapped[plain.id().id()]);
+    REQUIRE(remote_plain.component<Position>()->x == 1.f);
+
+    // Written from Python and from C++, which has to say so.
+    script->object.attr("position").attr("x") = py::float_(3.f);
+    script->object.attr("label") = py::str("changed");
+    plain.component<Position>()->y = 7.f;
+    python.mark_changed(plain.id());
+    python.update(entities, events, static_cast<TimeDelta>(0.1));
+    python.delta_snapshot(snapshot, 1);
+    REQUIRE(spectator.apply_snapshot(snapshot.data(), snapshot.size(), mapped).size() == 2);
+    REQUIRE(remote_scripted.component<Position>()->x == 3.f);
+    REQUIRE(remote_plain.component<Position>()->y == 7.f);
+    py::object remote_script = remote_scripted.component<PythonScript>()->object;
+    REQUIRE(py::cast<std::string>(remote_script.attr("label")) == "changed");
+
+    // Nothing changed, nothing sent.
+    python.update(entities, events, static_cast<TimeDelta>(0.1));
+    python.delta_snapshot(snapshot, 2);
+    REQUIRE(spectator.apply_snapshot(snapshot.data(), snapshot.size(), mapped).empty());
+
+    // Unmarked C++ writes are missed, unless tracking scans components.
+    plain.component<Position>()->x = 9.f;
+    python.update(entities, events, static_cast<TimeDelta>(0.1));
+    python.delta_snapshot(snapshot, 3);
+    REQUIRE(spectator.apply_snapshot(snapshot.data(), snapshot.size(), mapped).empty());
+    python.track_changes(600, true);
+    python.update(entities, events, static_cast<TimeDelta>(0.1));
+    python.delta_snapshot(snapshot, 4);
+    REQUIRE(spectator.apply_snapshot(snapshot.data(), snapshot.size(), mapped).size() == 1);
+    REQUIRE(remote_plain.component<Position>()->x == 9.f);
+
+    plain.destroy();
+    python.update(entities, events, static_cast<TimeDelta>(0.1));
+    python.delta_snapshot(snapshot, 5);
+    spectator.apply_snapshot(snapshot.data(), snapshot.size(), mapped);
+    REQUIRE(!remote_plain.valid());
+    REQUIRE(spectator_entities.size() == 1);
+    entities.reset();
+    spectator_entities.reset();
+  }
+  catch ( py::error_already_set& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    PyErr_Print();
+    PyErr_Clear();
+    REQUIRE(false);
+  }
+}
+
+// Three scripted entities in a worker process.
+class TestShard : public Shard {
+public:
+  TestShard(size_t index, SharedComponents<Position> &positions)
+    : entity_manager(event_manager), python(entity_manager), index(index),
+      positions(positions) {
+    python.host()->add_module("entityx_python_test", &pybind11_init);
+    python.add_path(ENTITYX_PYTHON_TEST_DATA);
+    python.configure(event_manager);
+    for ( int i = 0; i < 3; ++i ) {
+      entity_manager.create().assign<PythonScript>("entityx.tests.parallel_test", "ParallelTest");
+    }
+  }
+
+  ~TestShard() {
+    entity_manager.reset();
+  }
+
+  void update(TimeDelta dt) override {
+    if ( dt < 0 )
+      throw std::runtime_error("negative time");
+    python.update(entity_manager, event_manager, dt);
+    positions.publish(index, entity_manager);
+  }
+
+private:
+  EventManager event_manager;
+  EntityManager entity_manager;
+  PythonSystem python;
+  size_t index;
+  SharedComponents<Position> &positions;
+};
+
+TEST_CASE("TestShardedWorld") {
+  SharedComponents<Position> positions(
+    "/dev/shm/entityx_python_test_" + std::to_string(::getpid()), 2, 8);
+  ShardedWorld world(2, [&](size_t index, size_t) {
+    return std::unique_ptr<Shard>(new TestShard(index, positions));
+  });
+  REQUIRE(world.size() == 2);
+  world.update(static_cast<TimeDelta>(0.1));
+  world.update(static_cast<TimeDelta>(0.1));
+  for ( size_t shard = 0; shard < 2; ++shard ) {
+    REQUIRE(positions.size(shard) == 3);
+    for ( auto slot = positions.begin(shard); slot != positions.end(shard); ++slot ) {
+      REQUIRE(slot->component.x == 2.f);
+    }
+  }
+
+  bool threw = false;
+  try {
+    world.update(static_cast<TimeDelta>(-1.0));
+  }
+  catch ( const std::runtime_error &e ) {
+    threw = std::string(e.what()) == "shard 0: negative time";
+  }
+  REQUIRE(threw);
+  // Failures leave the shards usable.
+  world.update(static_cast<TimeDelta>(0.1));
+  REQUIRE(positions.begin(1)->component.x == 3.f);
+}
@@ -0,0 +1,208 @@
+// Copyright 2017 Bablawn3d5
+
+#include "entityx/python/ReplayLog.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace entityx {
+namespace python {
+
+namespace {
+
+const char replay_magic[8] = {'E', 'X', 'P', 'Y', 'R', 'E', 'P', 'L'};
+const uint32_t replay_version = 2;
+
+struct ReplayHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t snapshot_size;
+};
+
+std::runtime_error replay_error(const std::string &what) {
+  return std::runtime_error("malformed replay log: " + what);
+}
+
+}  // namespace
+
+thread_local const ReplayRecorder *ReplayRecorder::running_ = nullptr;
+
+void ReplayRecorder::start(const std::string &path, const std::string &snapshot,
+                           const std::vector<Entity::Id> &entities) {
+  stop();
+  out_.open(path, std::ios::binary | std::ios::trunc);
+  if ( !out_ )
+    throw std::runtime_error("failed to open replay log " + path);
+  ReplayHeader header;
+  std::memcpy(header.magic, replay_magic, sizeof(header.magic));
+  header.version = replay_version;
+  header.reserved = 0;
+  header.snapshot_size = snapshot.size();
+  out_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out_.write(snapshot.data(), static_cast<std::streamsize>(snapshot.size()));
+  skipped_ = 0;
+  entities_.clear();
+  next_entity_ = 0;
+  for ( auto id : entities ) {
+    entities_[id.id()] = next_entity_++;
+  }
+}
+
+void ReplayRecorder::stop() {
+  if ( !out_.is_open() )
+    return;
+  out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  buffer_.clear();
+  out_.close();
+  entities_.clear();
+}
+
+void ReplayRecorder::append(const void *data, size_t size) {
+  buffer_.append(static_cast<const char *>(data), size);
+}
+
+void ReplayRecorder::append_string(const char *data, size_t size) {
+  const uint32_t length = static_cast<uint32_t>(size);
+  append(&length, sizeof(length));
+  append(data, size);
+}
+
+void ReplayRecorder::end_frame(TimeDelta dt) {
+  if ( !recording() )
+    return;
+  const ReplayRecord kind = ReplayRecord::Update;
+  const double seconds = static_cast<double>(dt);
+  append(&kind, sizeof(kind));
+  append(&seconds, sizeof(seconds));
+  out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  buffer_.clear();
+  if ( !out_ )
+    throw std::runtime_error("failed to write replay log");
+}
+
+void ReplayRecorder::append_entity(ReplayRecord kind, Entity::Id id) {
+  const uint32_t number = entities_.at(id.id());
+  append(&kind, sizeof(kind));
+  append(&number, sizeof(number));
+}
+
+void ReplayRecorder::create(Entity::Id id) {
+  const ReplayRecord kind = ReplayRecord::Create;
+  append(&kind, sizeof(kind));
+  entities_[id.id()] = next_entity_++;
+}
+
+void ReplayRecorder::spawn(Entity::Id id, const std::string &module, const std::string &cls,
+                           const char *args, size_t size) {
+  append_entity(ReplayRecord::Spawn, id);
+  append_string(module.data(), module.size());
+  append_string(cls.data(), cls.size());
+  append_string(args, size);
+}
+
+void ReplayRecorder::component(Entity::Id id, const std::string &name, const void *data,
+                               size_t size) {
+  append_entity(ReplayRecord::Component, id);
+  append_string(name.data(), name.size());
+  append_string(static_cast<const char *>(data), size);
+}
+
+void ReplayRecorder::remove(Entity::Id id, const std::string &name) {
+  append_entity(ReplayRecord::Remove, id);
+  append_string(name.data(), name.size());
+}
+
+void ReplayRecorder::destroy(Entity::Id id) {
+  if ( !known(id) )
+    return;
+  append_entity(ReplayRecord::Destroy, id);
+  forget(id);
+}
+
+void ReplayRecorder::event(ReplayRecord kind, uint32_t proxy, const void *data, size_t size) {
+  append(&kind, sizeof(kind));
+  append(&proxy, sizeof(proxy));
+  append_string(static_cast<const char *>(data), size);
+}
+
+ReplayReader::ReplayReader(const std::string &path) : position_(0) {
+  file_.open_readonly(path);
+  ReplayHeader header;
+  std::memcpy(&header, take(sizeof(header)), sizeof(header));
+  if ( std::memcmp(header.magic, replay_magic, sizeof(header.magic)) != 0 )
+    throw replay_error("bad magic");
+  if ( header.version != replay_version )
+    throw replay_error("unsupported version " + std::to_string(header.version));
+  snapshot_offset_ = position_;
+  snapshot_size_ = static_cast<size_t>(header.snapshot_size);
+  take(snapshot_size_);
+}
+
+const char *ReplayReader::take(size_t size) {
+  if ( size > file_.size() - position_ )
+    throw replay_error("truncated record");
+  const char *at = file_.data() + position_;
+  position_ += size;
+  return at;
+}
+
+uint32_t ReplayReader::take_size() {
+  uint32_t size;
+  std::memcpy(&size, take(sizeof(size)), sizeof(size));
+  return size;
+}
+
+bool ReplayReader::next(Record &record) {
+  if ( position_ == file_.size() )
+    return false;
+  uint8_t kind;
+  std::memcpy(&kind, take(sizeof(kind)), sizeof(kind));
+  record.kind = static_cast<ReplayRecord>(kind);
+  switch ( record.kind ) {
+    case ReplayRecord::Update: {
+      double seconds;
+      std::memcpy(&seconds, take(sizeof(seconds)), sizeof(seconds));
+      record.dt = static_cast<TimeDelta>(seconds);
+      return true;
+    }
+    case ReplayRecord::Spawn: {
+      record.entity = take_size();
+      uint32_t size = take_size();
+      record.module.assign(take(size), size);
+      size = take_size();
+      record.cls.assign(take(size), size);
+      record.size = take_size();
+      record.data = take(record.size);
+      return true;
+    }
+    case ReplayRecord::Event:
+    case ReplayRecord::QueuedEvent:
+      std::memcpy(&record.proxy, take(sizeof(record.proxy)), sizeof(record.proxy));
+      record.size = take_size();
+      record.data = take(record.size);
+      return true;
+    case ReplayRecord::Create:
+      return true;
+    case ReplayRecord::Component: {
+      record.entity = take_size();
+      const uint32_t size = take_size();
+      record.name.assign(take(size), size);
+      record.size = take_size();
+      record.data = take(record.size);
+      return true;
+    }
+    case ReplayRecord::Remove: {
+      record.entity = take_size();
+      const uint32_t size = take_size();
+      record.name.assign(take(size), size);
+      return true;
+    }
+    case ReplayRecord::Destroy:
+      record.entity = take_size();
+      return true;
+  }
+  throw replay_error("unknown record " + std::to_string(kind));
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,323 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "entityx/Entity.h"
+#include "entityx/python/MappedFile.h"
+
+namespace entityx {
+namespace python {
+
+/**
+ * The kinds of record in a replay log.
+ */
+enum class ReplayRecord : uint8_t {
+  /// update() or finish_update() ended a frame: the time step.
+  Update = 1,
+  /// A PythonScript assigned from C++: entity, module, class and pickled args.
+  Spawn = 2,
+  /// An event sent to Python by the proxy with the given index.
+  Event = 3,
+  /// An event an update() took from a proxy's EventQueue.
+  QueuedEvent = 4,
+  /// C++ gave a script to an entity the log did not know yet.
+  Create = 5,
+  /// A registered component assigned from C++: entity, name and raw component.
+  Component = 6,
+  /// A registered component removed from C++: entity and name.
+  Remove = 7,
+  /// An entity destroyed from C++.
+  Destroy = 8
+};
+
+/**
+ * Writes the fields of an event into a replay log, see ReplayEvent. Only
+ * numbers, enums and strings can be written: entities and their ids are
+ * refused at compile time, since a replay creates its entities anew.
+ */
+class ReplayWriter {
+public:
+  explicit ReplayWriter(std::string &out) : out_(out) {}
+
+  template <typename T>
+  ReplayWriter &operator () (const T &value) {
+    static_assert(!std::is_same<T, Entity>::value && !std::is_same<T, Entity::Id>::value,
+                  "entities can not be replayed: their ids differ in the replay");
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                  "replayed event fields must be numbers, enums or strings");
+    out_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    return *this;
+  }
+
+  ReplayWriter &operator () (const std::string &value) {
+    (*this)(static_cast<uint32_t>(value.size()));
+    out_.append(value);
+    return *this;
+  }
+
+private:
+  std::string &out_;
+};
+
+/// Reads back the fields a ReplayWriter wrote, in the same order.
+class ReplayFields {
+public:
+  ReplayFields(const char *data, size_t size) : data_(data), size_(size) {}
+
+  template <typename T>
+  ReplayFields &operator () (T &value) {
+    static_assert(!std::is_same<T, Entity>::value && !std::is_same<T, Entity::Id>::value,
+                  "entities can not be replayed: their ids differ in the replay");
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                  "replayed event fields must be numbers, enums or strings");
+    std::memcpy(&value, take(sizeof(value)), sizeof(value));
+    return *this;
+  }
+
+  ReplayFields &operator () (std::string &value) {
+    uint32_t size;
+    (*this)(size);
+    value.assign(take(size), size);
+    return *this;
+  }
+
+  /// Throws std::runtime_error unless every field was read.
+  void finish() const {
+    if ( size_ != 0 )
+      throw std::runtime_error("replayed event has the wrong size");
+  }
+
+private:
+  const char *take(size_t size) {
+    if ( size > size_ )
+      throw std::runtime_error("replayed event has the wrong size");
+    const char *at = data_;
+    data_ += size;
+    size_ -= size;
+    return at;
+  }
+
+  const char *data_;
+  size_t size_;
+};
+
+/**
+ * Specialize for every event type that should be recorded and replayed:
+ *
+ *   template <>
+ *   struct ReplayEvent<Damage> {
+ *     static void save(const Damage &event, ReplayWriter &out) {
+ *       out(event.amount);
+ *     }
+ *     static Damage load(ReplayFields &in) {
+ *       Damage event;
+ *       in(event.amount);
+ *       return event;
+ *     }
+ *   };
+ *
+ * Events are written field by field rather than as raw bytes, because an
+ * event's bytes may hold pointers, as entityx::Entity does. Events without
+ * a specialization are counted by ReplayRecorder::skipped().
+ */
+template <typename Event>
+struct ReplayEvent {};
+
+/// Whether ReplayEvent is specialized for `Event`.
+template <typename Event>
+class is_replayable {
+  template <typename T>
+  static std::true_type check(decltype(&ReplayEvent<T>::save));
+  template <typename T>
+  static std::false_type check(...);
+
+public:
+  static const bool value = decltype(check<Event>(nullptr))::value;
+};
+
+/**
+ * Writes what drives a PythonSystem from outside into a compact log, so
+ * the same run can be replayed without the rest of the program.
+ *
+ * A log is the magic "EXPYREPL", a version, a snapshot of the world when
+ * recording started and then unpadded records, each a ReplayRecord byte
+ * followed by:
+ *
+ *   Update       double dt
+ *   Spawn        uint32 entity, then uint32 size and bytes of module, class
+ *                and pickled args
+ *   Event        uint32 proxy index, uint32 size, the event's ReplayEvent fields
+ *   QueuedEvent  as Event
+ *   Create       nothing
+ *   Component    uint32 entity, uint32 size and bytes of the name and the
+ *                raw component
+ *   Remove       uint32 entity, uint32 size and bytes of the name
+ *   Destroy      uint32 entity
+ *
+ * Entities are numbered in the order the log meets them: the snapshot's in
+ * snapshot order, then one per Create. Registered components an entity
+ * has when C++ gives it a script are recorded right after its Create, so
+ * the replayed script finds them when it is constructed. Later component
+ * changes and destruction from C++ are recorded for numbered entities.
+ *
+ * Only what comes from outside the scripts is recorded: events emitted and
+ * entities spawned by a thread while it runs scripts or their handlers are
+ * taken to be caused by the scripts, and happen again on replay. What other
+ * threads do meanwhile, e.g. C++ between start_update() and
+ * finish_update(), is recorded as if done before that frame. Events need a
+ * ReplayEvent specialization to be recorded; others are counted by
+ * skipped().
+ *
+ * Records are buffered and written when a frame ends.
+ */
+class ReplayRecorder {
+public:
+  ReplayRecorder() : next_entity_(0), skipped_(0) {}
+
+  /**
+   * Start a log at `path` from a snapshot of the world. `entities` are the
+   * snapshot's entities in snapshot order.
+   */
+  void start(const std::string &path, const std::string &snapshot,
+             const std::vector<Entity::Id> &entities);
+
+  /// Write what is buffered and close the log.
+  void stop();
+
+  bool recording() const {
+    return out_.is_open();
+  }
+
+  /// Whether something happening now is recorded: outside scripts and handlers.
+  bool external() const {
+    return recording() && running_ != this;
+  }
+
+  void end_frame(TimeDelta dt);
+
+  /// Whether the log has numbered `id`.
+  bool known(Entity::Id id) const {
+    return entities_.count(id.id()) != 0;
+  }
+
+  /// Number `id`, which the log did not know yet.
+  void create(Entity::Id id);
+
+  /// `id` got a script; it must be known.
+  void spawn(Entity::Id id, const std::string &module, const std::string &cls, const char *args,
+             size_t size);
+
+  void component(Entity::Id id, const std::string &name, const void *data, size_t size);
+
+  void remove(Entity::Id id, const std::string &name);
+
+  /// Record that C++ destroyed `id` if it is known.
+  void destroy(Entity::Id id);
+
+  /// Stop numbering `id`, which the scripts destroyed.
+  void forget(Entity::Id id) {
+    entities_.erase(id.id());
+  }
+
+  void event(ReplayRecord kind, uint32_t proxy, const void *data, size_t size);
+
+  /// Count an event that could not be recorded.
+  void skip() {
+    ++skipped_;
+  }
+
+  size_t skipped() const {
+    return skipped_;
+  }
+
+  /**
+   * Marks the current thread as running scripts, or delivering events to
+   * their handlers, while in scope.
+   */
+  class Running {
+  public:
+    explicit Running(const ReplayRecorder *recorder) : previous_(running_) {
+      if ( recorder )
+        running_ = recorder;
+    }
+
+    ~Running() {
+      running_ = previous_;
+    }
+
+  private:
+    const ReplayRecorder *previous_;
+  };
+
+private:
+  void append(const void *data, size_t size);
+  void append_string(const char *data, size_t size);
+  // The record of `kind` followed by the number of `id`.
+  void append_entity(ReplayRecord kind, Entity::Id id);
+
+  std::ofstream out_;
+  // The number of every entity the log knows, by id.
+  std::unordered_map<uint64_t, uint32_t> entities_;
+  uint32_t next_entity_;
+  std::string buffer_;
+  size_t skipped_;
+  // The recorder whose scripts the current thread runs, if any.
+  static thread_local const ReplayRecorder *running_;
+};
+
+/**
+ * Reads a log written by ReplayRecorder from a memory-mapped file. Throws
+ * std::runtime_error if it is malformed.
+ */
+class ReplayReader {
+public:
+  struct Record {
+    ReplayRecord kind;
+    TimeDelta dt;
+    uint32_t proxy;
+    // The number of the entity spawned, changed or destroyed.
+    uint32_t entity;
+    std::string module;
+    std::string cls;
+    // The component assigned or removed.
+    std::string name;
+    // The pickled args of a spawn, the event or the raw component, inside
+    // the log.
+    const char *data;
+    size_t size;
+  };
+
+  explicit ReplayReader(const std::string &path);
+
+  const char *snapshot() const {
+    return file_.data() + snapshot_offset_;
+  }
+
+  size_t snapshot_size() const {
+    return snapshot_size_;
+  }
+
+  /// Read the next record; false at the end of the log.
+  bool next(Record &record);
+
+private:
+  const char *take(size_t size);
+  uint32_t take_size();
+
+  MappedFile file_;
+  size_t snapshot_offset_;
+  size_t snapshot_size_;
+  size_t position_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,78 @@
+// Copyright 2017 Bablawn3d5
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "entityx/python/ScriptArchive.h"
+
+namespace entityx {
+namespace python {
+
+#pragma pack(push, 1)
+struct ScriptArchiveHeader {
+  char magic[8];          // "EXPYARC\0"
+  uint32_t version;
+  uint32_t count;
+  uint32_t python_magic;
+  uint32_t reserved;
+};
+
+struct ScriptArchive::Entry {
+  uint32_t name_offset;
+  uint32_t name_size;
+  uint64_t code_offset;
+  uint64_t code_size;
+  uint32_t flags;
+  uint32_t reserved;
+};
+#pragma pack(pop)
+
+static const char SCRIPT_ARCHIVE_MAGIC[8] = { 'E', 'X', 'P', 'Y', 'A', 'R', 'C', '\0' };
+static const uint32_t SCRIPT_ARCHIVE_VERSION = 1;
+static const uint32_t SCRIPT_ARCHIVE_PACKAGE = 1;
+
+ScriptArchive::ScriptArchive(const std::string &path)
+  : entries_(nullptr), count_(0), python_magic_(0) {
+  file_.open_readonly(path);
+  ScriptArchiveHeader header;
+  if ( file_.size() < sizeof(header) )
+    throw std::runtime_error(path + " is not a script archive");
+  std::memcpy(&header, file_.data(), sizeof(header));
+  if ( std::memcmp(header.magic, SCRIPT_ARCHIVE_MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != SCRIPT_ARCHIVE_VERSION )
+    throw std::runtime_error(path + " is not a script archive");
+  if ( sizeof(header) + header.count * sizeof(Entry) > file_.size() )
+    throw std::runtime_error(path + " is truncated");
+
+  entries_ = reinterpret_cast<const Entry *>(file_.data() + sizeof(header));
+  count_ = header.count;
+  python_magic_ = header.python_magic;
+  for ( uint32_t i = 0; i < count_; ++i ) {
+    const Entry &entry = entries_[i];
+    if ( entry.name_offset + static_cast<uint64_t>(entry.name_size) > file_.size() ||
+         entry.code_offset + entry.code_size > file_.size() )
+      throw std::runtime_error(path + " is truncated");
+  }
+}
+
+bool ScriptArchive::find(const std::string &name, Module &module) const {
+  // The index is sorted by name, so binary search it in place.
+  const char *data = file_.data();
+  const Entry *end = entries_ + count_;
+  const Entry *entry = std::lower_bound(entries_, end, name,
+    [data](const Entry &entry, const std::string &name) {
+      const size_t size = std::min<size_t>(entry.name_size, name.size());
+      const int order = std::memcmp(data + entry.name_offset, name.data(), size);
+      return order < 0 || (order == 0 && entry.name_size < name.size());
+    });
+  if ( entry == end || entry->name_size != name.size() ||
+       std::memcmp(data + entry->name_offset, name.data(), name.size()) != 0 )
+    return false;
+  module.code = data + entry->code_offset;
+  module.size = static_cast<size_t>(entry->code_size);
+  module.package = (entry->flags & SCRIPT_ARCHIVE_PACKAGE) != 0;
+  return true;
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,55 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "entityx/python/MappedFile.h"
+
+namespace entityx {
+namespace python {
+
+/**
+ * A memory-mapped archive of precompiled Python modules, built with
+ * tools/bundle.py.
+ *
+ * PythonSystem::add_archive() installs an import hook that serves modules
+ * straight from the mapping, so importing them neither scans sys.path nor
+ * compiles source. Throws std::runtime_error if the file is not an archive.
+ */
+class ScriptArchive {
+public:
+  struct Module {
+    const char *code;   // Marshalled code object.
+    size_t size;
+    bool package;
+  };
+
+  explicit ScriptArchive(const std::string &path);
+
+  /**
+   * Look up a module by its full dotted name.
+   */
+  bool find(const std::string &name, Module &module) const;
+
+  bool contains(const std::string &name) const {
+    Module module;
+    return find(name, module);
+  }
+
+  /// The bytecode magic of the interpreter that built the archive.
+  uint32_t python_magic() const { return python_magic_; }
+  size_t size() const { return count_; }
+  const std::string &path() const { return file_.path(); }
+
+private:
+  struct Entry;
+
+  MappedFile file_;
+  const Entry *entries_;
+  uint32_t count_;
+  uint32_t python_magic_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,133 @@
+// Copyright 2017 Bablawn3d5
+
+#include "entityx/python/ScriptJobs.h"
+
+namespace entityx {
+namespace python {
+
+py::object JobFuture::result() const {
+  if ( !done_ )
+    throw std::runtime_error("job is not done yet");
+  if ( !error_.empty() )
+    throw std::runtime_error(error_);
+  return value_;
+}
+
+void JobFuture::then(py::object callback) {
+  if ( !done_ ) {
+    callbacks_.push_back(callback);
+    return;
+  }
+  // then() is called from Python, so this finds the existing wrapper.
+  callback(py::cast(this, py::return_value_policy::reference));
+}
+
+ScriptJobs::ScriptJobs(PythonHost &host) : host_(host), next_id_(0), running_(0) {}
+
+ScriptJobs::~ScriptJobs() {
+  wait();
+}
+
+void ScriptJobs::set_pool(std::shared_ptr<JobPool> pool) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pool_ = pool;
+}
+
+std::shared_ptr<JobFuture> ScriptJobs::submit(const std::string &name, const py::args &args) {
+  Binder binder;
+  std::shared_ptr<JobPool> pool;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = binders_.find(name);
+    if ( found == binders_.end() )
+      throw std::runtime_error("unknown job: " + name);
+    binder = found->second;
+    if ( !pool_ )
+      pool_ = host_.job_pool();
+    pool = pool_;
+  }
+  Work work = binder(args);
+  auto future = std::make_shared<JobFuture>();
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    id = next_id_++;
+    pending_[id] = future;
+    ++running_;
+  }
+  pool->submit([this, id, work]() {
+    Finished finished;
+    finished.id = id;
+    try {
+      finished.result = work();
+    }
+    catch ( const std::exception &e ) {
+      finished.error = e.what();
+    }
+    catch ( ... ) {
+      finished.error = "job failed";
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_.push_back(std::move(finished));
+    if ( --running_ == 0 )
+      idle_.notify_all();
+  });
+  return future;
+}
+
+void ScriptJobs::resolve() {
+  std::vector<Finished> finished;
+  std::vector<std::shared_ptr<JobFuture>> futures;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished.swap(finished_);
+    for ( auto &job : finished ) {
+      auto found = pending_.find(job.id);
+      futures.push_back(found->second);
+      pending_.erase(found);
+    }
+  }
+  for ( size_t i = 0; i < finished.size(); ++i ) {
+    JobFuture &future = *futures[i];
+    future.error_ = finished[i].error;
+    if ( future.error_.empty() ) {
+      try {
+        future.value_ = finished[i].result();
+      }
+      catch ( const std::exception &e ) {
+        future.error_ = e.what();
+      }
+    }
+    future.done_ = true;
+    for ( auto &callback : future.callbacks_ ) {
+      callbacks_.push_back(std::make_pair(callback, futures[i]));
+    }
+    future.callbacks_.clear();
+  }
+  while ( !callbacks_.empty() ) {
+    auto next = callbacks_.front();
+    callbacks_.pop_front();
+    next.first(py::cast(next.second));
+  }
+}
+
+void ScriptJobs::clear() {
+  wait();
+  std::unordered_map<uint64_t, std::shared_ptr<JobFuture>> pending;
+  std::vector<Finished> finished;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending.swap(pending_);
+    finished.swap(finished_);
+  }
+  // Released outside the mutex, as dropping callbacks may run Python code.
+  callbacks_.clear();
+}
+
+void ScriptJobs::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this]() { return running_ == 0; });
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,164 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "entityx/python/JobPool.h"
+#include "entityx/python/PythonHost.h"
+
+namespace py = pybind11;
+
+namespace entityx {
+namespace python {
+
+/**
+ * The result of a job submitted from Python, bound as `_entityx.Future`.
+ */
+class JobFuture {
+public:
+  JobFuture() : done_(false) {}
+
+  bool done() const {
+    return done_;
+  }
+
+  /// The job's result. Throws std::runtime_error if it failed or is not done.
+  py::object result() const;
+
+  /// Call `callback(future)` once the job is done, or now if it already is.
+  void then(py::object callback);
+
+private:
+  friend class ScriptJobs;
+
+  bool done_;
+  py::object value_;
+  std::string error_;
+  std::vector<py::object> callbacks_;
+};
+
+/**
+ * Named C++ jobs that scripts run on a JobPool.
+ *
+ * Arguments are converted from Python when a job is submitted and the result
+ * is converted back when it is resolved, both on the scripting thread. The
+ * job itself runs on a worker without the GIL, so argument and result types
+ * must be plain C++ types, never py::object.
+ */
+class ScriptJobs {
+public:
+  /// Runs jobs on the host's job_pool() unless set_pool() is called.
+  explicit ScriptJobs(PythonHost &host);
+  /// Waits for running jobs. Call clear() first, with the GIL.
+  ~ScriptJobs();
+
+  ScriptJobs(const ScriptJobs &) = delete;
+  ScriptJobs &operator = (const ScriptJobs &) = delete;
+
+  /**
+   * Register `job` as `name`. Exceptions thrown by the job fail its future
+   * with the exception's message.
+   */
+  template <typename Result, typename... Args>
+  void add(const std::string &name, std::function<Result(Args...)> job) {
+    static_assert(!std::is_void<Result>::value, "jobs must return a result");
+    std::lock_guard<std::mutex> lock(mutex_);
+    binders_[name] = [name, job](const py::args &args) {
+      if ( args.size() != sizeof...(Args) ) {
+        throw std::runtime_error("job " + name + " takes " +
+                                 std::to_string(sizeof...(Args)) + " arguments");
+      }
+      return bind(job, args, typename MakeIndices<sizeof...(Args)>::type());
+    };
+  }
+
+  template <typename Result, typename... Args>
+  void add(const std::string &name, Result (*job)(Args...)) {
+    add(name, std::function<Result(Args...)>(job));
+  }
+
+  /// Run jobs on `pool` instead of the host's.
+  void set_pool(std::shared_ptr<JobPool> pool);
+
+  /**
+   * Queue the job registered as `name`. Requires the GIL. Throws
+   * std::runtime_error for unknown jobs or a wrong number of arguments.
+   */
+  std::shared_ptr<JobFuture> submit(const std::string &name, const py::args &args);
+
+  /**
+   * Resolve the futures of jobs finished since the last call and run their
+   * callbacks. Requires the GIL. If a callback raises, the remaining ones
+   * run on the next call.
+   */
+  void resolve();
+
+  /// Wait for running jobs and drop every future and callback. Requires the GIL.
+  void clear();
+
+private:
+  // Converts a job result to Python, with the GIL.
+  typedef std::function<py::object()> Converter;
+  // Runs a job with its arguments bound, on a worker.
+  typedef std::function<Converter()> Work;
+  // Converts Python arguments and binds them to a job, with the GIL.
+  typedef std::function<Work(const py::args &)> Binder;
+
+  template <size_t...> struct Indices {};
+  template <size_t N, size_t... Is>
+  struct MakeIndices : MakeIndices<N - 1, N - 1, Is...> {};
+  template <size_t... Is>
+  struct MakeIndices<0, Is...> {
+    typedef Indices<Is...> type;
+  };
+
+  template <typename Result, typename... Args, size_t... Is>
+  static Work bind(const std::function<Result(Args...)> &job, const py::args &args,
+                   Indices<Is...>) {
+    (void)args;
+    auto values = std::make_shared<std::tuple<typename std::decay<Args>::type...>>(
+      py::object(args[Is]).template cast<typename std::decay<Args>::type>()...);
+    return [job, values]() -> Converter {
+      auto result = std::make_shared<Result>(job(std::get<Is>(*values)...));
+      return [result]() { return py::cast(*result); };
+    };
+  }
+
+  struct Finished {
+    uint64_t id;
+    Converter result;
+    std::string error;
+  };
+
+  void wait();
+
+  PythonHost &host_;
+  std::mutex mutex_;
+  std::condition_variable idle_;
+  std::unordered_map<std::string, Binder> binders_;
+  std::shared_ptr<JobPool> pool_;
+  uint64_t next_id_;
+  size_t running_;
+  // Futures of queued and running jobs, owned here so that they are only
+  // released with the GIL.
+  std::unordered_map<uint64_t, std::shared_ptr<JobFuture>> pending_;
+  std::vector<Finished> finished_;
+  // Callbacks of resolved futures not run yet.
+  std::deque<std::pair<py::object, std::shared_ptr<JobFuture>>> callbacks_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,223 @@
+// Copyright 2017 Bablawn3d5
+
+// NOTE: Python must be included first.
+#include "entityx/python/PythonHost.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "entityx/python/ShardedWorld.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace entityx {
+namespace python {
+
+#ifndef _WIN32
+
+namespace {
+
+// Sent both ways over each worker's socket.
+struct Message {
+  enum Type : int32_t { Ready, Update, Done, Failed, Quit };
+
+  int32_t type;
+  double dt;
+  char error[256];
+};
+
+Message make_message(int32_t type, const char *error = "") {
+  Message message;
+  std::memset(&message, 0, sizeof(message));
+  message.type = type;
+  std::strncpy(message.error, error, sizeof(message.error) - 1);
+  return message;
+}
+
+bool send_message(int socket, const Message &message) {
+  int flags = 0;
+#ifdef MSG_NOSIGNAL
+  // A worker that died must not take the coordinator down with SIGPIPE.
+  flags = MSG_NOSIGNAL;
+#endif
+  const char *data = reinterpret_cast<const char *>(&message);
+  size_t sent = 0;
+  while ( sent < sizeof(message) ) {
+    ssize_t result = ::send(socket, data + sent, sizeof(message) - sent, flags);
+    if ( result < 0 && errno == EINTR )
+      continue;
+    if ( result <= 0 )
+      return false;
+    sent += static_cast<size_t>(result);
+  }
+  return true;
+}
+
+bool receive_message(int socket, Message &message) {
+  char *data = reinterpret_cast<char *>(&message);
+  size_t received = 0;
+  while ( received < sizeof(message) ) {
+    ssize_t result = ::recv(socket, data + received, sizeof(message) - received, 0);
+    if ( result < 0 && errno == EINTR )
+      continue;
+    if ( result <= 0 )
+      return false;
+    received += static_cast<size_t>(result);
+  }
+  return true;
+}
+
+// fork(), keeping an initialized interpreter consistent in both processes.
+pid_t fork_process() {
+  // Otherwise both processes would write out what is still buffered.
+  std::fflush(nullptr);
+  if ( !Py_IsInitialized() )
+    return ::fork();
+  PythonHost::Lock lock(*PythonHost::shared());
+#if PY_VERSION_HEX >= 0x03070000
+  PyOS_BeforeFork();
+  const pid_t pid = ::fork();
+  if ( pid == 0 ) {
+    PyOS_AfterFork_Child();
+  } else {
+    PyOS_AfterFork_Parent();
+  }
+#else
+  const pid_t pid = ::fork();
+  if ( pid == 0 )
+    PyOS_AfterFork();
+#endif
+  return pid;
+}
+
+// The body of a worker process. Never returns.
+void run_worker(int socket, size_t index, size_t count, const ShardedWorld::Factory &factory) {
+  int status = 0;
+  try {
+    std::unique_ptr<Shard> shard = factory(index, count);
+    if ( !send_message(socket, make_message(Message::Ready)) )
+      ::_exit(1);
+    Message command;
+    while ( receive_message(socket, command) && command.type == Message::Update ) {
+      Message reply = make_message(Message::Done);
+      try {
+        shard->update(command.dt);
+      }
+      catch ( const std::exception &e ) {
+        reply = make_message(Message::Failed, e.what());
+      }
+      if ( !send_message(socket, reply) )
+        break;
+    }
+  }
+  catch ( const std::exception &e ) {
+    send_message(socket, make_message(Message::Failed, e.what()));
+    status = 1;
+  }
+  // Skip the coordinator's atexit handlers and static destructors.
+  std::fflush(nullptr);
+  ::_exit(status);
+}
+
+}  // namespace
+
+ShardedWorld::ShardedWorld(size_t processes, Factory factory) {
+  for ( size_t index = 0; index < processes; ++index ) {
+    int sockets[2];
+    if ( ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0 ) {
+      stop();
+      throw std::runtime_error(std::string("failed to create a shard socket: ") +
+                               std::strerror(errno));
+    }
+    const pid_t pid = fork_process();
+    if ( pid < 0 ) {
+      ::close(sockets[0]);
+      ::close(sockets[1]);
+      stop();
+      throw std::runtime_error(std::string("failed to start a shard: ") + std::strerror(errno));
+    }
+    if ( pid == 0 ) {
+      ::close(sockets[0]);
+      for ( auto &worker : workers_ ) {
+        ::close(worker.socket);
+      }
+      run_worker(sockets[1], index, processes, factory);
+    }
+    ::close(sockets[1]);
+    Worker worker = { static_cast<int>(pid), sockets[0] };
+    workers_.push_back(worker);
+  }
+  try {
+    wait_for_replies();
+  }
+  catch ( ... ) {
+    stop();
+    throw;
+  }
+}
+
+ShardedWorld::~ShardedWorld() {
+  stop();
+}
+
+void ShardedWorld::update(TimeDelta dt) {
+  Message command = make_message(Message::Update);
+  command.dt = dt;
+  for ( auto &worker : workers_ ) {
+    send_message(worker.socket, command);
+  }
+  wait_for_replies();
+}
+
+void ShardedWorld::wait_for_replies() {
+  // Read every reply even after a failure, so the next frame starts clean.
+  std::string error;
+  for ( size_t index = 0; index < workers_.size(); ++index ) {
+    Message reply;
+    if ( !receive_message(workers_[index].socket, reply) ) {
+      if ( error.empty() )
+        error = "shard " + std::to_string(index) + " exited";
+    } else if ( reply.type == Message::Failed && error.empty() ) {
+      error = "shard " + std::to_string(index) + ": " + reply.error;
+    }
+  }
+  if ( !error.empty() )
+    throw std::runtime_error(error);
+}
+
+void ShardedWorld::stop() {
+  for ( auto &worker : workers_ ) {
+    send_message(worker.socket, make_message(Message::Quit));
+    ::close(worker.socket);
+  }
+  for ( auto &worker : workers_ ) {
+    int status;
+    while ( ::waitpid(static_cast<pid_t>(worker.pid), &status, 0) < 0 && errno == EINTR ) {}
+  }
+  workers_.clear();
+}
+
+#else
+
+ShardedWorld::ShardedWorld(size_t processes, Factory factory) {
+  throw std::runtime_error("ShardedWorld is not supported on this platform");
+}
+
+ShardedWorld::~ShardedWorld() {}
+
+void ShardedWorld::update(TimeDelta dt) {}
+
+void ShardedWorld::wait_for_replies() {}
+
+void ShardedWorld::stop() {}
+
+#endif
+
+}  // namespace python
+}  // namespace entityx
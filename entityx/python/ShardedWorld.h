@@ -0,0 +1,76 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "entityx/Entity.h"
+
+namespace entityx {
+namespace python {
+
+/**
+ * One part of a ShardedWorld, living in its own worker process. Typically
+ * owns an EntityManager, an EventManager and a PythonSystem.
+ */
+class Shard {
+public:
+  virtual ~Shard() {}
+
+  /// Advance the shard by one frame, e.g. update its systems and publish
+  /// its SharedComponents.
+  virtual void update(TimeDelta dt) = 0;
+};
+
+/**
+ * A world split across worker processes, each with its own interpreter.
+ *
+ * The constructor forks one worker per shard and builds its Shard there
+ * with `factory(index, count)`. Share state with the coordinator through
+ * SharedComponents created before the ShardedWorld; everything else stays
+ * in the worker. Workers are forked, so create the ShardedWorld while the
+ * coordinator runs no other threads; an initialized interpreter is
+ * prepared for the fork as os.fork() would. POSIX only.
+ */
+class ShardedWorld {
+public:
+  typedef std::function<std::unique_ptr<Shard>(size_t index, size_t count)> Factory;
+
+  /**
+   * Start `processes` workers and wait until each has built its Shard.
+   * Throws std::runtime_error if a worker can not be started or its factory
+   * throws.
+   */
+  ShardedWorld(size_t processes, Factory factory);
+  /// Destroy every Shard and wait for the workers to exit.
+  ~ShardedWorld();
+
+  ShardedWorld(const ShardedWorld &) = delete;
+  ShardedWorld &operator = (const ShardedWorld &) = delete;
+
+  size_t size() const {
+    return workers_.size();
+  }
+
+  /**
+   * Update every shard by one frame and wait for all of them. Throws
+   * std::runtime_error naming the first shard that failed or exited.
+   */
+  void update(TimeDelta dt);
+
+private:
+  struct Worker {
+    int pid;
+    int socket;
+  };
+
+  void stop();
+  void wait_for_replies();
+
+  std::vector<Worker> workers_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,126 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "entityx/Entity.h"
+#include "entityx/python/MappedFile.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace entityx {
+namespace python {
+
+/**
+ * One component type of every shard of a ShardedWorld, in shared memory.
+ *
+ * The coordinator creates the pool before starting the shards; each shard
+ * publishes its components into its own region after updating, and the
+ * coordinator reads them in place between ShardedWorld::update() calls.
+ * `path` should be on a memory-backed file system such as /dev/shm; the
+ * coordinator removes the file when the pool is destroyed.
+ *
+ * publish() copies every component of a shard, once per update. EntityX
+ * allocates its component pools itself, so they cannot be placed in shared
+ * memory and read without the copy. The cost grows with the number of
+ * components (see BenchmarkSharedPublish), so only share the components
+ * the coordinator actually reads.
+ */
+template <typename Component>
+class SharedComponents {
+public:
+  static_assert(std::is_trivially_copyable<Component>::value,
+                "shared components must be trivially copyable");
+
+  struct Slot {
+    /// Entity::Id::id() of the owning entity, unique within its shard.
+    uint64_t entity;
+    Component component;
+  };
+
+  /// @param capacity Maximum number of components per shard.
+  SharedComponents(const std::string &path, size_t shards, size_t capacity)
+    : shards_(shards), capacity_(capacity) {
+    file_.open(path, slots_offset() + shards * capacity * sizeof(Slot));
+    for ( size_t shard = 0; shard < shards; ++shard ) {
+      counts()[shard] = 0;
+    }
+  }
+
+  ~SharedComponents() {
+#ifndef _WIN32
+    if ( file_.is_open() )
+      ::unlink(file_.path().c_str());
+#endif
+  }
+
+  SharedComponents(const SharedComponents &) = delete;
+  SharedComponents &operator = (const SharedComponents &) = delete;
+
+  size_t shards() const {
+    return shards_;
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  /**
+   * Called by shard `shard`: replace its region with every Component of
+   * `entities`. Throws std::runtime_error if they do not fit.
+   */
+  void publish(size_t shard, EntityManager &entities) {
+    Slot *slots = region(shard);
+    size_t count = 0;
+    entities.each<Component>([&](Entity entity, Component &component) {
+      if ( count == capacity_ )
+        throw std::runtime_error("shared component pool is full: " + file_.path());
+      slots[count].entity = entity.id().id();
+      slots[count].component = component;
+      ++count;
+    });
+    counts()[shard] = count;
+  }
+
+  /// Number of components shard `shard` published last.
+  size_t size(size_t shard) const {
+    return static_cast<size_t>(counts()[shard]);
+  }
+
+  const Slot *begin(size_t shard) const {
+    return region(shard);
+  }
+
+  const Slot *end(size_t shard) const {
+    return region(shard) + size(shard);
+  }
+
+private:
+  // The per-shard counts come first, then the slots of each shard.
+  size_t slots_offset() const {
+    const size_t bytes = shards_ * sizeof(uint64_t);
+    return (bytes + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+  }
+
+  uint64_t *counts() const {
+    return reinterpret_cast<uint64_t *>(const_cast<char *>(file_.data()));
+  }
+
+  Slot *region(size_t shard) const {
+    char *slots = const_cast<char *>(file_.data()) + slots_offset();
+    return reinterpret_cast<Slot *>(slots) + shard * capacity_;
+  }
+
+  size_t shards_;
+  size_t capacity_;
+  MappedFile file_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,70 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "entityx/Entity.h"
+
+namespace entityx {
+namespace python {
+
+/**
+ * The snapshots of the last few frames, oldest overwritten first.
+ *
+ * Each slot keeps its buffer, so once it has grown to the size of the
+ * world, saving into it copies without reallocating. Saving still
+ * allocates: the entity list, the script states and their pickle are made
+ * anew every frame.
+ */
+class SnapshotRing {
+public:
+  struct Entry {
+    Entry() : frame(0), dt(0), valid(false) {}
+
+    uint64_t frame;
+    // The time step of the update() that ended the frame.
+    TimeDelta dt;
+    bool valid;
+    std::string data;
+  };
+
+  explicit SnapshotRing(size_t size = 0) : entries_(size) {}
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+  /// The entry to save `frame` into, replacing the oldest one.
+  Entry &push(uint64_t frame, TimeDelta dt) {
+    Entry &entry = entries_[frame % entries_.size()];
+    entry.frame = frame;
+    entry.dt = dt;
+    entry.valid = true;
+    return entry;
+  }
+
+  /// The snapshot of `frame`, or null if it is no longer kept.
+  const Entry *find(uint64_t frame) const {
+    if ( entries_.empty() )
+      return nullptr;
+    const Entry &entry = entries_[frame % entries_.size()];
+    return entry.valid && entry.frame == frame ? &entry : nullptr;
+  }
+
+  /// Forget the frames after `frame`.
+  void truncate(uint64_t frame) {
+    for ( auto &entry : entries_ ) {
+      if ( entry.frame > frame )
+        entry.valid = false;
+    }
+  }
+
+private:
+  std::vector<Entry> entries_;
+};
+
+}  // namespace python
+}  // namespace entityx
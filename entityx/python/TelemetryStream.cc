@@ -0,0 +1,246 @@
+// Copyright 2017 Bablawn3d5
+
+#include "entityx/python/TelemetryStream.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace entityx {
+namespace python {
+
+const size_t TelemetryStream::ring_blocks;
+
+namespace {
+
+const char telemetry_magic[8] = {'E', 'X', 'P', 'Y', 'T', 'E', 'L', 'E'};
+const uint32_t telemetry_version = 1;
+
+struct TelemetryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t columns;
+  uint64_t capacity;
+  uint64_t slots;
+  uint64_t block_size;
+  uint64_t every;
+  uint64_t written;
+  char component[64];
+};
+
+struct TelemetryColumn {
+  char name[48];
+  uint32_t type;
+  uint32_t size;
+  uint64_t offset;
+};
+
+struct BlockHeader {
+  uint64_t sequence;
+  uint64_t frame;
+  uint64_t count;
+  uint64_t total;
+};
+
+size_t padded(size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+size_t field_size(FieldType type) {
+  switch ( type ) {
+    case FieldType::Bool:
+      return sizeof(bool);
+    case FieldType::Int32:
+    case FieldType::UInt32:
+      return sizeof(uint32_t);
+    case FieldType::Int64:
+    case FieldType::UInt64:
+      return sizeof(uint64_t);
+    case FieldType::Float:
+      return sizeof(float);
+    case FieldType::Double:
+      return sizeof(double);
+  }
+  return 0;
+}
+
+void copy_name(char *field, size_t size, const std::string &text) {
+  if ( text.size() >= size )
+    throw std::runtime_error("name too long for telemetry: " + text);
+  std::memset(field, 0, size);
+  std::memcpy(field, text.data(), text.size());
+}
+
+}  // namespace
+
+TelemetryStream::TelemetryStream(EntityManager &entities, const ComponentInfo &component,
+                                 const std::vector<std::string> &fields,
+                                 const std::string &path, size_t every, size_t capacity,
+                                 size_t slots)
+  : entities_(entities), component_(component), every_(every), capacity_(capacity),
+    slots_(slots), sequence_(0), synced_(0), dropped_(0), stopping_(false),
+    paused_(false) {
+  if ( every == 0 || capacity == 0 || slots == 0 )
+    throw std::runtime_error("telemetry needs a non-zero interval, capacity and slots");
+  for ( auto &name : fields ) {
+    const FieldInfo *found = nullptr;
+    for ( auto &field : component.fields() ) {
+      if ( field.name == name )
+        found = &field;
+    }
+    if ( !found )
+      throw std::runtime_error("no field " + name + " registered on " + component.name());
+    fields_.push_back(*found);
+  }
+
+  size_t offset = sizeof(BlockHeader) + capacity * sizeof(uint64_t);
+  for ( auto &field : fields_ ) {
+    columns_.push_back(offset);
+    offset += padded(capacity * field_size(field.type));
+  }
+  block_size_ = offset;
+  data_offset_ = padded(sizeof(TelemetryHeader) + fields_.size() * sizeof(TelemetryColumn));
+
+  file_.open(path, data_offset_ + slots * block_size_);
+  std::memset(file_.data(), 0, data_offset_);
+  TelemetryHeader *header = reinterpret_cast<TelemetryHeader *>(file_.data());
+  std::memcpy(header->magic, telemetry_magic, sizeof(header->magic));
+  header->version = telemetry_version;
+  header->columns = static_cast<uint32_t>(fields_.size());
+  header->capacity = capacity;
+  header->slots = slots;
+  header->block_size = block_size_;
+  header->every = every;
+  header->written = 0;
+  copy_name(header->component, sizeof(header->component), component.name());
+  TelemetryColumn *column = reinterpret_cast<TelemetryColumn *>(header + 1);
+  for ( size_t f = 0; f < fields_.size(); ++f, ++column ) {
+    copy_name(column->name, sizeof(column->name), fields_[f].name);
+    column->type = static_cast<uint32_t>(fields_[f].type);
+    column->size = static_cast<uint32_t>(field_size(fields_[f].type));
+    column->offset = columns_[f];
+  }
+  // Slots left over from an earlier, larger stream must not look written.
+  for ( size_t slot = 0; slot < slots; ++slot ) {
+    std::memset(file_.data() + data_offset_ + slot * block_size_, 0, sizeof(BlockHeader));
+  }
+
+  blocks_.resize(ring_blocks);
+  for ( size_t i = 0; i < ring_blocks; ++i ) {
+    blocks_[i].resize(block_size_);
+    free_.push_back(i);
+  }
+  writer_ = std::thread(&TelemetryStream::run, this);
+}
+
+TelemetryStream::~TelemetryStream() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  ready_cv_.notify_one();
+  writer_.join();
+  file_.sync(true);
+}
+
+void TelemetryStream::sample(uint64_t frame) {
+  size_t index;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if ( free_.empty() ) {
+      ++dropped_;
+      return;
+    }
+    index = free_.back();
+    free_.pop_back();
+  }
+
+  char *block = blocks_[index].data();
+  uint64_t *ids = reinterpret_cast<uint64_t *>(block + sizeof(BlockHeader));
+  uint64_t count = 0;
+  uint64_t total = 0;
+  component_.each(entities_, [&](Entity::Id id, void *data) {
+    ++total;
+    if ( count == capacity_ )
+      return;
+    const char *bytes = static_cast<const char *>(data);
+    ids[count] = id.id();
+    for ( size_t f = 0; f < fields_.size(); ++f ) {
+      const size_t size = field_size(fields_[f].type);
+      std::memcpy(block + columns_[f] + count * size, bytes + fields_[f].offset, size);
+    }
+    ++count;
+  });
+  BlockHeader *header = reinterpret_cast<BlockHeader *>(block);
+  header->frame = frame;
+  header->count = count;
+  header->total = total;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ready_.push_back(index);
+  }
+  ready_cv_.notify_one();
+}
+
+void TelemetryStream::pause() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  paused_ = true;
+}
+
+void TelemetryStream::resume() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    paused_ = false;
+  }
+  ready_cv_.notify_one();
+}
+
+void TelemetryStream::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for ( ;; ) {
+    // Stopping writes what is queued even while paused.
+    ready_cv_.wait(lock, [this] { return stopping_ || (!paused_ && !ready_.empty()); });
+    if ( ready_.empty() )
+      return;
+    while ( !ready_.empty() && (!paused_ || stopping_) ) {
+      const size_t index = ready_.front();
+      ready_.pop_front();
+      lock.unlock();
+      publish(blocks_[index]);
+      lock.lock();
+      free_.push_back(index);
+    }
+    if ( sequence_ - synced_ >= slots_ ) {
+      synced_ = sequence_;
+      lock.unlock();
+      file_.sync();
+      lock.lock();
+    }
+  }
+}
+
+void TelemetryStream::publish(std::vector<char> &block) {
+  const BlockHeader *sampled = reinterpret_cast<const BlockHeader *>(block.data());
+  char *slot = file_.data() + data_offset_ + (sequence_ % slots_) * block_size_;
+  BlockHeader *header = reinterpret_cast<BlockHeader *>(slot);
+  const size_t rows = static_cast<size_t>(sampled->count);
+
+  // Zero the sequence while the slot is rewritten, so readers skip it.
+  __atomic_store_n(&header->sequence, 0, __ATOMIC_RELEASE);
+  std::atomic_thread_fence(std::memory_order_release);
+  header->frame = sampled->frame;
+  header->count = sampled->count;
+  header->total = sampled->total;
+  // Only the rows that were filled in.
+  std::memcpy(slot + sizeof(BlockHeader), block.data() + sizeof(BlockHeader),
+              rows * sizeof(uint64_t));
+  for ( size_t f = 0; f < fields_.size(); ++f ) {
+    std::memcpy(slot + columns_[f], block.data() + columns_[f], rows * field_size(fields_[f].type));
+  }
+  ++sequence_;
+  __atomic_store_n(&header->sequence, sequence_, __ATOMIC_RELEASE);
+  TelemetryHeader *file_header = reinterpret_cast<TelemetryHeader *>(file_.data());
+  __atomic_store_n(&file_header->written, sequence_, __ATOMIC_RELEASE);
+}
+
+}  // namespace python
+}  // namespace entityx
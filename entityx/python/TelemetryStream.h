@@ -0,0 +1,118 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "entityx/Entity.h"
+#include "entityx/python/ComponentRegistry.hpp"
+#include "entityx/python/MappedFile.h"
+
+namespace entityx {
+namespace python {
+
+/**
+ * Samples registered fields of one component type for every entity that
+ * has it, every few frames, into a memory-mapped file that others can read
+ * while the world runs.
+ *
+ * Samples are copied column by column into one of a few in-memory blocks
+ * on the updating thread; a background thread copies finished blocks into
+ * the file. If the writer falls behind, samples are dropped and counted
+ * rather than blocking the update. Readers map the same pages, so they see
+ * samples without an msync; the writer only msyncs once per `slots`
+ * samples and when stopped, which bounds what a crash loses.
+ *
+ * The file is a header followed by a ring of `slots` fixed-size blocks,
+ * all native-endian:
+ *
+ *   header  magic "EXPYTELE", version, column count, capacity, slots,
+ *           block size, sample interval, blocks written, component name,
+ *           then per column its field name, FieldType, value size and
+ *           offset within a block
+ *   block   sequence + 1 (0 while being written), frame, row count and
+ *           how many entities had the component, then `capacity` uint64
+ *           entity ids and `capacity` values per column
+ *
+ * Block n of the stream is written to slot n % slots. A reader copies a
+ * block and keeps it if its sequence was the same before and after.
+ * tools/telemetry.py reads the file.
+ */
+class TelemetryStream {
+public:
+  /**
+   * @param capacity Rows per sample; entities beyond it are left out.
+   * @param slots Samples kept in the file.
+   */
+  TelemetryStream(EntityManager &entities, const ComponentInfo &component,
+                  const std::vector<std::string> &fields, const std::string &path,
+                  size_t every, size_t capacity, size_t slots);
+  ~TelemetryStream();
+
+  TelemetryStream(const TelemetryStream &) = delete;
+  TelemetryStream &operator = (const TelemetryStream &) = delete;
+
+  /// Sample if `frame` is one of every `every` frames.
+  void end_frame(uint64_t frame) {
+    if ( frame % every_ == 0 )
+      sample(frame);
+  }
+
+  const std::string &path() const {
+    return file_.path();
+  }
+
+  /**
+   * Stop copying samples into the file, e.g. while it is copied elsewhere.
+   * Samples beyond the in-memory ring are dropped until resume().
+   */
+  void pause();
+
+  void resume();
+
+  /// Samples dropped because the writer was behind or paused.
+  uint64_t dropped() const {
+    return dropped_;
+  }
+
+private:
+  static const size_t ring_blocks = 4;
+
+  void sample(uint64_t frame);
+  void run();
+  void publish(std::vector<char> &block);
+
+  EntityManager &entities_;
+  const ComponentInfo &component_;
+  std::vector<FieldInfo> fields_;
+  std::vector<size_t> columns_;
+  const uint64_t every_;
+  const size_t capacity_;
+  const size_t slots_;
+  size_t block_size_;
+  size_t data_offset_;
+  MappedFile file_;
+  uint64_t sequence_;
+  // Written by the writer thread only.
+  uint64_t synced_;
+  std::atomic<uint64_t> dropped_;
+
+  std::mutex mutex_;
+  std::condition_variable ready_cv_;
+  bool stopping_;
+  bool paused_;
+  std::vector<std::vector<char>> blocks_;
+  std::vector<size_t> free_;
+  std::deque<size_t> ready_;
+  std::thread writer_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,72 @@
+// Copyright 2017 Bablawn3d5
+
+#include <algorithm>
+#include "entityx/python/ThreadPool.h"
+
+namespace entityx {
+namespace python {
+
+ThreadPool::ThreadPool(size_t threads)
+  : tasks_(nullptr), next_(0), pending_(0), stop_(false) {
+  threads = std::max<size_t>(threads, 1);
+  for ( size_t i = 0; i < threads; ++i ) {
+    workers_.push_back(std::thread([this]() { work(); }));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  ready_.notify_all();
+  for ( auto &worker : workers_ ) {
+    worker.join();
+  }
+}
+
+void ThreadPool::run(const std::vector<Task> &tasks) {
+  if ( tasks.empty() )
+    return;
+  std::lock_guard<std::mutex> batch(run_mutex_);
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    tasks_ = &tasks;
+    next_ = 0;
+    pending_ = tasks.size();
+    error_ = nullptr;
+    ready_.notify_all();
+    done_.wait(lock, [this]() { return pending_ == 0; });
+    tasks_ = nullptr;
+    std::swap(error, error_);
+  }
+  if ( error )
+    std::rethrow_exception(error);
+}
+
+void ThreadPool::work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for ( ;; ) {
+    ready_.wait(lock, [this]() { return stop_ || (tasks_ && next_ < tasks_->size()); });
+    if ( stop_ )
+      return;
+    const Task &task = (*tasks_)[next_++];
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      task();
+    }
+    catch ( ... ) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    if ( error && !error_ )
+      error_ = error;
+    if ( --pending_ == 0 )
+      done_.notify_all();
+  }
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,60 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace entityx {
+namespace python {
+
+/**
+ * A fixed set of worker threads that run batches of tasks.
+ *
+ * Tasks do not hold any Python lock; take a PythonHost::Lock inside a task
+ * before touching Python objects.
+ */
+class ThreadPool {
+public:
+  typedef std::function<void()> Task;
+
+  /// @param threads Number of workers, at least one.
+  explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator = (const ThreadPool &) = delete;
+
+  size_t size() const {
+    return workers_.size();
+  }
+
+  /**
+   * Run every task on the workers and block until all have finished. If
+   * tasks throw, the first exception is rethrown once the batch is done.
+   * Batches from different threads run one after another.
+   */
+  void run(const std::vector<Task> &tasks);
+
+private:
+  void work();
+
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::condition_variable done_;
+  const std::vector<Task> *tasks_;
+  size_t next_;
+  size_t pending_;
+  std::exception_ptr error_;
+  bool stop_;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace python
+}  // namespace entityx
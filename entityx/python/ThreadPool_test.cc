@@ -0,0 +1,80 @@
+// Copyright 2017 Bablawn3d5
+
+#define CATCH_CONFIG_MAIN
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include "entityx/python/3rdparty/catch.hpp"
+#include "entityx/python/JobPool.h"
+#include "entityx/python/ThreadPool.h"
+
+using namespace entityx::python;
+
+TEST_CASE("TestThreadPoolRunsEveryTask") {
+  ThreadPool pool(4);
+  REQUIRE(pool.size() == 4);
+  std::atomic<int> sum(0);
+  std::vector<ThreadPool::Task> tasks;
+  for ( int i = 1; i <= 100; ++i ) {
+    tasks.push_back([&sum, i]() { sum += i; });
+  }
+  for ( int batch = 0; batch < 10; ++batch ) {
+    pool.run(tasks);
+  }
+  REQUIRE(sum == 10 * 5050);
+}
+
+TEST_CASE("TestThreadPoolRethrows") {
+  ThreadPool pool(2);
+  std::atomic<int> ran(0);
+  std::vector<ThreadPool::Task> tasks;
+  for ( int i = 0; i < 8; ++i ) {
+    tasks.push_back([&ran, i]() {
+      ++ran;
+      if ( i == 3 )
+        throw std::runtime_error("task failed");
+    });
+  }
+  bool threw = false;
+  try {
+    pool.run(tasks);
+  }
+  catch ( const std::runtime_error& ) {
+    threw = true;
+  }
+  REQUIRE(threw);
+  // The rest of the batch still ran, and the pool is still usable.
+  REQUIRE(ran == 8);
+  pool.run(std::vector<ThreadPool::Task>(1, [&ran]() { ++ran; }));
+  REQUIRE(ran == 9);
+}
+
+TEST_CASE("TestJobPoolRunsNestedJobs") {
+  std::atomic<int> sum(0);
+  std::mutex mutex;
+  std::condition_variable done;
+  int remaining = 100 * 10;
+  {
+    JobPool pool(4);
+    REQUIRE(pool.size() == 4);
+    for ( int i = 0; i < 100; ++i ) {
+      // Each job queues more on its own worker, for the others to steal.
+      pool.submit([&, i]() {
+        for ( int j = 0; j < 10; ++j ) {
+          pool.submit([&, i]() {
+            sum += i;
+            std::lock_guard<std::mutex> lock(mutex);
+            if ( --remaining == 0 )
+              done.notify_all();
+          });
+        }
+      });
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]() { return remaining == 0; });
+  }
+  REQUIRE(sum == 10 * 4950);
+}
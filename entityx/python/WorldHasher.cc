@@ -0,0 +1,341 @@
+// Copyright 2017 Bablawn3d5
+
+#include "entityx/python/WorldHasher.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "entityx/python/PythonScript.hpp"
+
+namespace entityx {
+namespace python {
+
+namespace {
+
+const char hash_magic[8] = {'E', 'X', 'P', 'Y', 'H', 'A', 'S', 'H'};
+const uint64_t hash_version = 1;
+
+// The splitmix64 finalizer.
+uint64_t mix(uint64_t h) {
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+size_t field_size(FieldType type) {
+  switch ( type ) {
+    case FieldType::Bool:
+      return sizeof(bool);
+    case FieldType::Int32:
+    case FieldType::UInt32:
+      return sizeof(uint32_t);
+    case FieldType::Int64:
+    case FieldType::UInt64:
+      return sizeof(uint64_t);
+    case FieldType::Float:
+      return sizeof(float);
+    case FieldType::Double:
+      return sizeof(double);
+  }
+  return 0;
+}
+
+// Registered fields skip the padding between them, which may hold anything.
+uint64_t hash_component(const ComponentInfo &info, const void *data, uint64_t seed) {
+  if ( info.fields().empty() )
+    return hash_bytes(data, info.size(), seed);
+  const char *bytes = static_cast<const char *>(data);
+  uint64_t h = seed;
+  for ( auto &field : info.fields() ) {
+    h = mix(h ^ hash_bytes(bytes + field.offset, field_size(field.type), seed));
+  }
+  return h;
+}
+
+// An entity's share of the frame hash.
+uint64_t term(uint64_t id, uint64_t hash) {
+  return mix(id ^ mix(hash));
+}
+
+// Keeps hashing a container that holds itself from overflowing the stack.
+struct RecursionGuard {
+  RecursionGuard()
+    : entered(Py_EnterRecursiveCall(const_cast<char *>(" while hashing a frame")) == 0) {}
+  ~RecursionGuard() {
+    if ( entered )
+      Py_LeaveRecursiveCall();
+  }
+
+  bool entered;
+};
+
+void write(std::ofstream &out, const void *data, size_t size) {
+  out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+}
+
+}  // namespace
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed) {
+  const char *bytes = static_cast<const char *>(data);
+  uint64_t h = mix(seed ^ (size * 0x9e3779b97f4a7c15ULL));
+  size_t i = 0;
+  for ( ; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t) ) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, sizeof(word));
+    h = mix(h ^ word);
+  }
+  if ( i < size ) {
+    uint64_t word = 0;
+    std::memcpy(&word, bytes + i, size - i);
+    h = mix(h ^ word);
+  }
+  return h;
+}
+
+void WorldHasher::enable(const std::string &path, const std::vector<std::string> &attributes) {
+  disable();
+  for ( auto &name : attributes ) {
+    attributes_.push_back(py::str(name));
+  }
+  if ( !path.empty() ) {
+    out_.open(path, std::ios::binary | std::ios::trunc);
+    if ( !out_ )
+      throw std::runtime_error("failed to open frame hash log " + path);
+    write(out_, hash_magic, sizeof(hash_magic));
+    write(out_, &hash_version, sizeof(hash_version));
+  }
+  enabled_ = true;
+}
+
+void WorldHasher::disable() {
+  enabled_ = false;
+  tracked_ = 0;
+  attributes_.clear();
+  if ( out_.is_open() )
+    out_.close();
+}
+
+uint64_t WorldHasher::hash_value(PyObject *value) const {
+  if ( value == Py_None )
+    return mix(0x4e6f6e65);
+  // Before ints, as bools are ints.
+  if ( PyBool_Check(value) )
+    return mix(value == Py_True ? 1 : 2);
+  if ( PyFloat_Check(value) ) {
+    const double number = PyFloat_AS_DOUBLE(value);
+    return hash_bytes(&number, sizeof(number), 0xf1);
+  }
+#if PY_MAJOR_VERSION < 3
+  if ( PyInt_Check(value) ) {
+    const long long number = PyInt_AS_LONG(value);
+    return hash_bytes(&number, sizeof(number), 0x17);
+  }
+#endif
+  if ( PyLong_Check(value) ) {
+    int overflow = 0;
+    const long long number = PyLong_AsLongLongAndOverflow(value, &overflow);
+    if ( overflow == 0 && !(number == -1 && PyErr_Occurred()) )
+      return hash_bytes(&number, sizeof(number), 0x17);
+    PyErr_Clear();
+  }
+  if ( PyBytes_Check(value) )
+    return hash_bytes(PyBytes_AS_STRING(value), static_cast<size_t>(PyBytes_GET_SIZE(value)), 0x57);
+  if ( PyUnicode_Check(value) ) {
+    py::object utf8 = py::reinterpret_steal<py::object>(PyUnicode_AsUTF8String(value));
+    if ( !utf8 )
+      throw py::error_already_set();
+    return hash_value(utf8.ptr());
+  }
+  // Copied first, as hashing an element may run code that changes them.
+  if ( PyTuple_Check(value) || PyList_Check(value) || PyDict_Check(value) ||
+       PyAnySet_Check(value) ) {
+    RecursionGuard guard;
+    if ( !guard.entered )
+      throw py::error_already_set();
+    if ( PyDict_Check(value) ) {
+      py::object items = py::reinterpret_steal<py::object>(PyDict_Items(value));
+      if ( !items )
+        throw py::error_already_set();
+      // Summed, so the order the items are visited in does not matter.
+      uint64_t sum = 0;
+      const Py_ssize_t size = PyList_GET_SIZE(items.ptr());
+      for ( Py_ssize_t i = 0; i < size; ++i ) {
+        PyObject *item = PyList_GET_ITEM(items.ptr(), i);
+        const uint64_t key = hash_value(PyTuple_GET_ITEM(item, 0));
+        sum += mix(mix(key ^ 0xd1) ^ hash_value(PyTuple_GET_ITEM(item, 1)));
+      }
+      return mix(sum ^ mix(0xd1c7 + static_cast<uint64_t>(size)));
+    }
+    py::object items = py::reinterpret_steal<py::object>(PySequence_Tuple(value));
+    if ( !items )
+      throw py::error_already_set();
+    const Py_ssize_t size = PyTuple_GET_SIZE(items.ptr());
+    if ( PyAnySet_Check(value) ) {
+      uint64_t sum = 0;
+      for ( Py_ssize_t i = 0; i < size; ++i ) {
+        sum += mix(hash_value(PyTuple_GET_ITEM(items.ptr(), i)) ^ 0x5e);
+      }
+      return mix(sum ^ mix(0x5e7 + static_cast<uint64_t>(size)));
+    }
+    uint64_t h = mix(0x5e9 + static_cast<uint64_t>(size));
+    for ( Py_ssize_t i = 0; i < size; ++i ) {
+      h = mix(h ^ hash_value(PyTuple_GET_ITEM(items.ptr(), i)));
+    }
+    return h;
+  }
+  py::object repr = py::reinterpret_steal<py::object>(PyObject_Repr(value));
+  if ( !repr )
+    throw py::error_already_set();
+  py::object text = repr;
+  if ( PyUnicode_Check(repr.ptr()) ) {
+    text = py::reinterpret_steal<py::object>(PyUnicode_AsUTF8String(repr.ptr()));
+    if ( !text )
+      throw py::error_already_set();
+  }
+  // A default repr holds the object's address, which differs between runs.
+  if ( std::strstr(PyBytes_AS_STRING(text.ptr()), " at 0x") ) {
+    PyErr_Format(PyExc_TypeError, "can not hash a %s for a frame hash, give it a __repr__",
+                 Py_TYPE(value)->tp_name);
+    throw py::error_already_set();
+  }
+  return mix(hash_value(text.ptr()) ^ 0x7e);
+}
+
+uint64_t WorldHasher::hash_script(const py::object &script) const {
+  const char *cls = Py_TYPE(script.ptr())->tp_name;
+  uint64_t h = hash_bytes(cls, std::strlen(cls), 0xc1);
+  for ( auto &name : attributes_ ) {
+    PyObject *value = PyObject_GetAttr(script.ptr(), name.ptr());
+    if ( !value ) {
+      PyErr_Clear();
+      h = mix(h ^ 0xab5e47);
+      continue;
+    }
+    py::object held = py::reinterpret_steal<py::object>(value);
+    h = mix(h ^ hash_value(value));
+  }
+  return h;
+}
+
+void WorldHasher::set(Entity::Id id, bool present, uint64_t hash) {
+  const size_t index = id.index();
+  if ( index >= ids_.size() ) {
+    if ( !present )
+      return;
+    ids_.resize(index + 1, 0);
+    hashes_.resize(index + 1, 0);
+  }
+  // A present entity replaces whatever held its index before.
+  if ( ids_[index] != 0 && (present || ids_[index] == id.id()) ) {
+    world_ -= term(ids_[index], hashes_[index]);
+    --count_;
+    ids_[index] = 0;
+  }
+  if ( present ) {
+    ids_[index] = id.id();
+    hashes_[index] = hash;
+    world_ += term(ids_[index], hash);
+    ++count_;
+  }
+}
+
+void WorldHasher::rehash() {
+  std::fill(hashes_.begin(), hashes_.end(), 0);
+  std::fill(ids_.begin(), ids_.end(), 0);
+  auto entity_hash = [this](Entity::Id id) -> uint64_t & {
+    const size_t index = id.index();
+    if ( index >= hashes_.size() ) {
+      hashes_.resize(index + 1, 0);
+      ids_.resize(index + 1, 0);
+    }
+    ids_[index] = id.id();
+    return hashes_[index];
+  };
+
+  const auto &components = components_.components();
+  for ( size_t c = 0; c < components.size(); ++c ) {
+    const ComponentInfo &info = *components[c];
+    const uint64_t seed = c + 1;
+    info.each(entities_, [&](Entity::Id id, void *data) {
+      uint64_t &h = entity_hash(id);
+      h = mix(h ^ hash_component(info, data, seed));
+    });
+  }
+  entities_.each<PythonScript>([&](Entity entity, PythonScript &script) {
+    if ( !script.object )
+      return;
+    uint64_t &h = entity_hash(entity.id());
+    h = mix(h ^ hash_script(script.object));
+  });
+
+  world_ = 0;
+  count_ = 0;
+  for ( size_t index = 0; index < ids_.size(); ++index ) {
+    if ( ids_[index] == 0 )
+      continue;
+    world_ += term(ids_[index], hashes_[index]);
+    ++count_;
+  }
+}
+
+void WorldHasher::update(uint64_t since) {
+  for ( Entity::Id id : tracker_.removed(since) ) {
+    set(id, false, 0);
+  }
+  const auto &components = components_.components();
+  for ( Entity::Id id : tracker_.changed(since) ) {
+    if ( !entities_.valid(id) ) {
+      set(id, false, 0);
+      continue;
+    }
+    // In the same order as rehash() combines them.
+    bool present = false;
+    uint64_t h = 0;
+    for ( size_t c = 0; c < components.size(); ++c ) {
+      const void *data = components[c]->get(entities_, id);
+      if ( !data )
+        continue;
+      h = mix(h ^ hash_component(*components[c], data, c + 1));
+      present = true;
+    }
+    auto script = entities_.component<PythonScript>(id);
+    if ( script && script->object ) {
+      h = mix(h ^ hash_script(script->object));
+      present = true;
+    }
+    set(id, present, h);
+  }
+}
+
+void WorldHasher::commit(uint64_t frame) {
+  // Cleared first, so a frame that fails to hash is rehashed in full.
+  const uint64_t since = tracked_;
+  tracked_ = 0;
+  if ( tracker_.enabled() && since != 0 )
+    update(since);
+  else
+    rehash();
+  tracked_ = tracker_.enabled() ? tracker_.frame() : 0;
+  hash_ = mix(world_ ^ count_);
+
+  if ( out_.is_open() ) {
+    log_.clear();
+    for ( size_t index = 0; index < ids_.size(); ++index ) {
+      if ( ids_[index] == 0 )
+        continue;
+      log_.push_back(ids_[index]);
+      log_.push_back(hashes_[index]);
+    }
+    write(out_, &frame, sizeof(frame));
+    write(out_, &hash_, sizeof(hash_));
+    write(out_, &count_, sizeof(count_));
+    write(out_, log_.data(), log_.size() * sizeof(uint64_t));
+    if ( !out_ )
+      throw std::runtime_error("failed to write frame hash log");
+  }
+}
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,103 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "entityx/Entity.h"
+#include "entityx/python/ChangeTracker.h"
+#include "entityx/python/ComponentRegistry.hpp"
+
+namespace py = pybind11;
+
+namespace entityx {
+namespace python {
+
+/// A fast 64 bit hash of `size` bytes, the same on every run.
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed);
+
+/**
+ * Hashes every entity's registered components and chosen script
+ * attributes at the end of each frame, to show two runs stayed identical.
+ *
+ * An entity's hash covers its registered components in registration order,
+ * field by field when fields are registered so padding does not count,
+ * else as raw bytes; then its script's class and the chosen attributes.
+ * Floats are hashed by their bits, ints, strings and None by value, lists
+ * and tuples element by element, and dicts and sets independently of their
+ * iteration order. Other objects are hashed by their repr(), and hashing
+ * fails with a TypeError for objects that only have the default repr, as it
+ * holds their address. Python's own hash() is randomized per process, so it
+ * is not used.
+ *
+ * The frame's hash combines the entity hashes independently of their
+ * order. While a ChangeTracker is enabled only the entities it found
+ * changed or removed are rehashed, so a frame costs what changed; the rules
+ * for what it notices apply to the hashed attributes too. Otherwise the
+ * whole world is rehashed every frame.
+ *
+ * With a path, every frame is appended to a log for tools/hashdiff.py:
+ * the magic "EXPYHASH", a version, then per frame its number, hash and
+ * entity count followed by an (entity id, hash) pair per entity, all
+ * native-endian uint64.
+ */
+class WorldHasher {
+public:
+  WorldHasher(EntityManager &entities, const ComponentRegistry &components,
+              const ChangeTracker &tracker)
+    : entities_(entities), components_(components), tracker_(tracker), enabled_(false),
+      hash_(0), world_(0), count_(0), tracked_(0) {}
+
+  /// Start hashing, logging to `path` unless it is empty. Requires the GIL.
+  void enable(const std::string &path, const std::vector<std::string> &attributes);
+
+  /// Stop hashing and close the log. Requires the GIL.
+  void disable();
+
+  bool enabled() const {
+    return enabled_;
+  }
+
+  /// The hash of the last committed frame.
+  uint64_t hash() const {
+    return hash_;
+  }
+
+  /// Hash the world as of the end of `frame`. Requires the GIL.
+  void commit(uint64_t frame);
+
+private:
+  uint64_t hash_value(PyObject *value) const;
+  uint64_t hash_script(const py::object &script) const;
+  // Hash every entity.
+  void rehash();
+  // Rehash the entities the tracker found changed or removed after `since`.
+  void update(uint64_t since);
+  // Replace the hash of `id`'s index; `present` is false if it has none.
+  void set(Entity::Id id, bool present, uint64_t hash);
+
+  EntityManager &entities_;
+  const ComponentRegistry &components_;
+  const ChangeTracker &tracker_;
+  bool enabled_;
+  uint64_t hash_;
+  // The sum of the entity terms and their number, kept between frames.
+  uint64_t world_;
+  uint64_t count_;
+  // The tracker frame the hashes are up to date with; 0 when they must be
+  // rehashed in full.
+  uint64_t tracked_;
+  std::vector<py::object> attributes_;
+  std::ofstream out_;
+  // Per entity index, the id (0 if none) and hash as of the last commit.
+  std::vector<uint64_t> hashes_;
+  std::vector<uint64_t> ids_;
+  std::vector<uint64_t> log_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -0,0 +1,307 @@
+// Copyright 2017 Bablawn3d5
+
+#include "entityx/python/WorldSerializer.h"
+#include <algorithm>
+#include <stdexcept>
+#include "entityx/python/PythonScript.hpp"
+
+namespace entityx {
+namespace python {
+
+// Whether an attribute name starts with '_'. Non-string names count as
+// private too.
+static bool is_private(PyObject *name) {
+#if PY_MAJOR_VERSION >= 3
+  if ( !PyUnicode_Check(name) )
+    return true;
+  return PyUnicode_GET_LENGTH(name) == 0 || PyUnicode_READ_CHAR(name, 0) == '_';
+#else
+  if ( !PyString_Check(name) )
+    return true;
+  return PyString_GET_SIZE(name) == 0 || PyString_AS_STRING(name)[0] == '_';
+#endif
+}
+
+void class_key(PyTypeObject *type, std::string &key) {
+  key.clear();
+  PyObject *module = type->tp_dict ? PyDict_GetItemString(type->tp_dict, "__module__") : nullptr;
+#if PY_MAJOR_VERSION >= 3
+  if ( module && PyUnicode_Check(module) ) {
+    Py_ssize_t size = 0;
+    const char *text = PyUnicode_AsUTF8AndSize(module, &size);
+    if ( text )
+      key.append(text, static_cast<size_t>(size));
+    else
+      PyErr_Clear();
+  }
+#else
+  if ( module && PyString_Check(module) )
+    key.append(PyString_AS_STRING(module), static_cast<size_t>(PyString_GET_SIZE(module)));
+#endif
+  key += ':';
+  // The __name__ of classes defined in Python.
+  key += type->tp_name;
+}
+
+py::object pickle_module() {
+#if PY_MAJOR_VERSION >= 3
+  return py::module::import("pickle");
+#else
+  return py::module::import("cPickle");
+#endif
+}
+
+// Globals that pickles of plain data refer to. Protocol 2 names the
+// builtins module __builtin__ on Python 3 as well.
+static const char *const safe_globals[][2] = {
+  {"__builtin__", "set"},
+  {"__builtin__", "frozenset"},
+  {"__builtin__", "complex"},
+  {"__builtin__", "bytearray"},
+#if PY_MAJOR_VERSION >= 3
+  // Protocol 2 pickles bytes as _codecs.encode(text, "latin1").
+  {"_codecs", "encode"},
+#endif
+  {"collections", "OrderedDict"},
+  {"collections", "deque"},
+};
+
+py::object WorldSerializer::find_global(const std::string &module, const std::string &name) const {
+  bool allowed = allowed_.count(std::make_pair(module, name)) != 0;
+  for ( auto &global : safe_globals ) {
+    allowed = allowed || (module == global[0] && name == global[1]);
+  }
+  if ( !allowed ) {
+    const std::string message = "global " + module + "." + name + " is not allowed";
+    PyErr_SetString(pickle_module().attr("UnpicklingError").ptr(), message.c_str());
+    throw py::error_already_set();
+  }
+#if PY_MAJOR_VERSION >= 3
+  if ( module == "__builtin__" )
+    return py::module::import("builtins").attr(name.c_str());
+#endif
+  return py::module::import(module.c_str()).attr(name.c_str());
+}
+
+py::object WorldSerializer::unpickle(const char *data, size_t size) {
+  if ( !find_global_ ) {
+    find_global_ = py::cpp_function([this](const std::string &module, const std::string &name) {
+      return find_global(module, name);
+    });
+  }
+  py::object bytes = py::reinterpret_steal<py::object>(
+    PyBytes_FromStringAndSize(data, static_cast<Py_ssize_t>(size)));
+  if ( !bytes )
+    throw py::error_already_set();
+#if PY_MAJOR_VERSION >= 3
+  // Without a buffered file the Unpickler reads one opcode at a time and
+  // is three times slower than pickle.loads.
+  py::object io = py::module::import("io");
+  py::object file = io.attr("BufferedReader")(io.attr("BytesIO")(bytes));
+  if ( !unpickler_ ) {
+    // The C Unpickler looks find_class up on the object, and a builtin
+    // function in the class dict is called without self.
+    py::dict methods;
+    methods["find_class"] = find_global_;
+    py::object type = py::reinterpret_borrow<py::object>(reinterpret_cast<PyObject *>(&PyType_Type));
+    unpickler_ = type(py::str("RestrictedUnpickler"),
+                      py::make_tuple(pickle_module().attr("Unpickler")), methods);
+  }
+  return unpickler_(file).attr("load")();
+#else
+  py::object file = py::module::import("cStringIO").attr("StringIO")(bytes);
+  py::object unpickler = pickle_module().attr("Unpickler")(file);
+  unpickler.attr("find_global") = find_global_;
+  return unpickler.attr("load")();
+#endif
+}
+
+std::vector<Entity::Id> WorldSerializer::entities() const {
+  std::vector<Entity::Id> ids;
+  entities_.each<PythonScript>([&ids](Entity entity, PythonScript &script) {
+    ids.push_back(entity.id());
+  });
+  for ( auto &component : components_.components() ) {
+    component->each(entities_, [&ids](Entity::Id id, void *) {
+      ids.push_back(id);
+    });
+  }
+  std::sort(ids.begin(), ids.end(), [](Entity::Id a, Entity::Id b) {
+    return a.index() < b.index();
+  });
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  return ids;
+}
+
+const WorldSerializer::ClassInfo &WorldSerializer::class_info(const py::object &script) {
+  PyObject *type = reinterpret_cast<PyObject *>(Py_TYPE(script.ptr()));
+  class_key(Py_TYPE(script.ptr()), key_);
+  auto found = classes_.find(key_);
+  if ( found != classes_.end() && found->second.cls.ptr() == type )
+    return found->second;
+  const std::string key = key_;
+
+  ClassInfo info;
+  info.cls = py::reinterpret_borrow<py::object>(type);
+  info.excluded = py::reinterpret_steal<py::object>(PySet_New(nullptr));
+  PySet_Add(info.excluded.ptr(), py::str("entity").ptr());
+  py::object components = py::reinterpret_steal<py::object>(
+    PyObject_GetAttrString(type, "_components"));
+  if ( components && PyDict_Check(components.ptr()) ) {
+    PyObject *name;
+    PyObject *value;
+    Py_ssize_t position = 0;
+    while ( PyDict_Next(components.ptr(), &position, &name, &value) ) {
+      PySet_Add(info.excluded.ptr(), name);
+    }
+  }
+  PyErr_Clear();
+
+  // Most derived class first, so that overrides win.
+  py::object seen = py::reinterpret_steal<py::object>(PySet_New(nullptr));
+  PyObject *mro = reinterpret_cast<PyTypeObject *>(type)->tp_mro;
+  for ( Py_ssize_t i = 0; mro && i < PyTuple_GET_SIZE(mro); ++i ) {
+    PyObject *base = PyTuple_GET_ITEM(mro, i);
+    if ( !PyType_Check(base) )
+      continue;
+    PyObject *dict = reinterpret_cast<PyTypeObject *>(base)->tp_dict;
+    PyObject *name;
+    PyObject *value;
+    Py_ssize_t position = 0;
+    while ( dict && PyDict_Next(dict, &position, &name, &value) ) {
+      if ( is_private(name) || PySet_Contains(seen.ptr(), name) == 1 )
+        continue;
+      PySet_Add(seen.ptr(), name);
+      if ( PySet_Contains(info.excluded.ptr(), name) == 1 || PyCallable_Check(value) ||
+           PyObject_HasAttrString(value, "__get__") )
+        continue;
+      info.attributes.push_back(py::reinterpret_borrow<py::object>(name));
+    }
+  }
+  // Replaces the entry of a class this one reloaded, releasing it.
+  ClassInfo &cached = classes_[key];
+  cached = std::move(info);
+  return cached;
+}
+
+template <typename Visitor>
+void WorldSerializer::each_state(const py::object &script, Visitor visit) {
+  const ClassInfo &info = class_info(script);
+  py::object dict = py::reinterpret_steal<py::object>(
+    PyObject_GetAttrString(script.ptr(), "__dict__"));
+  if ( !dict || !PyDict_Check(dict.ptr()) ) {
+    PyErr_Clear();
+    dict = py::object();
+  }
+  if ( dict ) {
+    PyObject *name;
+    PyObject *value;
+    Py_ssize_t position = 0;
+    while ( PyDict_Next(dict.ptr(), &position, &name, &value) ) {
+      if ( is_private(name) || PySet_Contains(info.excluded.ptr(), name) == 1 )
+        continue;
+      visit(name, value);
+    }
+  }
+  for ( auto &name : info.attributes ) {
+    if ( (dict && PyDict_Contains(dict.ptr(), name.ptr()) == 1) ||
+         PySet_Contains(info.excluded.ptr(), name.ptr()) == 1 )
+      continue;
+    py::object value = py::reinterpret_steal<py::object>(PyObject_GetAttr(script.ptr(), name.ptr()));
+    if ( !value ) {
+      PyErr_Clear();
+      continue;
+    }
+    visit(name.ptr(), value.ptr());
+  }
+}
+
+py::dict WorldSerializer::script_state(const py::object &script) {
+  py::dict state;
+  each_state(script, [&state](PyObject *name, PyObject *value) {
+    PyDict_SetItem(state.ptr(), name, value);
+  });
+  return state;
+}
+
+bool WorldSerializer::skip_unpicklable(const py::object &script) {
+  const ClassInfo &info = class_info(script);
+  py::object dumps = pickle_module().attr("dumps");
+  std::vector<py::object> skipped;
+  each_state(script, [&](PyObject *name, PyObject *value) {
+    PyObject *pickled = PyObject_CallFunction(dumps.ptr(), const_cast<char *>("Oi"), value, 2);
+    if ( pickled ) {
+      Py_DECREF(pickled);
+      return;
+    }
+    PyErr_Clear();
+    skipped.push_back(py::reinterpret_borrow<py::object>(name));
+  });
+  const std::string cls = py::cast<std::string>(info.cls.attr("__name__"));
+  for ( auto &name : skipped ) {
+    PySet_Add(info.excluded.ptr(), name.ptr());
+    const std::string message = "not saving " + cls + "." + py::cast<std::string>(name) +
+                                ", it can not be pickled";
+    if ( PyErr_WarnEx(PyExc_RuntimeWarning, message.c_str(), 1) != 0 )
+      throw py::error_already_set();
+  }
+  return !skipped.empty();
+}
+
+void WorldSerializer::write_json(JsonWriter &json, Entity::Id id) {
+  if ( !entities_.valid(id) )
+    throw std::runtime_error("can not serialize an invalid entity");
+  json.begin_object();
+  json.key("id");
+  json.value(static_cast<uint64_t>(id.id()));
+  json.key("index");
+  json.value(static_cast<uint64_t>(id.index()));
+  json.key("version");
+  json.value(static_cast<uint64_t>(id.version()));
+  json.key("components");
+  json.begin_object();
+  for ( auto &component : components_.components() ) {
+    const void *data = component->get(entities_, id);
+    if ( !data )
+      continue;
+    json.key(component->name());
+    json.component(*component, data);
+  }
+  json.end_object();
+
+  auto script = entities_.component<PythonScript>(id);
+  if ( script && script->object ) {
+    py::object cls = script->object.attr("__class__");
+    json.key("script");
+    json.begin_object();
+    json.key("module");
+    json.python(cls.attr("__module__").ptr());
+    json.key("class");
+    json.python(cls.attr("__name__").ptr());
+    json.key("args");
+    json.python(script->args.ptr());
+    json.key("state");
+    json.begin_object();
+    each_state(script->object, [&json](PyObject *name, PyObject *value) {
+      json.key(name);
+      json.python(value);
+    });
+    json.end_object();
+    json.end_object();
+  }
+  json.end_object();
+}
+
+void WorldSerializer::write_json(JsonWriter &json) {
+  json.begin_object();
+  json.key("entities");
+  json.begin_array();
+  for ( auto id : entities() ) {
+    write_json(json, id);
+  }
+  json.end_array();
+  json.end_object();
+}
+
+}  // namespace python
+}  // namespace entityx
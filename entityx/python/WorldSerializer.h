@@ -0,0 +1,126 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "entityx/Entity.h"
+#include "entityx/python/ComponentRegistry.hpp"
+#include "entityx/python/JsonWriter.h"
+
+namespace py = pybind11;
+
+namespace entityx {
+namespace python {
+
+/// The fastest pickle module, cPickle on Python 2. Requires the GIL.
+py::object pickle_module();
+
+/**
+ * Set `key` to "module:name" of a script class, reusing its storage so
+ * lookups by class do not allocate. Hot reloading makes new class objects
+ * with the same key.
+ */
+void class_key(PyTypeObject *type, std::string &key);
+
+/**
+ * Reads a scripted world through the ComponentRegistry: registered
+ * components and, for PythonScript entities, the script class, its
+ * constructor args and its Python state.
+ *
+ * The Python state of a script is every attribute not starting with '_'
+ * except `entity`, its Component attributes, methods and other descriptors.
+ * Class attributes are included unless shadowed by the instance. Which
+ * class attributes qualify is worked out once per class.
+ *
+ * Everything except entities() requires the GIL.
+ */
+class WorldSerializer {
+public:
+  WorldSerializer(EntityManager &entities, const ComponentRegistry &components)
+    : entities_(entities), components_(components) {}
+
+  /// Entities with a script or a registered component, in index order.
+  std::vector<Entity::Id> entities() const;
+
+  /// The Python state of `script` as a new dict.
+  py::dict script_state(const py::object &script);
+
+  /**
+   * Stop saving the attributes of `script`'s state that do not pickle, e.g.
+   * entities, futures and generators, for every script of its class. Each
+   * newly skipped attribute raises a RuntimeWarning. Returns whether any
+   * was skipped; call it when pickling the state failed, then try again.
+   */
+  bool skip_unpicklable(const py::object &script);
+
+  /**
+   * Write one entity as
+   * `{"id":..,"index":..,"version":..,"components":{..},"script":{..}}`.
+   * "script" holds "module", "class", "args" and "state" and is left out
+   * for entities without a PythonScript.
+   */
+  void write_json(JsonWriter &json, Entity::Id id);
+
+  /// Write `{"entities":[..]}` with every entity of entities().
+  void write_json(JsonWriter &json);
+
+  /**
+   * Unpickle `size` bytes at `data`. Pickles may only refer to the builtin
+   * sets, complex numbers, bytes and collections.OrderedDict and deque, and
+   * to globals passed to allow_global(); anything else raises
+   * pickle.UnpicklingError instead of importing and calling whatever a
+   * crafted file names.
+   */
+  py::object unpickle(const char *data, size_t size);
+
+  /// Let unpickle() load `name` from `module`, e.g. a class kept in script state.
+  void allow_global(const std::string &module, const std::string &name) {
+    allowed_.insert(std::make_pair(module, name));
+  }
+
+  /// Forget the cached class attributes and unpickler, e.g. after reloading scripts.
+  void clear() {
+    classes_.clear();
+    unpickler_ = py::object();
+    find_global_ = py::object();
+  }
+
+private:
+  struct ClassInfo {
+    // The class object the rest was computed for.
+    py::object cls;
+    // Public data attributes of the class and its bases.
+    std::vector<py::object> attributes;
+    // Names never saved: `entity`, the Component attributes and attributes
+    // that did not pickle.
+    py::object excluded;
+  };
+
+  const ClassInfo &class_info(const py::object &script);
+
+  // Call `visit(name, value)` for every attribute of the script's state.
+  template <typename Visitor>
+  void each_state(const py::object &script, Visitor visit);
+
+  py::object find_global(const std::string &module, const std::string &name) const;
+
+  EntityManager &entities_;
+  const ComponentRegistry &components_;
+  // By class_key(), so a reloaded class replaces the one it reloads
+  // rather than both being kept.
+  std::unordered_map<std::string, ClassInfo> classes_;
+  std::string key_;
+  std::set<std::pair<std::string, std::string>> allowed_;
+  // find_global() as a Python callable and, on Python 3, the Unpickler
+  // subclass calling it.
+  py::object find_global_;
+  py::object unpickler_;
+};
+
+}  // namespace python
+}  // namespace entityx
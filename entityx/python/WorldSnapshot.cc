@@ -0,0 +1,738 @@
+// Copyright 2017 Bablawn3d5
+
+#include "entityx/python/WorldSnapshot.h"
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+#include "entityx/python/PythonScript.hpp"
+
+namespace entityx {
+namespace python {
+
+namespace {
+
+const char snapshot_magic[8] = {'E', 'X', 'P', 'Y', 'S', 'N', 'A', 'P'};
+const uint32_t snapshot_version = 2;
+const uint32_t no_slot = std::numeric_limits<uint32_t>::max();
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t components;
+  uint64_t entities;
+  uint64_t removed;
+  uint64_t frame;
+  uint64_t since;
+  uint64_t scripts_offset;
+  uint64_t scripts_size;
+};
+
+struct SectionHeader {
+  uint32_t name_size;
+  uint32_t component_size;
+  uint64_t count;
+  uint64_t removed;
+};
+
+// A component section of a snapshot being applied.
+struct Section {
+  const ComponentInfo *info;
+  uint64_t count;
+  uint64_t removed;
+  const char *slots;
+  const char *data;
+  const char *removed_slots;
+};
+
+void pad(std::string &out) {
+  out.append((8 - out.size() % 8) % 8, '\0');
+}
+
+size_t padded(size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+uint32_t slot_at(const char *slots, uint64_t i) {
+  uint32_t slot;
+  std::memcpy(&slot, slots + i * sizeof(slot), sizeof(slot));
+  return slot;
+}
+
+uint64_t id_at(const char *ids, uint64_t i) {
+  uint64_t id;
+  std::memcpy(&id, ids + i * sizeof(id), sizeof(id));
+  return id;
+}
+
+std::runtime_error snapshot_error(const std::string &what) {
+  return std::runtime_error("malformed snapshot: " + what);
+}
+
+// Bounds-checked reader over the snapshot buffer.
+class Reader {
+public:
+  Reader(const char *data, size_t size) : data_(data), size_(size), position_(0) {}
+
+  const char *take(uint64_t size, const char *what) {
+    if ( size > size_ - position_ )
+      throw snapshot_error(std::string("truncated ") + what);
+    const char *at = data_ + position_;
+    position_ += padded(static_cast<size_t>(size));
+    if ( position_ > size_ )
+      position_ = size_;
+    return at;
+  }
+
+  size_t position() const {
+    return position_;
+  }
+
+private:
+  const char *data_;
+  size_t size_;
+  size_t position_;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// Seconds since `start`, restarting it.
+double lap(Clock::time_point &start) {
+  const Clock::time_point now = Clock::now();
+  const double seconds = std::chrono::duration<double>(now - start).count();
+  start = now;
+  return seconds;
+}
+
+py::object none() {
+  return py::reinterpret_borrow<py::object>(Py_None);
+}
+
+// A checked snapshot, pointing into its buffer.
+struct Parsed {
+  SnapshotHeader header;
+  const char *saved_ids;
+  const char *removed_ids;
+  std::vector<Section> sections;
+  py::object scripts;
+};
+
+}  // namespace
+
+SnapshotWriter::SnapshotWriter(std::string &out, const std::vector<Entity::Id> &ids,
+                               const std::vector<Entity::Id> &removed)
+  : out_(out), components_(0), entities_(ids.size()), removed_(removed.size()) {
+  out_.clear();
+  out_.resize(sizeof(SnapshotHeader));
+  for ( auto id : ids ) {
+    append_id(id);
+  }
+  for ( auto id : removed ) {
+    append_id(id);
+  }
+}
+
+void SnapshotWriter::append_id(Entity::Id id) {
+  const uint64_t value = id.id();
+  out_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void SnapshotWriter::section(const ComponentInfo &info, const std::vector<uint32_t> &slots,
+                             const std::string &data, const std::vector<uint32_t> &removed) {
+  SectionHeader section;
+  section.name_size = static_cast<uint32_t>(info.name().size());
+  section.component_size = static_cast<uint32_t>(info.size());
+  section.count = slots.size();
+  section.removed = removed.size();
+  out_.append(reinterpret_cast<const char *>(&section), sizeof(section));
+  out_.append(info.name());
+  pad(out_);
+  out_.append(reinterpret_cast<const char *>(slots.data()), slots.size() * sizeof(uint32_t));
+  pad(out_);
+  out_.append(data);
+  pad(out_);
+  out_.append(reinterpret_cast<const char *>(removed.data()), removed.size() * sizeof(uint32_t));
+  pad(out_);
+  ++components_;
+}
+
+py::tuple SnapshotWriter::script(size_t slot, py::object module, py::object cls, py::object args,
+                                 py::object state) {
+  py::tuple entry(5);
+  PyTuple_SET_ITEM(entry.ptr(), 0, PyLong_FromSize_t(slot));
+  PyTuple_SET_ITEM(entry.ptr(), 1, module.release().ptr());
+  PyTuple_SET_ITEM(entry.ptr(), 2, cls.release().ptr());
+  PyTuple_SET_ITEM(entry.ptr(), 3, args.release().ptr());
+  PyTuple_SET_ITEM(entry.ptr(), 4, state.release().ptr());
+  return entry;
+}
+
+void SnapshotWriter::finish(const py::list &scripts, uint64_t frame, uint64_t since) {
+  py::object pickled = pickle_module().attr("dumps")(scripts, 2);
+  char *data = nullptr;
+  Py_ssize_t size = 0;
+  if ( PyBytes_AsStringAndSize(pickled.ptr(), &data, &size) != 0 )
+    throw py::error_already_set();
+
+  SnapshotHeader header;
+  std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+  header.version = snapshot_version;
+  header.components = components_;
+  header.entities = entities_;
+  header.removed = removed_;
+  header.frame = frame;
+  header.since = since;
+  header.scripts_offset = out_.size();
+  header.scripts_size = static_cast<uint64_t>(size);
+  out_.append(data, static_cast<size_t>(size));
+  std::memcpy(&out_[0], &header, sizeof(header));
+}
+
+bool SnapshotWriter::is_snapshot(const char *data, size_t size) {
+  return size >= sizeof(snapshot_magic) &&
+         std::memcmp(data, snapshot_magic, sizeof(snapshot_magic)) == 0;
+}
+
+// Complete `writer` with the script entries `entries()` makes. If a state
+// does not pickle, the scripts of `ids` stop saving what does not and the
+// entries are made again, so e.g. a generator kept by a script does not
+// fail every save.
+template <typename Entries>
+static void finish(SnapshotWriter &writer, WorldSerializer &serializer, EntityManager &entities,
+                   const std::vector<Entity::Id> &ids, Entries entries, uint64_t frame,
+                   uint64_t since) {
+  try {
+    writer.finish(entries(), frame, since);
+    return;
+  }
+  catch ( const py::error_already_set& ) {
+    PyObject *type;
+    PyObject *value;
+    PyObject *trace;
+    PyErr_Fetch(&type, &value, &trace);
+    py::object error[] = {py::reinterpret_steal<py::object>(type),
+                          py::reinterpret_steal<py::object>(value),
+                          py::reinterpret_steal<py::object>(trace)};
+    bool skipped = false;
+    for ( auto id : ids ) {
+      auto script = entities.component<PythonScript>(id);
+      if ( script && script->object && serializer.skip_unpicklable(script->object) )
+        skipped = true;
+    }
+    if ( !skipped ) {
+      PyErr_Restore(error[0].release().ptr(), error[1].release().ptr(), error[2].release().ptr());
+      throw;
+    }
+  }
+  writer.finish(entries(), frame, since);
+}
+
+void WorldSnapshot::save(std::string &out, uint64_t frame) {
+  const std::vector<Entity::Id> ids = serializer_.entities();
+  SnapshotWriter writer(out, ids, std::vector<Entity::Id>());
+
+  slots_.clear();
+  for ( size_t slot = 0; slot < ids.size(); ++slot ) {
+    const size_t index = ids[slot].index();
+    if ( index >= slots_.size() )
+      slots_.resize(index + 1, no_slot);
+    slots_[index] = static_cast<uint32_t>(slot);
+  }
+
+  std::vector<uint32_t> &slots = section_slots_;
+  std::string &data = section_data_;
+  const std::vector<uint32_t> removed;
+  for ( auto &component : components_.components() ) {
+    slots.clear();
+    data.clear();
+    const std::vector<uint32_t> &slot_of = slots_;
+    component->each(entities_, [&](Entity::Id id, void *value) {
+      slots.push_back(slot_of[id.index()]);
+      data.append(static_cast<const char *>(value), component->size());
+    });
+    writer.section(*component, slots, data, removed);
+  }
+
+  finish(writer, serializer_, entities_, ids, [&]() {
+    py::list scripts;
+    for ( size_t slot = 0; slot < ids.size(); ++slot ) {
+      auto script = entities_.component<PythonScript>(ids[slot]);
+      if ( !script || !script->object )
+        continue;
+      py::object cls = script->object.attr("__class__");
+      scripts.append(SnapshotWriter::script(slot, cls.attr("__module__"), cls.attr("__name__"),
+                                            script->args, serializer_.script_state(script->object)));
+    }
+    return scripts;
+  }, frame, 0);
+}
+
+void WorldSnapshot::save_delta(std::string &out, const ChangeTracker &tracker, uint64_t since) {
+  if ( since < tracker.horizon() )
+    throw std::runtime_error("delta since frame " + std::to_string(since) +
+                             " is older than the tracked history");
+  const std::vector<Entity::Id> ids = tracker.changed(since);
+  SnapshotWriter writer(out, ids, tracker.removed(since));
+
+  std::vector<uint32_t> slots;
+  std::string data;
+  std::vector<uint32_t> removed;
+  const auto &components = components_.components();
+  for ( size_t c = 0; c < components.size(); ++c ) {
+    slots.clear();
+    data.clear();
+    removed.clear();
+    for ( size_t slot = 0; slot < ids.size(); ++slot ) {
+      const void *value = tracker.component_changed(c, ids[slot], since);
+      if ( value ) {
+        slots.push_back(static_cast<uint32_t>(slot));
+        data.append(static_cast<const char *>(value), components[c]->size());
+      } else if ( tracker.component_removed(c, ids[slot], since) ) {
+        removed.push_back(static_cast<uint32_t>(slot));
+      }
+    }
+    writer.section(*components[c], slots, data, removed);
+  }
+
+  finish(writer, serializer_, entities_, ids, [&]() {
+    py::list scripts;
+    for ( size_t slot = 0; slot < ids.size(); ++slot ) {
+      const Entity::Id id = ids[slot];
+      if ( tracker.script_removed(id, since) ) {
+        scripts.append(SnapshotWriter::script(slot, none(), none(), none(), none()));
+        continue;
+      }
+      if ( !tracker.script_changed(id, since) )
+        continue;
+      auto script = entities_.component<PythonScript>(id);
+      if ( !script || !script->object )
+        continue;
+      py::object state = serializer_.script_state(script->object);
+      if ( tracker.script_created(id, since) ) {
+        py::object cls = script->object.attr("__class__");
+        scripts.append(SnapshotWriter::script(slot, cls.attr("__module__"), cls.attr("__name__"),
+                                              script->args, state));
+      } else {
+        scripts.append(SnapshotWriter::script(slot, none(), none(), none(), state));
+      }
+    }
+    return scripts;
+  }, tracker.frame(), since);
+}
+
+std::vector<Entity::Id> WorldSnapshot::restore(const char *data, size_t size,
+                                               LoadTiming *timing) {
+  SnapshotEntities entities;
+  return apply(data, size, py::object(), entities, timing);
+}
+
+std::vector<Entity::Id> WorldSnapshot::restore(const char *data, size_t size,
+                                               const py::list &scripts, LoadTiming *timing) {
+  SnapshotEntities entities;
+  return apply(data, size, scripts, entities, timing);
+}
+
+uint64_t WorldSnapshot::frame(const char *data, size_t size) {
+  Reader reader(data, size);
+  SnapshotHeader header;
+  std::memcpy(&header, reader.take(sizeof(header), "header"), sizeof(header));
+  if ( std::memcmp(header.magic, snapshot_magic, sizeof(header.magic)) != 0 )
+    throw snapshot_error("bad magic");
+  return header.frame;
+}
+
+// Check a whole snapshot and unpickle its scripts, unless `scripts` are given.
+static Parsed parse(const ComponentRegistry &components, WorldSerializer &serializer,
+                    const char *data, size_t size, const py::object &scripts = py::object()) {
+  Parsed parsed;
+  Reader reader(data, size);
+  SnapshotHeader &header = parsed.header;
+  std::memcpy(&header, reader.take(sizeof(header), "header"), sizeof(header));
+  if ( std::memcmp(header.magic, snapshot_magic, sizeof(header.magic)) != 0 )
+    throw snapshot_error("bad magic");
+  if ( header.version != snapshot_version )
+    throw snapshot_error("unsupported version " + std::to_string(header.version));
+  if ( header.entities > no_slot || header.removed > no_slot )
+    throw snapshot_error("too many entities");
+  parsed.saved_ids = reader.take(header.entities * sizeof(uint64_t), "entity ids");
+  parsed.removed_ids = reader.take(header.removed * sizeof(uint64_t), "removed ids");
+
+  for ( uint32_t i = 0; i < header.components; ++i ) {
+    SectionHeader section;
+    std::memcpy(&section, reader.take(sizeof(section), "component section"), sizeof(section));
+    const std::string name(reader.take(section.name_size, "component name"), section.name_size);
+    const ComponentInfo *info = components.find(name);
+    if ( !info )
+      throw std::runtime_error("snapshot component " + name + " is not registered");
+    if ( info->size() != section.component_size )
+      throw std::runtime_error("snapshot component " + name + " has a different size");
+    if ( section.count > header.entities || section.removed > header.entities )
+      throw snapshot_error("too many " + name + " components");
+    Section s;
+    s.info = info;
+    s.count = section.count;
+    s.removed = section.removed;
+    s.slots = reader.take(section.count * sizeof(uint32_t), "component slots");
+    s.data = reader.take(section.count * section.component_size, "components");
+    s.removed_slots = reader.take(section.removed * sizeof(uint32_t), "removed slots");
+    for ( uint64_t j = 0; j < s.count; ++j ) {
+      if ( slot_at(s.slots, j) >= header.entities )
+        throw snapshot_error("bad entity slot for " + name);
+    }
+    for ( uint64_t j = 0; j < s.removed; ++j ) {
+      if ( slot_at(s.removed_slots, j) >= header.entities )
+        throw snapshot_error("bad entity slot for " + name);
+    }
+    parsed.sections.push_back(s);
+  }
+  if ( header.scripts_offset != reader.position() || header.scripts_size > size - reader.position() )
+    throw snapshot_error("bad script section");
+
+  if ( scripts )
+    parsed.scripts = scripts;
+  else
+    parsed.scripts = serializer.unpickle(data + header.scripts_offset,
+                                         static_cast<size_t>(header.scripts_size));
+  if ( !PyList_Check(parsed.scripts.ptr()) )
+    throw snapshot_error("bad script section");
+  const Py_ssize_t script_count = PyList_GET_SIZE(parsed.scripts.ptr());
+  for ( Py_ssize_t i = 0; i < script_count; ++i ) {
+    PyObject *entry = PyList_GET_ITEM(parsed.scripts.ptr(), i);
+    if ( !PyTuple_Check(entry) || PyTuple_GET_SIZE(entry) != 5 )
+      throw snapshot_error("bad script entry");
+    PyObject *module = PyTuple_GET_ITEM(entry, 1);
+    PyObject *state = PyTuple_GET_ITEM(entry, 4);
+    if ( (module != Py_None && !PyList_Check(PyTuple_GET_ITEM(entry, 3))) ||
+         (state != Py_None && !PyDict_Check(state)) )
+      throw snapshot_error("bad script entry");
+    if ( py::cast<uint64_t>(py::handle(PyTuple_GET_ITEM(entry, 0))) >= header.entities )
+      throw snapshot_error("bad script slot");
+  }
+  return parsed;
+}
+
+// Assign the script of a (slot, module, class, args, state) entry.
+static py::object assign_script(EntityManager &entities, Entity::Id id, PyObject *entry) {
+  if ( entities.component<PythonScript>(id) )
+    entities.remove<PythonScript>(id);
+  PythonScript script(py::cast<std::string>(py::handle(PyTuple_GET_ITEM(entry, 1))),
+                      py::cast<std::string>(py::handle(PyTuple_GET_ITEM(entry, 2))));
+  script.args = py::reinterpret_borrow<py::list>(PyTuple_GET_ITEM(entry, 3));
+  return entities.assign<PythonScript>(id, script)->object;
+}
+
+static void set_state(const py::object &object, PyObject *state) {
+  PyObject *name;
+  PyObject *value;
+  Py_ssize_t position = 0;
+  while ( PyDict_Next(state, &position, &name, &value) ) {
+    if ( PyObject_SetAttr(object.ptr(), name, value) != 0 )
+      throw py::error_already_set();
+  }
+}
+
+// Delete the attributes of `object`'s state that are not in `state`.
+static void drop_state(WorldSerializer &serializer, const py::object &object, PyObject *state) {
+  py::dict current = serializer.script_state(object);
+  PyObject *name;
+  PyObject *value;
+  Py_ssize_t position = 0;
+  while ( PyDict_Next(current.ptr(), &position, &name, &value) ) {
+    if ( PyDict_Contains(state, name) != 1 && PyObject_DelAttr(object.ptr(), name) != 0 )
+      PyErr_Clear();
+  }
+}
+
+namespace {
+
+// Puts the world back if apply() fails partway: entities it created are
+// destroyed and entities that existed get their components, scripts and
+// script state back.
+class Undo {
+public:
+  Undo(EntityManager &entities, WorldSerializer &serializer, SnapshotEntities &saved)
+    : entities_(entities), serializer_(serializer), saved_(saved) {}
+
+  /// A new entity was created for the saved id `saved`.
+  void created(uint64_t saved) {
+    created_.push_back(saved);
+  }
+
+  /// Call before `info` is assigned to or removed from `id`.
+  void component(const ComponentInfo &info, Entity::Id id) {
+    ComponentChange change;
+    change.info = &info;
+    change.id = id;
+    const void *value = info.get(entities_, id);
+    change.existed = value != nullptr;
+    if ( value )
+      change.data.assign(static_cast<const char *>(value), info.size());
+    components_.push_back(std::move(change));
+  }
+
+  /// Call before the script of `id` is replaced or removed.
+  void script(Entity::Id id) {
+    ScriptChange change;
+    change.id = id;
+    auto existing = entities_.component<PythonScript>(id);
+    change.existed = static_cast<bool>(existing);
+    if ( existing )
+      change.script = *existing;
+    scripts_.push_back(std::move(change));
+  }
+
+  /// Call before the state of `object` is set.
+  void state(const py::object &object) {
+    ScriptChange change;
+    change.existed = true;
+    change.object = object;
+    change.state = serializer_.script_state(object);
+    scripts_.push_back(std::move(change));
+  }
+
+  /// Undo every recorded change, newest first. Never throws a Python error.
+  void rollback() {
+    for ( auto change = scripts_.rbegin(); change != scripts_.rend(); ++change ) {
+      if ( change->object ) {
+        drop_state(serializer_, change->object, change->state.ptr());
+        PyObject *name;
+        PyObject *value;
+        Py_ssize_t position = 0;
+        while ( PyDict_Next(change->state.ptr(), &position, &name, &value) ) {
+          if ( PyObject_SetAttr(change->object.ptr(), name, value) != 0 )
+            PyErr_Clear();
+        }
+        continue;
+      }
+      if ( entities_.component<PythonScript>(change->id) )
+        entities_.remove<PythonScript>(change->id);
+      // The saved script still has its object, so it is not constructed again.
+      if ( change->existed )
+        entities_.assign<PythonScript>(change->id, change->script);
+    }
+    for ( auto change = components_.rbegin(); change != components_.rend(); ++change ) {
+      if ( change->existed ) {
+        std::memcpy(change->info->assign(entities_, change->id), change->data.data(),
+                    change->data.size());
+      } else {
+        change->info->remove(entities_, change->id);
+      }
+    }
+    for ( auto saved : created_ ) {
+      auto found = saved_.find(saved);
+      if ( found == saved_.end() )
+        continue;
+      if ( entities_.valid(found->second) )
+        entities_.destroy(found->second);
+      saved_.erase(found);
+    }
+  }
+
+private:
+  struct ComponentChange {
+    const ComponentInfo *info;
+    Entity::Id id;
+    bool existed;
+    std::string data;
+  };
+
+  struct ScriptChange {
+    Entity::Id id;
+    bool existed;
+    // The replaced script, or for state changes the object and its state.
+    PythonScript script;
+    py::object object;
+    py::dict state;
+  };
+
+  EntityManager &entities_;
+  WorldSerializer &serializer_;
+  SnapshotEntities &saved_;
+  std::vector<uint64_t> created_;
+  std::vector<ComponentChange> components_;
+  std::vector<ScriptChange> scripts_;
+};
+
+}  // namespace
+
+std::vector<Entity::Id> WorldSnapshot::apply(const char *data, size_t size,
+                                             SnapshotEntities &entities, LoadTiming *timing) {
+  return apply(data, size, py::object(), entities, timing);
+}
+
+std::vector<Entity::Id> WorldSnapshot::apply(const char *data, size_t size,
+                                             const py::object &scripts,
+                                             SnapshotEntities &entities, LoadTiming *timing) {
+  Clock::time_point start = Clock::now();
+  // Check everything before touching the world.
+  const Parsed parsed = parse(components_, serializer_, data, size, scripts);
+  if ( timing )
+    timing->parse += lap(start);
+
+  Undo undo(entities_, serializer_, entities);
+  std::vector<Entity::Id> ids;
+  try {
+    ids.reserve(static_cast<size_t>(parsed.header.entities));
+    entities.reserve(entities.size() + static_cast<size_t>(parsed.header.entities));
+    std::vector<char> created(static_cast<size_t>(parsed.header.entities), 0);
+    for ( uint64_t i = 0; i < parsed.header.entities; ++i ) {
+      const uint64_t saved = id_at(parsed.saved_ids, i);
+      Entity::Id &id = entities[saved];
+      if ( !entities_.valid(id) ) {
+        id = entities_.create().id();
+        created[i] = 1;
+        undo.created(saved);
+      }
+      ids.push_back(id);
+    }
+    for ( auto &section : parsed.sections ) {
+      const size_t component_size = section.info->size();
+      for ( uint64_t j = 0; j < section.count; ++j ) {
+        const uint32_t slot = slot_at(section.slots, j);
+        if ( !created[slot] )
+          undo.component(*section.info, ids[slot]);
+        std::memcpy(section.info->assign(entities_, ids[slot]),
+                    section.data + j * component_size, component_size);
+      }
+      for ( uint64_t j = 0; j < section.removed; ++j ) {
+        const uint32_t slot = slot_at(section.removed_slots, j);
+        if ( !created[slot] )
+          undo.component(*section.info, ids[slot]);
+        section.info->remove(entities_, ids[slot]);
+      }
+    }
+    if ( timing )
+      timing->spawn += lap(start);
+
+    const Py_ssize_t script_count = PyList_GET_SIZE(parsed.scripts.ptr());
+    for ( Py_ssize_t i = 0; i < script_count; ++i ) {
+      PyObject *entry = PyList_GET_ITEM(parsed.scripts.ptr(), i);
+      const size_t slot = py::cast<size_t>(py::handle(PyTuple_GET_ITEM(entry, 0)));
+      const Entity::Id id = ids[slot];
+      PyObject *state = PyTuple_GET_ITEM(entry, 4);
+      auto existing = entities_.component<PythonScript>(id);
+      if ( state == Py_None ) {
+        if ( existing ) {
+          undo.script(id);
+          entities_.remove<PythonScript>(id);
+        }
+        continue;
+      }
+      py::object object;
+      if ( PyTuple_GET_ITEM(entry, 1) != Py_None ) {
+        if ( !created[slot] )
+          undo.script(id);
+        object = assign_script(entities_, id, entry);
+      } else if ( existing ) {
+        object = existing->object;
+        if ( object )
+          undo.state(object);
+      }
+      if ( object )
+        set_state(object, state);
+    }
+  }
+  catch ( ... ) {
+    undo.rollback();
+    throw;
+  }
+
+  // Destroyed entities can not be brought back, so they go last.
+  for ( uint64_t i = 0; i < parsed.header.removed; ++i ) {
+    auto found = entities.find(id_at(parsed.removed_ids, i));
+    if ( found == entities.end() )
+      continue;
+    if ( entities_.valid(found->second) )
+      entities_.destroy(found->second);
+    entities.erase(found);
+  }
+  if ( timing ) {
+    timing->instantiate += lap(start);
+    timing->entities += ids.size();
+  }
+  return ids;
+}
+
+std::vector<Entity::Id> WorldSnapshot::rewind(const char *data, size_t size,
+                                              SnapshotEntities &entities) {
+  const Parsed parsed = parse(components_, serializer_, data, size);
+
+  // Saved entities keep their ids unless they were destroyed since.
+  std::vector<Entity::Id> ids;
+  ids.reserve(static_cast<size_t>(parsed.header.entities));
+  std::unordered_set<uint64_t> kept;
+  for ( uint64_t i = 0; i < parsed.header.entities; ++i ) {
+    const uint64_t saved = id_at(parsed.saved_ids, i);
+    auto found = entities.find(saved);
+    Entity::Id id = found != entities.end() ? found->second : Entity::Id(saved);
+    if ( !entities_.valid(id) ) {
+      id = entities_.create().id();
+      entities[saved] = id;
+    }
+    ids.push_back(id);
+    kept.insert(id.id());
+  }
+  for ( auto id : serializer_.entities() ) {
+    if ( !kept.count(id.id()) )
+      entities_.destroy(id);
+  }
+
+  std::unordered_set<uint64_t> present;
+  std::vector<Entity::Id> stale;
+  for ( auto &section : parsed.sections ) {
+    present.clear();
+    stale.clear();
+    for ( uint64_t j = 0; j < section.count; ++j ) {
+      present.insert(ids[slot_at(section.slots, j)].id());
+    }
+    section.info->each(entities_, [&](Entity::Id id, void *) {
+      if ( !present.count(id.id()) )
+        stale.push_back(id);
+    });
+    for ( auto id : stale ) {
+      section.info->remove(entities_, id);
+    }
+    const size_t component_size = section.info->size();
+    for ( uint64_t j = 0; j < section.count; ++j ) {
+      std::memcpy(section.info->assign(entities_, ids[slot_at(section.slots, j)]),
+                  section.data + j * component_size, component_size);
+    }
+  }
+
+  std::vector<char> scripted(ids.size(), 0);
+  const Py_ssize_t script_count = PyList_GET_SIZE(parsed.scripts.ptr());
+  for ( Py_ssize_t i = 0; i < script_count; ++i ) {
+    PyObject *entry = PyList_GET_ITEM(parsed.scripts.ptr(), i);
+    const size_t slot = py::cast<size_t>(py::handle(PyTuple_GET_ITEM(entry, 0)));
+    PyObject *state = PyTuple_GET_ITEM(entry, 4);
+    if ( state == Py_None || PyTuple_GET_ITEM(entry, 1) == Py_None )
+      throw snapshot_error("rewinding requires a full snapshot");
+    scripted[slot] = 1;
+    const Entity::Id id = ids[slot];
+    auto existing = entities_.component<PythonScript>(id);
+    py::object object;
+    if ( existing && existing->object ) {
+      py::object cls = existing->object.attr("__class__");
+      if ( PyObject_RichCompareBool(cls.attr("__module__").ptr(), PyTuple_GET_ITEM(entry, 1), Py_EQ) == 1 &&
+           PyObject_RichCompareBool(cls.attr("__name__").ptr(), PyTuple_GET_ITEM(entry, 2), Py_EQ) == 1 )
+        object = existing->object;
+    }
+    if ( object ) {
+      // Drop attributes set after the snapshot was taken.
+      drop_state(serializer_, object, state);
+    } else {
+      object = assign_script(entities_, id, entry);
+    }
+    set_state(object, state);
+  }
+  for ( size_t slot = 0; slot < ids.size(); ++slot ) {
+    if ( !scripted[slot] && entities_.component<PythonScript>(ids[slot]) )
+      entities_.remove<PythonScript>(ids[slot]);
+  }
+  return ids;
+}
+
+}  // namespace python
+}  // namespace entityx
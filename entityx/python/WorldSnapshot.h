@@ -0,0 +1,184 @@
+// Copyright 2017 Bablawn3d5
+
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "entityx/Entity.h"
+#include "entityx/python/ChangeTracker.h"
+#include "entityx/python/ComponentRegistry.hpp"
+#include "entityx/python/WorldSerializer.h"
+
+namespace py = pybind11;
+
+namespace entityx {
+namespace python {
+
+/// The local entity of each saved entity id, kept across applied deltas.
+typedef std::unordered_map<uint64_t, Entity::Id> SnapshotEntities;
+
+/// Seconds spent in each phase of restoring a snapshot or loading a level.
+struct LoadTiming {
+  LoadTiming() : entities(0), parse(0), spawn(0), instantiate(0) {}
+
+  size_t entities;
+  // Reading, checking and unpickling.
+  double parse;
+  // Creating entities and assigning their components.
+  double spawn;
+  // Constructing scripts and setting their state.
+  double instantiate;
+};
+
+/**
+ * Assembles a snapshot in the layout described at WorldSnapshot: the
+ * entity ids first, then one section per component type and finally the
+ * script entries. Requires the GIL.
+ */
+class SnapshotWriter {
+public:
+  SnapshotWriter(std::string &out, const std::vector<Entity::Id> &ids,
+                 const std::vector<Entity::Id> &removed);
+
+  /**
+   * Add a component section: the slots in `ids` of the entities that have
+   * the component, their components back to back in `data` and the slots of
+   * the entities that lost it.
+   */
+  void section(const ComponentInfo &info, const std::vector<uint32_t> &slots,
+               const std::string &data, const std::vector<uint32_t> &removed);
+
+  /// Pickle `scripts`, a list of script() entries, and complete the header.
+  void finish(const py::list &scripts, uint64_t frame, uint64_t since);
+
+  /// A (slot, module, class, args, state) script entry.
+  static py::tuple script(size_t slot, py::object module, py::object cls, py::object args,
+                          py::object state);
+
+  /// Whether `data` starts like a snapshot.
+  static bool is_snapshot(const char *data, size_t size);
+
+private:
+  void append_id(Entity::Id id);
+
+  std::string &out_;
+  uint32_t components_;
+  uint64_t entities_;
+  uint64_t removed_;
+};
+
+/**
+ * Saves the entities of WorldSerializer::entities() into a compact binary
+ * snapshot and restores them.
+ *
+ * The layout is 8 byte aligned native-endian data:
+ *
+ *   header   magic "EXPYSNAP", version, component count, entity count,
+ *            removed entity count, frame, since and the offset and size of
+ *            the script section
+ *   ids      one uint64 per entity: its id when saved
+ *   removed  one uint64 per entity removed since `since`
+ *   per registered component:
+ *            name size, component size, count, removed count, the name,
+ *            one uint32 entity slot per component, the raw components,
+ *            then one uint32 slot per entity that lost the component
+ *   scripts  one pickle of [(slot, module, class, args, state), ...];
+ *            module, class and args are None for scripts saved before and
+ *            all four are None for removed scripts
+ *
+ * A full snapshot holds every entity; a delta only what a ChangeTracker saw
+ * change after frame `since`. Components are stored as raw bytes, so a
+ * snapshot can only be restored by a build with the same component layouts.
+ * Restoring reads the buffer in place, e.g. straight from a memory-mapped
+ * file.
+ *
+ * Saving and applying require the GIL.
+ */
+class WorldSnapshot {
+public:
+  WorldSnapshot(EntityManager &entities, const ComponentRegistry &components,
+                WorldSerializer &serializer)
+    : entities_(entities), components_(components), serializer_(serializer) {}
+
+  /**
+   * Replace the contents of `out` with a snapshot of the world at `frame`.
+   * Script state that does not pickle is skipped, see
+   * WorldSerializer::skip_unpicklable().
+   */
+  void save(std::string &out, uint64_t frame = 0);
+
+  /**
+   * Replace the contents of `out` with what `tracker` saw change after frame
+   * `since`, as of its last commit. Throws std::runtime_error if `since` is
+   * older than the tracker's history.
+   */
+  void save_delta(std::string &out, const ChangeTracker &tracker, uint64_t since);
+
+  /**
+   * Create an entity for every entity in the snapshot, assign its saved
+   * components, then its PythonScript and finally set the script's saved
+   * state. Scripts are constructed as usual first, so __init__ runs
+   * before the state is applied. Returns the new ids in snapshot order.
+   *
+   * Throws std::runtime_error if the snapshot is malformed or its
+   * components do not match the registered ones, and rethrows errors of
+   * the scripts; the world is unchanged then. Script state is unpickled with
+   * WorldSerializer::unpickle(), so it may only hold allowed globals.
+   */
+  std::vector<Entity::Id> restore(const char *data, size_t size, LoadTiming *timing = nullptr);
+
+  /**
+   * Like restore(), with the script entries given instead of unpickled from
+   * the snapshot, e.g. those level_to_snapshot() returns.
+   */
+  std::vector<Entity::Id> restore(const char *data, size_t size, const py::list &scripts,
+                                  LoadTiming *timing = nullptr);
+
+  /**
+   * Apply a full or delta snapshot to the entities in `entities`, creating
+   * entities for saved ids not in it yet and destroying removed ones.
+   * Returns the local ids of the snapshot's entities in snapshot order.
+   * Adds the time taken by each phase to `timing`, if given.
+   *
+   * If a script fails, the entities created so far are destroyed and the
+   * components, scripts and script state of existing entities are put
+   * back before the error is rethrown. Removed entities are only destroyed
+   * once everything else succeeded.
+   */
+  std::vector<Entity::Id> apply(const char *data, size_t size, SnapshotEntities &entities,
+                                LoadTiming *timing = nullptr);
+
+  /**
+   * Return the world to a full snapshot of itself: entities saved in it
+   * keep their ids and script objects, later entities are destroyed and
+   * destroyed ones are created again. `entities` maps the saved ids of
+   * recreated entities to their new ids and must be kept between rewinds.
+   * Returns the local ids of the snapshot's entities in snapshot order.
+   */
+  std::vector<Entity::Id> rewind(const char *data, size_t size, SnapshotEntities &entities);
+
+  /// The frame a snapshot was saved at.
+  static uint64_t frame(const char *data, size_t size);
+
+private:
+  // apply() with the script entries given unless `scripts` is null.
+  std::vector<Entity::Id> apply(const char *data, size_t size, const py::object &scripts,
+                                SnapshotEntities &entities, LoadTiming *timing);
+
+  EntityManager &entities_;
+  const ComponentRegistry &components_;
+  WorldSerializer &serializer_;
+  // Snapshot slot of each entity index while saving.
+  std::vector<uint32_t> slots_;
+  // The slots and data of the component section being saved, kept so that
+  // saving every frame reuses them.
+  std::vector<uint32_t> section_slots_;
+  std::string section_data_;
+};
+
+}  // namespace python
+}  // namespace entityx
@@ -1,5 +1,7 @@
 import _entityx
-import json, operator
+import operator
+import traceback
+from functools import partial
 
 """These classes provide a convenience layer on top of the raw entityx::python
 primitives.
@@ -20,7 +22,78 @@ PythonComponent, otherwise they will be created by the Entity constructor.
 """
 
 
-__all__ = ['Entity', 'Component']
+__all__ = ['Entity', 'Component', 'emit', 'current_world', 'DEBUG', 'INFO', 'WARNING', 'ERROR']
+
+# Log levels for Entity.log(), matching entityx::python::LogLevel.
+DEBUG, INFO, WARNING, ERROR = 10, 20, 30, 40
+
+
+def current_world():
+    """Return the world entities created without an explicit world go into.
+
+    This is the world of the PythonSystem that is updating or delivering
+    events, or else the one configured last.
+    """
+    return _entityx._world
+
+
+def emit(event, world=None):
+    """Emit a C++ event from Python into `world`, by default the current one.
+
+    The event class must expose an `emit` method bound to
+    entityx::python::emit<Event>.
+
+    During a parallel update the event is emitted once every worker is done.
+    """
+    world = world or _entityx._world
+    world.defer(partial(event.emit, world.event_manager))
+
+
+def _resume(entity, generator, future=None):
+    """Advance `generator` with the result of `future` until it next yields
+    a Future, then resume it again once that one is resolved.
+
+    Once resumed by a future, errors are logged for `entity` rather than
+    raised into the update that resolved the future."""
+    error = None
+    try:
+        if future is None:
+            pending = next(generator)
+        else:
+            try:
+                value = future.result()
+            except RuntimeError as e:
+                error = e
+            if error is None:
+                pending = generator.send(value)
+            else:
+                pending = generator.throw(error)
+        pending.then(partial(_resume, entity, generator))
+    except StopIteration:
+        return
+    except Exception:
+        if future is None:
+            raise
+        entity.error('%s failed:\n%s', generator.__name__, traceback.format_exc())
+
+
+_tracking = False
+
+
+def _tracked_setattr(self, name, value):
+    """Entity.__setattr__ once a world tracks changes: public attributes are
+    script state, so the entity is marked changed."""
+    object.__setattr__(self, name, value)
+    if name[:1] != '_':
+        self._world.changed(self.entity.id)
+
+
+def _track_changes():
+    """Route script attribute writes through _tracked_setattr. Called once a
+    world tracks changes, so attribute writes cost nothing extra before."""
+    global _tracking
+    _tracking = True
+    Entity.__setattr__ = _tracked_setattr
 
 
 class Component(object):
@@ -40,12 +113,12 @@ class Component(object):
         self._args = args
         self._kwargs = kwargs
 
-    def _build(self, entity_id):
-        component = self._cls.get_component(_entityx._entity_manager, entity_id)
+    def _build(self, entity_manager, entity_id):
+        component = self._cls.get_component(entity_manager, entity_id)
         if not component:
             component = self._cls(*self._args, **self._kwargs)
-            component.assign_to(_entityx._entity_manager, entity_id)
-            return self._build(entity_id)
+            component.assign_to(entity_manager, entity_id)
+            return self._build(entity_manager, entity_id)
         return component
 
 
@@ -65,25 +138,39 @@ class EntityMetaClass(object.__class__):
         for key, value in dct.items():
             if isinstance(value, Component):
                 components[key] = value
+        # Script class name used to tag log records.
+        dct['_log_name'] = '%s.%s' % (dct.get('__module__', ''), name)
         return type.__new__(cls, name, bases, dct)
 
-class Entity(object):
+
+# Created by calling the metaclass, as the class statement spells it
+# differently in Python 2 and 3.
+_EntityBase = EntityMetaClass('_EntityBase', (object,), {'__module__': __name__})
+
+
+class Entity(_EntityBase):
     """Base Entity class.
 
     Python Enitities differ in semantics from C++ components, in that they
     contain logic, and so on.
     """
-    __metaclass__ = EntityMetaClass
 
     def __new__(cls, *args, **kwargs):
         entity = kwargs.pop('entity', None)
-        self = object.__new__(cls, *args, **kwargs)
+        world = kwargs.pop('world', None) or _entityx._world
+        self = object.__new__(cls)
+        if not _tracking and world.tracks_changes:
+            _track_changes()
+        self._world = world
+        entity_manager = world.entity_manager
         if entity is None:
-            entity = _entityx._entity_manager.new_entity(self)
+            if world.parallel:
+                raise RuntimeError('use self.spawn() to create entities during a parallel update')
+            entity = entity_manager.new_entity(self)
         # Initalize self.entity 
         self.entity = entity
         for k, v in self._components.items():
-            setattr(self, k, v._build(self.entity.id))
+            setattr(self, k, v._build(entity_manager, self.entity.id))
         return self
 
     def __init__(self):
@@ -96,32 +183,97 @@ class Entity(object):
     def id(self):
         return self.entity.id
 
+    def log(self, level, msg, *args):
+        """Log `msg % args` tagged with this entity and its class.
+
+        Records below the PythonSystem log level are dropped before `msg` is
+        formatted, and identical messages from one class are rate limited.
+        """
+        world = self._world
+        if level < world.log_level:
+            return
+        world.log.write(level, self.entity.id, self._log_name, msg, args)
+
+    def debug(self, msg, *args):
+        self.log(DEBUG, msg, *args)
+
+    def info(self, msg, *args):
+        self.log(INFO, msg, *args)
+
+    def warning(self, msg, *args):
+        self.log(WARNING, msg, *args)
+
+    def error(self, msg, *args):
+        self.log(ERROR, msg, *args)
+
+    def mark_changed(self):
+        """Note that the script state changed in place, e.g. a list attribute
+        was appended to, for a world that tracks changes. Assigning an
+        attribute is noticed without this."""
+        self._world.changed(self.entity.id)
+
+    def defer(self, fn, *args, **kwargs):
+        """Call `fn(*args, **kwargs)` once it is safe to change the world.
+
+        Outside a parallel update that is right away. During one, it is after
+        every worker is done, in entity order. Use this for anything that
+        creates, destroys or assigns components to other entities.
+        """
+        self._world.defer(partial(fn, *args, **kwargs))
+
+    def submit(self, job, *args):
+        """Run the C++ job registered as `job` on a worker thread.
+
+        Returns a Future that a later update resolves. Pass a callback taking
+        the future to `future.then()`, or yield the future from a generator
+        started with run_async().
+        """
+        return self._world.submit(job, *args)
+
+    def run_async(self, generator):
+        """Run `generator` until it yields a Future from submit(), then
+        resume it with the future's result once that is resolved. A failed
+        job raises RuntimeError at the yield.
+
+            def __init__(self):
+                self.path = None
+                self.run_async(self.find_path())
+
+            def find_path(self):
+                self.path = yield self.submit('find_path', self.start, self.goal)
+        """
+        _resume(self, generator)
+
+    def spawn(self, cls, *args, **kwargs):
+        """Create a `cls` entity in the same world as this one.
+
+        During a parallel update the entity is created later and None is
+        returned.
+        """
+        world = self._world
+        if world.parallel:
+            world.defer(partial(cls._create, world, None, args, kwargs))
+            return None
+        return cls._create(world, None, args, kwargs)
+
+    def emit(self, event):
+        """Emit a C++ event into this entity's world."""
+        emit(event, self._world)
+
     def destroy(self):
-        return self.entity.destroy()
+        """Destroy the entity, after the workers are done during a parallel update."""
+        self._world.defer(self.entity.destroy)
 
     def valid(self):
         return self.entity.valid()
 
-    ''' For seralization '''
     def to_json(self):
-        ''' Gets all vars including C++ varaibles of a class''' 
-        def get_vars(obj):
-            attrs = [attr for attr in dir(obj) if not callable(getattr(obj, attr)) and not attr.startswith("_")]
-            return attrs
-        ''' Fake equilvalent of __dict__ that also includes C++ classes '''
-        def get_dict(obj):
-            attrs = get_vars(obj)
-            dic = {}
-            for member in attrs:
-                att = getattr(obj,member)
-                # End recursion if C++ object provides __repr__ 
-                if type(att).__repr__ != object.__repr__:
-                    dic[member] = str(att)
-                # Recursively go over components that don't provide __repr__
-                else:
-                    dic[member] = get_dict(att)
-            return dic
-        return json.dumps(get_dict(self), indent=2)
+        """Serialize the entity's registered components and script state.
+
+        See PythonSystem::register_component() for which components are
+        included and WorldSerializer for the format.
+        """
+        return self._world.to_json(self.entity.id)
 
     @classmethod
     def _from_raw_entity(cls, *args, **kwargs):
@@ -132,7 +284,21 @@ class Entity(object):
         args = list(*args)
         kwargs = dict(kwargs)
         entity = kwargs.pop('entity', None)
-        self = Entity.__new__(cls, *args, entity=entity)
+        world = kwargs.pop('world', None)
+        return cls._create(world, entity, args, kwargs)
+
+    @classmethod
+    def _rebind(cls, entity, world):
+        """Attach a new script object to an entity reopened from a
+        persistent store, without calling __init__.
+
+        This is called from C++.
+        """
+        return Entity.__new__(cls, entity=entity, world=world)
+
+    @classmethod
+    def _create(cls, world, entity, args, kwargs):
+        self = Entity.__new__(cls, *args, entity=entity, world=world)
         cls.__init__(self, *args, **kwargs)
         return self
 
@@ -140,10 +306,17 @@ class Entity(object):
         Create a component if its not craeted, return component otherwise. 
     '''
     def Component(self, cls, *args, **kwargs):
-        component = cls.get_component(_entityx._entity_manager, self.entity.id)
+        world = self._world
+        entity_manager = world.entity_manager
+        component = cls.get_component(entity_manager, self.entity.id)
         if not component:
             component = cls(*args, **kwargs)
-            component.assign_to(_entityx._entity_manager, self.entity.id)
+            if world.parallel:
+                # Assigned once the workers are done; until then this is a
+                # standalone copy, and changes to it are assigned with it.
+                world.defer(partial(component.assign_to, entity_manager, self.entity.id))
+                return component
+            component.assign_to(entity_manager, self.entity.id)
             return self.Component(cls, *args, **kwargs)
         return component
 
@@ -151,7 +324,7 @@ class Entity(object):
         Returns true if the entity contains the component
     '''
     def HasComponent(self, cls):
-        component = cls.get_component(_entityx._entity_manager, self.entity.id)
+        component = cls.get_component(self._world.entity_manager, self.entity.id)
         if component:
             return True
         return False
\ No newline at end of file
@@ -1,5 +1,13 @@
 import sys
-import imp
+import _entityx
+
+try:
+    # Python 3 deprecated imp and 3.12 removed it.
+    import importlib
+    import importlib.util
+    imp = None
+except ImportError:
+    import imp
 
 '''
 Find modules by hierarchical module names.
@@ -27,11 +35,20 @@ def reload(name, skip=False):
         # TODO(SMA): This isn't hooked up on C++ end. Possibily passthough here?
         if skip:
             return sys.modules[name]
+        # Archived modules are precompiled and never change on disk.
+        loader = getattr(sys.modules[name], '__loader__', None)
+        if isinstance(loader, _entityx.ArchiveImporter):
+            return sys.modules[name]
         # Nuke it if its imported
         del sys.modules[name]
     except KeyError:
         pass
 
+    if imp is None:
+        # Pick up files created since the last import.
+        importlib.invalidate_caches()
+        return importlib.import_module(name)
+
     # If any of the following calls raises an exception,
     # there's a problem we can't handle -- let the caller handle it.
     fp, pathname, description = find_dotted_module(name)
@@ -0,0 +1,7 @@
+import _entityx
+from entityx import Entity
+
+
+class ArchivedTest(Entity):
+    def from_archive(self):
+        return isinstance(__loader__, _entityx.ArchiveImporter)
@@ -0,0 +1,13 @@
+from entityx import Entity, Component
+from entityx_python_benchmark import Position
+
+
+class Mover(Entity):
+    """A script that does a little arithmetic on its own component."""
+    position = Component(Position)
+
+    def update(self, dt):
+        position = self.position
+        for _ in range(20):
+            position.x += dt
+            position.y = position.x * 0.5
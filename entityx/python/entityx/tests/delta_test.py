@@ -0,0 +1,12 @@
+from entityx import Entity, Component
+from entityx_python_test import Position
+
+
+class DeltaTest(Entity):
+    position = Component(Position)
+
+    def __init__(self):
+        self.label = 'new'
+
+    def update(self, dt):
+        pass
@@ -1,13 +1,13 @@
-from entityx import Entity, emit
+from entityx import emit
+from entityx.tests.event_test import KeepEventTest
 from entityx_python_test import Collision
 
 
-class AnEntity(Entity):
-	pass
-
-
 def emit_collision_from_python():
-    a = AnEntity()
-    b = AnEntity()
-    collision = Collision(a, b)
+    a = KeepEventTest()
+    b = KeepEventTest()
+    collision = Collision(a.entity, b.entity)
     emit(collision)
+    assert a.collided and b.collided
+    # The event is converted to Python once and shared by both handlers.
+    assert len(a.events) == 1 and a.events[0] is b.events[0]
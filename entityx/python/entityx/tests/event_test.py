@@ -7,5 +7,25 @@ class EventTest(Entity):
     def on_collision(self, event):
         assert event.a
         assert event.b
-        assert event.a == self or event.b == self
+        assert event.a.id == self.id or event.b.id == self.id
         self.collided = True
+
+
+class KeepEventTest(EventTest):
+    """Keeps every event it receives. Not for EventConversion.View events,
+    which must not outlive the handler."""
+
+    def __init__(self):
+        self.events = []
+
+    def on_collision(self, event):
+        EventTest.on_collision(self, event)
+        self.events.append(event)
+
+
+class DamageTest(Entity):
+    def __init__(self):
+        self.batches = []
+
+    def on_damage(self, events):
+        self.batches.append([event.amount for event in events])
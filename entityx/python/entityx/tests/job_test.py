@@ -0,0 +1,30 @@
+from entityx import Entity
+
+
+class JobTest(Entity):
+    def __init__(self):
+        self.sum = None
+        self.product = None
+        self.error = None
+        self.submit('add', 2, 3).then(self.on_sum)
+        self.run_async(self.multiply())
+        self.run_async(self.crash())
+
+    def update(self, dt):
+        pass
+
+    def on_sum(self, future):
+        self.sum = future.result()
+
+    def multiply(self):
+        a = yield self.submit('add', 1, 1)
+        b = yield self.submit('add', a, 4)
+        try:
+            yield self.submit('fail')
+        except RuntimeError as e:
+            self.error = str(e)
+        self.product = a * b
+
+    def crash(self):
+        yield self.submit('add', 0, 0)
+        raise ValueError('lost the path')
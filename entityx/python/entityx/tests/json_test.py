@@ -5,4 +5,15 @@ from entityx_python_test import Position, Direction
 class JsonTest(Entity):
     position = Component(Position)
     direction = Component(Direction)
-    py_array = [1,2,3]
\ No newline at end of file
+    py_array = [1,2,3]
+
+    def __init__(self):
+        self.name = 'json "test"'
+
+
+class FragileTest(Entity):
+    fail = False
+
+    def __init__(self):
+        if FragileTest.fail:
+            raise ValueError('failed to restore')
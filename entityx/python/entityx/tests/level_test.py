@@ -0,0 +1,10 @@
+from entityx import Entity, Component
+from entityx_python_test import Position
+
+
+class LevelTest(Entity):
+    position = Component(Position)
+
+    def __init__(self, speed):
+        self.speed = speed
+        self.waypoints = []
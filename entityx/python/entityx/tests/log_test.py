@@ -0,0 +1,9 @@
+from entityx import Entity
+
+
+class LogTest(Entity):
+    def update(self, dt):
+        self.debug('not logged %d', 1)
+        for i in range(100):
+            self.warning('hit %d', i)
+        self.info('done')
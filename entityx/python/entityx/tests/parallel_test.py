@@ -0,0 +1,22 @@
+from entityx import Entity, Component
+from entityx_python_test import Position
+
+
+class ParallelChild(Entity):
+    position = Component(Position, 1, 2)
+
+
+class ParallelTest(Entity):
+    position = Component(Position)
+
+    def __init__(self, spawner=False):
+        self.spawner = spawner
+
+    def update(self, dt):
+        self.position.x += 1
+        if self.spawner:
+            assert self._world.parallel
+            assert self.spawn(ParallelChild) is None
+
+    def on_damage(self, events):
+        self.position.y += sum(event.amount for event in events)
@@ -0,0 +1,16 @@
+from entityx import Entity, Component
+from entityx_python_test import Position
+
+
+class ReplayTest(Entity):
+    position = Component(Position)
+
+    def __init__(self, speed):
+        self.speed = speed
+        self.damage = 0
+
+    def update(self, dt):
+        self.position.x += self.speed * dt
+
+    def on_hit(self, event):
+        self.damage += event.amount
@@ -0,0 +1,17 @@
+from entityx import Entity, Component
+from entityx_python_test import Position
+
+
+class RollbackTest(Entity):
+    position = Component(Position)
+
+    def __init__(self):
+        self.label = 'new'
+        self.elapsed = 0.0
+
+    def update(self, dt):
+        self.elapsed += dt
+
+    def ticker(self):
+        while True:
+            yield self.elapsed
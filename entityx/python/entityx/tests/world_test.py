@@ -0,0 +1,22 @@
+from entityx import Entity, Component
+from entityx_python_test import Position
+
+
+class WorldChild(Entity):
+    position = Component(Position, 1, 2)
+
+
+class WorldTest(Entity):
+    position = Component(Position)
+
+    def __init__(self):
+        self.children = []
+
+    def update(self, dt):
+        # Goes into the world being updated.
+        self.children.append(WorldChild())
+
+    def spawn_child(self):
+        child = self.spawn(WorldChild)
+        assert child._world is self._world
+        self.children.append(child)
@@ -0,0 +1,112 @@
+#!/usr/bin/env python
+"""Pack Python scripts into a precompiled archive for PythonSystem::add_archive().
+
+Usage: bundle.py [--exclude PATTERN] OUTPUT DIR [DIR ...]
+
+Every module and package below each DIR is compiled to bytecode with the
+running interpreter, which must be the Python version PythonSystem is linked
+against. Modules found in more than one DIR are taken from the first.
+
+Archive layout (little-endian):
+
+    header   magic "EXPYARC\\0", version u32, count u32,
+             interpreter magic (4 bytes), reserved u32
+    index    count entries sorted by name: name offset u32, name size u32,
+             code offset u64, code size u64, flags u32 (1 = package),
+             reserved u32
+    names    module names, UTF-8
+    code     marshalled code objects
+"""
+from __future__ import print_function
+
+import argparse
+import fnmatch
+import marshal
+import os
+import struct
+import sys
+
+try:
+    from importlib.util import MAGIC_NUMBER
+except ImportError:
+    from imp import get_magic
+    MAGIC_NUMBER = get_magic()
+
+HEADER = struct.Struct('<8sII4sI')
+ENTRY = struct.Struct('<IIQQII')
+MAGIC = b'EXPYARC\0'
+VERSION = 1
+FLAG_PACKAGE = 1
+
+
+def find_modules(root):
+    """Yield (module name, path, is_package) for scripts below root."""
+    for dirpath, dirnames, filenames in os.walk(root):
+        relative = os.path.relpath(dirpath, root)
+        parts = [] if relative == os.curdir else relative.split(os.sep)
+        if parts and '__init__.py' not in filenames:
+            # Not a package, so nothing below it is importable.
+            del dirnames[:]
+            continue
+        dirnames.sort()
+        for filename in sorted(filenames):
+            if not filename.endswith('.py'):
+                continue
+            if filename == '__init__.py':
+                if parts:
+                    yield '.'.join(parts), os.path.join(dirpath, filename), True
+            else:
+                yield '.'.join(parts + [filename[:-3]]), os.path.join(dirpath, filename), False
+
+
+def compile_module(name, path, root):
+    with open(path, 'rb') as f:
+        source = f.read()
+    # Tracebacks show the path relative to the bundled directory.
+    filename = os.path.relpath(path, root).replace(os.sep, '/')
+    code = compile(source, filename, 'exec', 0, True)
+    return marshal.dumps(code)
+
+
+def bundle(output, roots, excludes=()):
+    modules = {}
+    for root in roots:
+        for name, path, package in find_modules(root):
+            if name in modules or any(fnmatch.fnmatch(name, p) for p in excludes):
+                continue
+            modules[name] = (compile_module(name, path, root), package)
+
+    names = sorted(name.encode('utf-8') for name in modules)
+    index_size = HEADER.size + ENTRY.size * len(names)
+    name_offset = index_size
+    code_offset = index_size + sum(len(name) for name in names)
+    entries, codes = [], []
+    for name in names:
+        code, package = modules[name.decode('utf-8')]
+        entries.append(ENTRY.pack(name_offset, len(name), code_offset, len(code),
+                                  FLAG_PACKAGE if package else 0, 0))
+        codes.append(code)
+        name_offset += len(name)
+        code_offset += len(code)
+
+    with open(output, 'wb') as f:
+        f.write(HEADER.pack(MAGIC, VERSION, len(names), MAGIC_NUMBER, 0))
+        f.write(b''.join(entries))
+        f.write(b''.join(names))
+        f.write(b''.join(codes))
+    return len(names)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--exclude', action='append', default=[],
+                        help='skip modules matching this glob, e.g. "*.tests.*"')
+    parser.add_argument('output')
+    parser.add_argument('dirs', nargs='+')
+    args = parser.parse_args(argv)
+    count = bundle(args.output, args.dirs, args.exclude)
+    print('Bundled %d modules into %s' % (count, args.output))
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,100 @@
+#!/usr/bin/env python
+"""Find where two runs diverged, from logs of PythonSystem::hash_frames().
+
+Usage: hashdiff.py [--all] EXPECTED ACTUAL
+
+Prints the first frame whose hash differs and the entities whose hashes
+differ in it, then exits with status 1. A log that stops early differs
+too. Exits with status 0 if both logs have the same frames and they match.
+"""
+from __future__ import print_function
+
+import argparse
+import struct
+import sys
+
+try:
+    from itertools import zip_longest
+except ImportError:
+    from itertools import izip_longest as zip_longest
+
+HEADER = struct.Struct('=8sQ')
+FRAME = struct.Struct('=QQQ')
+ENTITY = struct.Struct('=QQ')
+MAGIC = b'EXPYHASH'
+
+
+def read_frames(path):
+    """Yield (frame, hash, {entity: hash}) for every frame of a log."""
+    with open(path, 'rb') as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        raise ValueError('%s is not a frame hash log' % path)
+    magic, version = HEADER.unpack_from(data, 0)
+    if magic != MAGIC or version != 1:
+        raise ValueError('%s is not a frame hash log' % path)
+    offset = HEADER.size
+    while offset + FRAME.size <= len(data):
+        frame, frame_hash, count = FRAME.unpack_from(data, offset)
+        offset += FRAME.size
+        if offset + count * ENTITY.size > len(data):
+            # The run stopped while writing this frame.
+            return
+        entities = {}
+        for _ in range(count):
+            entity, entity_hash = ENTITY.unpack_from(data, offset)
+            offset += ENTITY.size
+            entities[entity] = entity_hash
+        yield frame, frame_hash, entities
+
+
+def format_entity(entity):
+    return '%d.%d' % (entity & 0xffffffff, entity >> 32)
+
+
+def diverging_entities(expected, actual):
+    """Return [(entity, description)] for entities that differ, by index."""
+    differences = []
+    for entity in sorted(set(expected) | set(actual), key=lambda e: e & 0xffffffff):
+        if entity not in actual:
+            differences.append((entity, 'only in expected'))
+        elif entity not in expected:
+            differences.append((entity, 'only in actual'))
+        elif expected[entity] != actual[entity]:
+            differences.append((entity, 'state differs'))
+    return differences
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('expected')
+    parser.add_argument('actual')
+    parser.add_argument('--all', action='store_true',
+                        help='list every diverging entity, not just the first ten')
+    args = parser.parse_args(argv)
+    frames = 0
+    for expected, actual in zip_longest(read_frames(args.expected), read_frames(args.actual)):
+        if expected is None or actual is None:
+            shorter, longer = ('expected', actual) if expected is None else ('actual', expected)
+            print('frame counts differ: %s ends after %d frames, before frame %d'
+                  % (shorter, frames, longer[0]))
+            return 1
+        if expected[0] != actual[0]:
+            print('frame numbers differ: %d in expected, %d in actual' % (expected[0], actual[0]))
+            return 1
+        if expected[1] != actual[1]:
+            differences = diverging_entities(expected[2], actual[2])
+            print('first diverging frame: %d' % expected[0])
+            shown = differences if args.all else differences[:10]
+            for entity, description in shown:
+                print('  entity %s: %s' % (format_entity(entity), description))
+            if len(shown) < len(differences):
+                print('  ... and %d more' % (len(differences) - len(shown)))
+            return 1
+        frames += 1
+    print('%d frames match' % frames)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
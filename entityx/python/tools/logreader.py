@@ -0,0 +1,85 @@
+#!/usr/bin/env python
+"""Print binary script logs written by entityx::python::BinaryLogSink.
+
+Usage: logreader.py [--level LEVEL] [--entity ID] PATH
+
+PATH is the path given to BinaryLogSink; all of its segments (PATH.0,
+PATH.1, ...) are read in the order they were written.
+"""
+from __future__ import print_function
+
+import argparse
+import datetime
+import glob
+import struct
+import sys
+
+SEGMENT_HEADER = struct.Struct('<8sIIQQ')
+RECORD_HEADER = struct.Struct('<QQII')
+MAGIC = b'EXPYLOG\0'
+LEVELS = {10: 'DEBUG', 20: 'INFO', 30: 'WARNING', 40: 'ERROR'}
+INVALID_ENTITY = 0
+
+
+def read_segment(path):
+    """Return (sequence, [(timestamp, entity, level, message)]) for a segment."""
+    with open(path, 'rb') as f:
+        data = f.read()
+    if len(data) < SEGMENT_HEADER.size:
+        return None
+    magic, version, header_size, sequence, size = SEGMENT_HEADER.unpack_from(data, 0)
+    if magic != MAGIC or version != 1:
+        raise ValueError('%s is not a binary script log' % path)
+    records = []
+    offset = header_size
+    end = min(header_size + size, len(data))
+    while offset + RECORD_HEADER.size <= end:
+        timestamp, entity, level, length = RECORD_HEADER.unpack_from(data, offset)
+        offset += RECORD_HEADER.size
+        message = data[offset:offset + length].decode('utf-8', 'replace')
+        offset += (length + 7) & ~7
+        records.append((timestamp, entity, level, message))
+    return sequence, records
+
+
+def read_log(path):
+    """Yield (timestamp, entity, level, message) from all segments of a log."""
+    segments = []
+    for segment_path in glob.glob(path + '.*'):
+        if not segment_path[len(path) + 1:].isdigit():
+            continue
+        segment = read_segment(segment_path)
+        if segment is not None:
+            segments.append(segment)
+    for _, records in sorted(segments, key=lambda segment: segment[0]):
+        for record in records:
+            yield record
+
+
+def format_record(timestamp, entity, level, message):
+    when = datetime.datetime.utcfromtimestamp(timestamp / 1e9).isoformat()
+    if entity == INVALID_ENTITY:
+        who = '-'
+    else:
+        who = '%d.%d' % (entity & 0xffffffff, entity >> 32)
+    return '%s %-7s %s %s' % (when, LEVELS.get(level, level), who, message)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('path')
+    parser.add_argument('--level', default='DEBUG', choices=sorted(LEVELS.values()),
+                        help='only show records at or above this level')
+    parser.add_argument('--entity', help='only show records for entity INDEX.VERSION')
+    args = parser.parse_args(argv)
+    min_level = dict((name, value) for value, name in LEVELS.items())[args.level]
+    for timestamp, entity, level, message in read_log(args.path):
+        if level < min_level:
+            continue
+        if args.entity and '%d.%d' % (entity & 0xffffffff, entity >> 32) != args.entity:
+            continue
+        print(format_record(timestamp, entity, level, message))
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
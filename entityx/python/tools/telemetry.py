@@ -0,0 +1,127 @@
+#!/usr/bin/env python
+"""Read samples from a file written by PythonSystem::sample_fields().
+
+Usage: telemetry.py [--csv] [--last N] FILE
+
+Prints a summary of each sample still in the file, oldest first, or with
+--csv one row per entity and sample. The file may be read while the world
+that writes it is running; samples being overwritten are skipped.
+
+read_samples() may also be imported to get the columns as lists.
+"""
+from __future__ import print_function
+
+import argparse
+import mmap
+import struct
+import sys
+
+HEADER = struct.Struct('=8sIIQQQQQ64s')
+COLUMN = struct.Struct('=48sIIQ')
+BLOCK = struct.Struct('=QQQQ')
+MAGIC = b'EXPYTELE'
+# By FieldType.
+FORMATS = ['?', 'i', 'I', 'q', 'Q', 'f', 'd']
+
+
+def read_name(field):
+    return field.split(b'\0', 1)[0].decode('utf-8')
+
+
+class Sample(object):
+    def __init__(self, frame, total, ids, columns):
+        self.frame = frame
+        # How many entities had the component; more than len(ids) if the
+        # sample was cut off at the stream's capacity.
+        self.total = total
+        self.ids = ids
+        self.columns = columns
+
+
+def read_header(data, path):
+    if len(data) < HEADER.size:
+        raise ValueError('%s is not a telemetry file' % path)
+    (magic, version, columns, capacity, slots, block_size, every, written,
+     component) = HEADER.unpack_from(data, 0)
+    if magic != MAGIC or version != 1:
+        raise ValueError('%s is not a telemetry file' % path)
+    fields = []
+    offset = HEADER.size
+    for _ in range(columns):
+        name, kind, size, column_offset = COLUMN.unpack_from(data, offset)
+        fields.append((read_name(name), FORMATS[kind], column_offset))
+        offset += COLUMN.size
+    data_offset = (offset + 7) & ~7
+    return {'component': read_name(component), 'fields': fields, 'slots': slots,
+            'block_size': block_size, 'every': every, 'data_offset': data_offset}
+
+
+def read_block(data, header, slot, sequence):
+    """Return the Sample in `slot` if it still holds `sequence`, else None."""
+    start = header['data_offset'] + slot * header['block_size']
+    before = BLOCK.unpack_from(data, start)[0]
+    block = data[start:start + header['block_size']]
+    after = BLOCK.unpack_from(data, start)[0]
+    if before != sequence or after != sequence:
+        return None
+    frame, count, total = BLOCK.unpack_from(block, 0)[1:]
+    ids = list(struct.unpack_from('=%dQ' % count, block, BLOCK.size))
+    columns = {}
+    for name, fmt, offset in header['fields']:
+        columns[name] = list(struct.unpack_from('=%d%s' % (count, fmt), block, offset))
+    return Sample(frame, total, ids, columns)
+
+
+def read_samples(path, last=None):
+    """Return (component, [Sample]) for the samples in the file, oldest first."""
+    with open(path, 'rb') as f:
+        data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    try:
+        header = read_header(data, path)
+        written = HEADER.unpack_from(data, 0)[7]
+        kept = min(written, header['slots'])
+        if last is not None:
+            kept = min(kept, last)
+        samples = []
+        for sequence in range(written - kept + 1, written + 1):
+            sample = read_block(data, header, (sequence - 1) % header['slots'], sequence)
+            if sample is not None:
+                samples.append(sample)
+        return header['component'], samples
+    finally:
+        data.close()
+
+
+def format_entity(entity):
+    return '%d.%d' % (entity & 0xffffffff, entity >> 32)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('file')
+    parser.add_argument('--csv', action='store_true', help='print every value')
+    parser.add_argument('--last', type=int, help='only the newest N samples')
+    args = parser.parse_args(argv)
+    component, samples = read_samples(args.file, args.last)
+    names = sorted(samples[0].columns) if samples else []
+    if args.csv:
+        print(','.join(['frame', 'entity'] + ['%s.%s' % (component, n) for n in names]))
+        for sample in samples:
+            for row, entity in enumerate(sample.ids):
+                values = [str(sample.columns[n][row]) for n in names]
+                print(','.join([str(sample.frame), format_entity(entity)] + values))
+        return 0
+    for sample in samples:
+        line = 'frame %d: %d entities' % (sample.frame, len(sample.ids))
+        if sample.total > len(sample.ids):
+            line += ' of %d' % sample.total
+        for name in names:
+            values = sample.columns[name]
+            if values:
+                line += ', %s %s..%s' % (name, min(values), max(values))
+        print(line)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))